@@ -1,7 +1,7 @@
 #ifndef BITVAULT_H
 #define BITVAULT_H
 
-#include <Arduino.h>
+#include <stdint.h>
 //#include <atomic>
 
 // Primary template for BitVault (non-atomic version)
@@ -27,6 +27,16 @@ class BitVault {
         }
     }
 
+    // Retrieves every bit at once
+    T get_all() const {
+        return bits;
+    }
+
+    // Replaces every bit at once
+    void set_all(T value) {
+        bits = value;
+    }
+
     // Clears all the bits by resetting 'bits' to 0
     void clear_all() {
         bits = 0;  // Direct assignment to clear all bits
@@ -1,6 +1,9 @@
 #include "chippycore.h"
+#include "ChippyHost.h"
 
 //#define USE_STACK
+//#define USE_POLICY_HOST   // Integrate through ChippyHost policies instead of the callbacks below
+//#define USE_PSRAM         // Guest RAM pages in PSRAM (ESP32-WROVER), the translation caches in internal RAM
 
 #ifndef USE_STACK
     ChippyCore cc;
@@ -24,6 +27,29 @@ void screenUpdateCallback(bool clearScreen, bool updateScreen){
 void loopCallback(uint8_t& keySet, bool& keyState, bool& pause, bool& stop){
 }
 
+// Callback function for the error that stopped the emulator, it must not block
+void errorCallback(const ErrorReport& error){
+    Serial.printf("ERROR %u at PC 0x%03X opcode 0x%04X SP %u\n", error.code, error.cpu.PC, error.opcode, error.cpu.SP);
+}
+
+// The same integration as policies, called once per 60 Hz frame and inlined into ChippyHost::loop()
+struct SketchDisplay {
+    void present(const DisplayFrame& frame){
+        // Send the rows set in frame.dirty_rows to the display here
+    }
+};
+
+struct SketchInput {
+    void poll(HostInput& input){
+        // Set input.keys (bit n is key n), input.pause and input.stop from the keypad here
+    }
+};
+
+SketchDisplay sketchDisplay;
+SketchInput sketchInput;
+NoAudio sketchAudio;
+PlatformClock sketchClock;
+
 //There are some roms that needs those quirks.
 //I do not know yet which ones. Every rom you load can have his own set of quirks.
 bool default_quirkconfig[5] =  {   
@@ -53,10 +79,43 @@ void showFreeMemory(){
     Serial.println(xPortGetMinimumEverFreeHeapSize());
 }
 
+// Function to print the memory held by an emulator instance
+void showFootprint(ChippyCore& core){
+    CoreFootprint footprint = core.get_footprint();
+    Serial.printf("Instance: %u (display %u), guest RAM: %u, translation: %u, analysis: %u (%u while loading), history: %u, total: %u\n",
+                  footprint.instance, footprint.display, footprint.guest_memory, footprint.translation,
+                  footprint.analysis, footprint.transient, footprint.history, footprint.total);
+}
+
+#ifdef USE_PSRAM
+// Allocator hook: the buffers read at every opcode stay in internal RAM, the rest goes to PSRAM
+void* psramAlloc(size_t size, uint8_t use){
+    uint32_t caps = use == ALLOC_TRANSLATION ? MALLOC_CAP_INTERNAL : MALLOC_CAP_SPIRAM;
+    return heap_caps_malloc(size, caps | MALLOC_CAP_8BIT);
+}
+
+void psramFree(void* memory, uint8_t use){
+    heap_caps_free(memory);
+}
+#endif
+
 
 void playGame(const uint8_t* rom, const size_t romSize, const bool* quirkconfig_game){
-    #ifdef USE_STACK
+    #if defined(USE_POLICY_HOST) && !defined(USE_STACK)
+        static ChippyHost<SketchDisplay, SketchInput, NoAudio, PlatformClock> host(cc, sketchDisplay, sketchInput, sketchAudio, sketchClock);
+        if(!host.isRunning()){
+            host.load_and_run(rom, romSize, quirkconfig_game);
+        }
+        else{
+            host.loop();
+        }
+
+    #elif defined(USE_STACK)
         ChippyCore cc;
+        #ifdef USE_PSRAM
+            cc.set_allocator(&psramAlloc, &psramFree);
+        #endif
+        cc.set_error_callback(&errorCallback);
         cc.load_and_run(rom, romSize, &drawPixelCallback, &screenUpdateCallback, &loopCallback, quirkconfig_game);
         while(cc.isRunning()){
             cc.loop();
@@ -77,11 +136,17 @@ void playGame(const uint8_t* rom, const size_t romSize, const bool* quirkconfig_
 void setup() {
     Serial.begin(115200);
     delay(1000);
+    #ifndef USE_STACK
+        #ifdef USE_PSRAM
+            cc.set_allocator(&psramAlloc, &psramFree);
+        #endif
+        cc.set_error_callback(&errorCallback);
+    #endif
 }
 
 void loop() {
-    // Example ROM data to be loaded
-    const uint8_t ROM[] = {0x12, 0x25};
+    // Example ROM data to be loaded. Static, so it stays in flash and is read in place while it runs
+    static const uint8_t ROM[] = {0x12, 0x25};
     // Start the game with the specified ROM
     playGame(ROM, sizeof(ROM), default_quirkconfig);
 }
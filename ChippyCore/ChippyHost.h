@@ -0,0 +1,204 @@
+#ifndef CHIPPYHOST_H
+#define CHIPPYHOST_H
+
+#include "chippycore.h"
+
+///***********************************************************************************************///
+///                                        POLICY HOST                                            ///
+///                                                                                               ///
+/// Front-end that connects a ChippyCore to the board through four policy types instead of        ///
+/// function pointers. The calls are resolved at compile time and inline into the frame loop, and ///
+/// none of them runs between opcodes: the core runs headless, and once per 60 Hz frame the host  ///
+/// polls the input, runs the frame's opcodes, presents the changed rows and updates the sound.   ///
+///                                                                                               ///
+///   Display  void present(const DisplayFrame& frame)   rows changed since the last present     ///
+///   Input    void poll(HostInput& input)                before every frame, input holds the     ///
+///                                                       current state, change what differs      ///
+///            static constexpr uint32_t poll_us          optional, also poll that often between  ///
+///                                                       frames, changes go to the key queue     ///
+///   Audio    void frame(bool sound)                     after every tick                        ///
+///   Clock    uint32_t micros(), void idle(uint32_t us)  pacing, idle() when no frame is due     ///
+///                                                                                               ///
+/// The Callback* policies below wrap the classic function pointers, PlatformClock the platform   ///
+/// layer. ChippyCore::load_and_run() with callbacks keeps working unchanged next to this.        ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//What the input policy reports before every frame
+struct HostInput {
+    uint16_t keys;      // Bit n is key n
+    bool pause;
+    bool stop;
+};
+
+//Policies over the classic callbacks, for ROM hosts that already have them
+struct CallbackDisplay {
+    ChippyCore::presentCallback callback;
+    inline void present(const DisplayFrame& frame){
+        callback(frame);
+    }
+};
+
+//Polls a loopCallback like ChippyCore::loop() does, every LOOP_POLL_US, so a key pressed and released
+//between two frames is still seen. Each call reports at most one key change.
+struct CallbackInput {
+    static constexpr uint32_t poll_us = LOOP_POLL_US;
+    ChippyCore::loopCallback callback;
+    inline void poll(HostInput& input){
+        uint8_t key = 255;
+        bool pressed = false;
+        callback(key, pressed, input.pause, input.stop);
+        if (key < MAX_16) {
+            input.keys = pressed ? input.keys | (1 << key) : input.keys & ~(1 << key);
+        }
+    }
+};
+
+struct NoAudio {
+    inline void frame(bool){}
+};
+
+struct NoInput {
+    inline void poll(HostInput&){}
+};
+
+//Input::poll_us, 0 for policies that are only polled before every frame
+template<class Input, class = void>
+struct InputPollUs {
+    static constexpr uint32_t value = 0;
+};
+template<class Input>
+struct InputPollUs<Input, decltype(void(Input::poll_us))> {
+    static constexpr uint32_t value = Input::poll_us;
+};
+
+struct PlatformClock {
+    inline uint32_t micros(){
+        return platform_micros();
+    }
+    //Millisecond sleeps, which yield to the other FreeRTOS tasks on the ESP32
+    inline void idle(uint32_t us){
+        platform_delay(us >= 1000 ? us / 1000 : 1);
+    }
+};
+
+template<class Display, class Input, class Audio, class Clock>
+class ChippyHost{
+    public:
+        ChippyHost(ChippyCore& core, Display& display, Input& input, Audio& audio, Clock& clock)
+            : _core(core), _display(display), _input(input), _audio(audio), _clock(clock){
+        }
+
+        //load_and_run() without callbacks, the policies take their place. displayWait as in
+        //ChippyCore::set_present_callback().
+        void load_and_run(const uint8_t* data, size_t dataSize, const bool* config, bool displayWait = false){
+            _core.set_present_callback(nullptr, displayWait);
+            _core.load_and_run(data, dataSize, nullptr, nullptr, nullptr, config);
+            _state = {0, false, false};
+            _queued = false;
+            _core.set_keypad_mask(0);
+            _last = _clock.micros();
+            _phase = 0;
+        }
+
+        //instructionsPerFrame opcodes per 60 Hz frame, a late caller catches up at most maxCatchUpFrames
+        void set_speed(uint16_t instructionsPerFrame, uint8_t maxCatchUpFrames = DEFAULT_MAX_CATCHUP_FRAMES){
+            _instructionsPerFrame = instructionsPerFrame;
+            _maxCatchUpFrames = maxCatchUpFrames;
+        }
+
+        bool isRunning(){
+            return _core.isRunning();
+        }
+
+        //Runs every frame that is due, or idles until the next one when none is. Returns the opcodes run.
+        uint32_t loop(){
+            if (!_core.isRunning()) {
+                return 0;
+            }
+            uint32_t now = _clock.micros();
+            uint64_t phase = _phase + static_cast<uint64_t>(now - _last) * 60;
+            _last = now;
+            uint64_t frames = phase / FRAME_PHASE_UNITS;
+            if (frames > _maxCatchUpFrames) {
+                phase = static_cast<uint64_t>(_maxCatchUpFrames) * FRAME_PHASE_UNITS + phase % FRAME_PHASE_UNITS;
+                frames = _maxCatchUpFrames;
+            }
+            _phase = static_cast<uint32_t>(phase - frames * FRAME_PHASE_UNITS);
+            if (!frames) {
+                uint32_t wait = (FRAME_PHASE_UNITS - _phase + 59) / 60;
+                if (InputPollUs<Input>::value) {
+                    uint16_t keys = _state.keys;
+                    _input.poll(_state);
+                    queue_keys(keys);
+                    wait = wait < InputPollUs<Input>::value ? wait : InputPollUs<Input>::value;
+                }
+                _clock.idle(wait);
+                return 0;
+            }
+            uint32_t executed = 0;
+            for (uint64_t frame = 0; frame < frames && _core.isRunning(); frame++) {
+                executed += run_frame();
+            }
+            return executed;
+        }
+
+        //One frame right away, without the clock (headless runs)
+        uint32_t run_frame(){
+            if (_queued && _core.get_keypad_mask() == _state.keys) {
+                _queued = false;    //The core applied every queued change
+            }
+            uint16_t keys = _state.keys;
+            _input.poll(_state);
+            if (_state.stop) {
+                _core.stop();
+                return 0;
+            }
+            if (_queued) {
+                queue_keys(keys);   //Behind the queued changes, or the keypad would go back to an older state
+            }
+            else if (_state.keys != keys) {
+                _core.set_keypad_mask(_state.keys);
+            }
+            if (_state.pause) {
+                return 0;
+            }
+            uint32_t executed = _core.run_frame(_instructionsPerFrame);
+            DisplayFrame frame = _core.take_display_frame();
+            if (frame.dirty_rows) {
+                _display.present(frame);
+            }
+            _audio.frame(_core.is_sound_on());
+            return executed;
+        }
+
+        ChippyCore& core(){
+            return _core;
+        }
+
+    private:
+        //Key changes since keys go through the core's event queue, applied one per key at every tick
+        void queue_keys(uint16_t keys){
+            uint16_t changed = keys ^ _state.keys;
+            for (uint8_t key = 0; key < MAX_16; key++) {
+                if (changed & (1 << key)) {
+                    _core.push_key_event(key, (_state.keys >> key) & 1);
+                    _queued = true;
+                }
+            }
+        }
+
+        ChippyCore& _core;
+        Display& _display;
+        Input& _input;
+        Audio& _audio;
+        Clock& _clock;
+
+        HostInput _state = {0, false, false};
+        uint16_t _instructionsPerFrame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+        uint8_t _maxCatchUpFrames = DEFAULT_MAX_CATCHUP_FRAMES;
+        uint32_t _last = 0;     ///< Clock of the last loop()
+        uint32_t _phase = 0;    ///< Time into the current frame, FRAME_PHASE_UNITS per frame
+        bool _queued = false;   ///< Key changes are in the core's event queue
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef FASTRANDOM_H
+#define FASTRANDOM_H
+
+#include <stdint.h>
+
+///***********************************************************************************************///
+///                                        FAST RANDOM                                            ///
+///                                                                                               ///
+/// xorshift32 for CXNN: three shifts and xors per number, no hardware register and no lock, and  ///
+/// the same seed always gives the same numbers on the ESP32 and the host. The seed goes through  ///
+/// the murmur3 finalizer first, so neighbouring seeds start far apart and 0 is a valid seed.     ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define FAST_RANDOM_ZERO_STATE 0x6D2B79F5   // Taken instead of the one seed that mixes to 0
+
+class FastRandom{
+    public:
+        inline void seed(uint32_t seed){
+            seed ^= seed >> 16;
+            seed *= 0x85EBCA6B;
+            seed ^= seed >> 13;
+            seed *= 0xC2B2AE35;
+            seed ^= seed >> 16;
+            _state = seed ? seed : FAST_RANDOM_ZERO_STATE;
+        }
+
+        inline uint32_t next(){
+            uint32_t x = _state;
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            _state = x;
+            return x;
+        }
+
+        //The high byte, the low bits of xorshift are the weakest
+        inline uint8_t next_byte(){
+            return next() >> 24;
+        }
+
+        //Raw generator state for snapshots
+        inline uint32_t state() const{
+            return _state;
+        }
+        inline void set_state(uint32_t state){
+            _state = state ? state : FAST_RANDOM_ZERO_STATE;
+        }
+
+    private:
+        uint32_t _state = FAST_RANDOM_ZERO_STATE;
+};
+
+#endif
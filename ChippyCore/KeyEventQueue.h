@@ -0,0 +1,57 @@
+#ifndef KEYEVENTQUEUE_H
+#define KEYEVENTQUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+///***********************************************************************************************///
+///                                      KEY EVENT QUEUE                                          ///
+///                                                                                               ///
+/// Single producer, single consumer ring of keypad events. The producer (an ISR, a GPIO handler  ///
+/// or another thread) pushes, the emulator drains once per frame. No locks and no allocation:    ///
+/// push() only touches the head index, the consumer only the tail index.                         ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define KEY_QUEUE_SIZE 32           // Power of two
+#define KEY_EVENT_PRESSED 0x80      // Event byte: key number in the low nibble, this bit set on press
+
+class KeyEventQueue{
+    public:
+        //Producer side, false when the queue is full and the event was dropped
+        inline bool push(uint8_t key, bool pressed){
+            uint32_t head = _head.load(std::memory_order_relaxed);
+            if (head - _tail.load(std::memory_order_acquire) >= KEY_QUEUE_SIZE) {
+                return false;
+            }
+            _events[head & (KEY_QUEUE_SIZE - 1)] = key | (pressed ? KEY_EVENT_PRESSED : 0);
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        //Consumer side, the oldest event without removing it
+        inline bool peek(uint8_t& key, bool& pressed) const{
+            uint32_t tail = _tail.load(std::memory_order_relaxed);
+            if (tail == _head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            uint8_t event = _events[tail & (KEY_QUEUE_SIZE - 1)];
+            key = event & 0x0F;
+            pressed = (event & KEY_EVENT_PRESSED) != 0;
+            return true;
+        }
+
+        inline void pop(){
+            _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        //Consumer side, drops everything pushed so far
+        inline void clear(){
+            _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+    private:
+        uint8_t _events[KEY_QUEUE_SIZE];
+        std::atomic<uint32_t> _head{0};
+        std::atomic<uint32_t> _tail{0};
+};
+
+#endif
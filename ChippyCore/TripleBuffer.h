@@ -0,0 +1,54 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+
+///***********************************************************************************************///
+///                                       TRIPLE BUFFER                                           ///
+///                                                                                               ///
+/// Lock-free handoff of the latest value from one producer to one consumer. The producer fills   ///
+/// write_buffer() and publishes it, the consumer picks up the newest published value with        ///
+/// update(). Neither side ever waits: a value the consumer did not pick up in time is replaced   ///
+/// by the next one.                                                                              ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename T>
+class TripleBuffer{
+    public:
+        //Producer side
+        T& write_buffer(){
+            return _buffers[_back];
+        }
+
+        //Hands the write buffer to the consumer. Returns false when the previous value was never read.
+        bool publish(){
+            uint8_t previous = _middle.exchange(_back | FRESH, std::memory_order_acq_rel);
+            _back = previous & INDEX_MASK;
+            return !(previous & FRESH);
+        }
+
+        //Consumer side, true when a newer value than the current read_buffer() was taken
+        bool update(){
+            if (!(_middle.load(std::memory_order_acquire) & FRESH)) {
+                return false;
+            }
+            uint8_t previous = _middle.exchange(_front, std::memory_order_acq_rel);
+            _front = previous & INDEX_MASK;
+            return true;
+        }
+
+        const T& read_buffer() const{
+            return _buffers[_front];
+        }
+
+    private:
+        static const uint8_t INDEX_MASK = 0x03;
+        static const uint8_t FRESH = 0x04;     // Set while the middle buffer holds an unread value
+
+        T _buffers[3];
+        alignas(64) std::atomic<uint8_t> _middle{1};    // Own cache line, the only shared state
+        alignas(64) uint8_t _back = 0;                  // Producer only
+        alignas(64) uint8_t _front = 2;                 // Consumer only
+};
+
+#endif
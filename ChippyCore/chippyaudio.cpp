@@ -0,0 +1,118 @@
+#include "chippyaudio.h"
+#include <math.h>
+#include <string.h>
+
+#define AUDIO_PHASE_SHIFT 25        // 7 bits of pattern position above the fraction
+#define AUDIO_PATTERN_RATE 4000.0f  // XO-CHIP bits per second at pitch 64
+
+//One square wave cycle over the 128 pattern bits
+static const uint8_t BEEP_PATTERN[AUDIO_PATTERN_BYTES] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+ChippyAudio::ChippyAudio(uint32_t sampleRate, int16_t amplitude, uint16_t beepHz)
+    : _sampleRate(sampleRate), _amplitude(amplitude),
+      _beepStep(static_cast<uint32_t>((static_cast<uint64_t>(beepHz) * AUDIO_PATTERN_BYTES * 8 << AUDIO_PHASE_SHIFT) / sampleRate)){
+}
+
+uint32_t ChippyAudio::pitch_step(uint8_t pitch) const{
+    float bitsPerSecond = AUDIO_PATTERN_RATE * exp2f((pitch - 64) / 48.0f);
+    return static_cast<uint32_t>(bitsPerSecond * (1 << AUDIO_PHASE_SHIFT) / _sampleRate);
+}
+
+// count samples of the pattern from the current phase
+void ChippyAudio::render(int16_t* out, uint16_t count, const uint8_t* pattern, uint32_t step){
+    uint32_t phase = _phase;
+    int16_t high = _amplitude;
+    int16_t low = -_amplitude;
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t bit = phase >> AUDIO_PHASE_SHIFT;
+        out[i] = (pattern[bit >> 3] & (0x80 >> (bit & 7))) ? high : low;
+        phase += step;
+    }
+    _phase = phase;
+}
+
+void ChippyAudio::render_frame(bool active, const uint8_t* pattern, uint8_t pitch){
+    uint32_t step = _beepStep;
+    if (!pattern) {
+        pattern = BEEP_PATTERN;
+    }
+    else {
+        if (_pitch != pitch) {
+            _pitch = pitch;
+            _patternStep = pitch_step(pitch);
+        }
+        step = _patternStep;
+    }
+
+    _frameRemainder += _sampleRate;
+    uint32_t samples = _frameRemainder / 60;
+    _frameRemainder %= 60;
+    while (samples) {
+        if (!_block) {
+            uint32_t head = _head.load(std::memory_order_relaxed);
+            bool full = head - _tail.load(std::memory_order_acquire) >= AUDIO_RING_BLOCKS;
+            _block = full ? _overflow : _blocks[head & (AUDIO_RING_BLOCKS - 1)];
+            _filled = 0;
+        }
+        uint16_t count = AUDIO_BLOCK_SAMPLES - _filled;
+        if (count > samples) {
+            count = samples;
+        }
+        if (active) {
+            render(_block + _filled, count, pattern, step);
+        }
+        else {
+            memset(_block + _filled, 0, count * sizeof(int16_t));
+        }
+        _filled += count;
+        samples -= count;
+        if (_filled == AUDIO_BLOCK_SAMPLES) {
+            if (_block == _overflow) {
+                _stats.dropped_blocks++;
+            }
+            else {
+                _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                _stats.rendered_blocks++;
+            }
+            _block = nullptr;
+        }
+    }
+}
+
+const int16_t* ChippyAudio::read_block() const{
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    return _blocks[tail & (AUDIO_RING_BLOCKS - 1)];
+}
+
+void ChippyAudio::release_block(){
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail != _head.load(std::memory_order_acquire)) {
+        _tail.store(tail + 1, std::memory_order_release);
+    }
+}
+
+uint32_t ChippyAudio::ready_blocks() const{
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+}
+
+void ChippyAudio::reset(){
+    _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+    _block = nullptr;
+    _filled = 0;
+    _phase = 0;
+    _frameRemainder = 0;
+    _stats = {0, 0};
+}
+
+uint32_t ChippyAudio::sample_rate() const{
+    return _sampleRate;
+}
+
+AudioStats ChippyAudio::get_stats() const{
+    return _stats;
+}
@@ -0,0 +1,74 @@
+#ifndef CHIPPYAUDIO_H
+#define CHIPPYAUDIO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "defines.h"
+
+///***********************************************************************************************///
+///                                       AUDIO PIPELINE                                          ///
+///                                                                                               ///
+/// Signed 16 bit mono PCM in a ring of fixed size blocks, ready to be handed to I2S DMA. The     ///
+/// core renders one 60 Hz frame of samples at every timer tick: silence while the sound timer    ///
+/// is zero, otherwise the XO-CHIP pattern buffer (128 one bit samples, MSB first) played at      ///
+/// 4000 * 2^((pitch - 64) / 48) bits per second. Before a ROM loads a pattern with F002 the      ///
+/// plain CHIP-8 beeper plays, a square wave at the beep frequency. The phase runs on across      ///
+/// frames so the waveform never clicks at a frame boundary.                                      ///
+///                                                                                               ///
+/// Single producer (the emulator), single consumer (the I2S or file writer). Neither side       ///
+/// waits: when the ring is full the newest block is dropped and counted.                         ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define AUDIO_SAMPLE_RATE 24000     // 400 samples per 60 Hz frame
+#define AUDIO_BLOCK_SAMPLES 200     // One DMA buffer
+#define AUDIO_RING_BLOCKS 8         // Power of two, 4 frames of latency at most
+#define AUDIO_BEEP_HZ 440
+#define AUDIO_AMPLITUDE 6000
+
+struct AudioStats {
+    uint32_t rendered_blocks;
+    uint32_t dropped_blocks;    // Blocks lost because the consumer fell behind
+};
+
+class ChippyAudio{
+    public:
+        explicit ChippyAudio(uint32_t sampleRate = AUDIO_SAMPLE_RATE, int16_t amplitude = AUDIO_AMPLITUDE,
+                             uint16_t beepHz = AUDIO_BEEP_HZ);
+
+        //Producer side, called by the core once per 60 Hz tick. pattern is nullptr for the beeper.
+        void render_frame(bool active, const uint8_t* pattern, uint8_t pitch);
+
+        //Consumer side: the oldest complete block, nullptr when none is ready. It stays valid and in the
+        //ring until release_block().
+        const int16_t* read_block() const;
+        void release_block();
+        uint32_t ready_blocks() const;
+
+        //Drops every block and restarts the waveform, only while the producer is not rendering
+        void reset();
+
+        uint32_t sample_rate() const;
+        AudioStats get_stats() const;
+
+    private:
+        int16_t _blocks[AUDIO_RING_BLOCKS][AUDIO_BLOCK_SAMPLES];
+        int16_t _overflow[AUDIO_BLOCK_SAMPLES];     // Written instead while the ring is full
+        std::atomic<uint32_t> _head{0};     // Producer only writes
+        std::atomic<uint32_t> _tail{0};     // Consumer only writes
+
+        int16_t* _block = nullptr;      // Block being filled, nullptr between blocks
+        uint16_t _filled = 0;
+        uint32_t _sampleRate;
+        int16_t _amplitude;
+        uint32_t _beepStep;             // Phase step of the beeper
+        uint32_t _phase = 0;            // Position in the 128 bit pattern, 7.25 fixed point
+        uint32_t _frameRemainder = 0;   // sampleRate / 60 carried over, so no sample is lost
+        int16_t _pitch = -1;            // Pitch of _patternStep, -1 before the first pattern
+        uint32_t _patternStep = 0;
+        AudioStats _stats = {0, 0};
+
+        uint32_t pitch_step(uint8_t pitch) const;
+        void render(int16_t* out, uint16_t count, const uint8_t* pattern, uint32_t step);
+};
+
+#endif
@@ -1,53 +1,112 @@
 #include "chippycore.h"
+#include "chippyaudio.h"
+#include "chippyreplay.h"
 
+#include <new>
+#include <stdio.h>
+
+//The two pages with the fontsets, built at compile time so they live in flash and are shared by every instance
+struct FontPages {
+    uint8_t bytes[2 * MEMORY_PAGE_SIZE];
+    constexpr FontPages() : bytes() {
+        for (uint8_t i = 0; i < sizeof(FONTSET); i++) {
+            bytes[FONTSET_START_ADDRESS + i] = FONTSET[i];
+        }
+        for (uint8_t i = 0; i < sizeof(BIG_FONTSET); i++) {
+            bytes[BIG_FONTSET_START_ADDRESS + i] = BIG_FONTSET[i];
+        }
+    }
+};
+static constexpr FontPages FONT_PAGES;
+static constexpr uint8_t ZERO_PAGE[MEMORY_PAGE_SIZE] = {};
+
+// Stops the emulator and reports the error without blocking, to the error callback or the log
 void ChippyCore::handleError(uint8_t errorCode){
+    stopEmulator();
+    CHIPPY_DEBUG_ERROR(*this, errorCode);
+    ErrorReport error = {errorCode, read_opcode(PC), get_cpu_state()};
+    if(_eCallback){
+        _eCallback(error);
+        return;
+    }
     switch(errorCode){
         case ERROR_ROM_SIZE:
-            Serial.println("ERROR: The rom size is too big");
-            stopEmulator();
+            platform_log("ERROR: The rom size is too big");
         break;
         case ERROR_USER_KEYPRESS:
-            Serial.println("ERROR: You can only choose a keypress value 0-15 in your loopback");
-            stopEmulator();
+            platform_log("ERROR: You can only choose a keypress value 0-15 in your loopback");
         break;
         case STACK_UNDERFLOW_ERROR:
-            Serial.println("ERROR: Stack underflow opcode 0x00EE");
-            stopEmulator();
+            platform_log("ERROR: Stack underflow opcode 0x00EE");
         break;
         case STACK_OVERFLOW_ERROR:
-            Serial.println("ERROR: Stack overflow opcode 0x2000");
-            stopEmulator();
+            platform_log("ERROR: Stack overflow opcode 0x2000");
         break;
         case UNKNOWN_OPCODE:
-            Serial.println("ERROR: Unknown Opcode detected");
-            stopEmulator();
+            platform_log("ERROR: Unknown Opcode detected");
+        break;
+        case ERROR_OUT_OF_MEMORY:
+            platform_log("ERROR: No memory for a written page");
         break;
         default:
-            stopEmulator();
+            platform_log("ERROR: Unknown error");
         break;
     }
-  
-  delay(2000);
+    char line[48];
+    snprintf(line, sizeof(line), "  at PC 0x%03X opcode 0x%04X SP %u", error.cpu.PC, error.opcode, error.cpu.SP);
+    platform_log(line);
 }
  // How are you testing today 
 void ChippyCore::stopEmulator(){
     flag.set(START, false);
 }
+void ChippyCore::set_present_callback(presentCallback pCallback, bool displayWait){
+    _pCallback = pCallback;
+    flag.set(QUIRK_DISPWAIT, displayWait);
+}
+void ChippyCore::set_audio(ChippyAudio* audio){
+    _audio = audio;
+}
+void ChippyCore::set_random_source(randomCallback rCallback){
+    _rCallback = rCallback;
+}
+void ChippyCore::set_random_seed(uint32_t seed){
+    _randomSeed = seed;
+    _random.seed(seed);
+}
+uint32_t ChippyCore::get_random_seed() const{
+    return _randomSeed;
+}
+void ChippyCore::set_recorder(ChippyRecorder* recorder){
+    _recorder = recorder;
+}
+void ChippyCore::set_error_callback(errorCallback eCallback){
+    _eCallback = eCallback;
+}
+void ChippyCore::set_rom_verification(bool enabled){
+    _verifyRoms = enabled;
+}
+void ChippyCore::set_rom_placement(uint8_t placement){
+    _romPlacement = placement;
+}
+RomReport ChippyCore::get_rom_report() const{
+    if(!_verifier){
+        return RomReport{};
+    }
+    return _verifier->report();
+}
+bool ChippyCore::is_rom_code(uint16_t address) const{
+    return _verifier && _verifier->is_code(address);
+}
 bool ChippyCore::isRunning(){
     return flag.get(START);
 }
 void ChippyCore::load_and_run(const uint8_t* data, size_t dataSize, drawPixelCallback dCallback, screenCallback sCallback, loopCallback lCallback, const bool* config){
-    //init the callbacks
-    if(dCallback){
-        _dCallback = dCallback;
-    }
-    if(sCallback){
-        _sCallback = sCallback;
-    }
-    if(lCallback){
-        _lCallback = lCallback;
-    }
-    
+    //init the callbacks, a nullptr callback is allowed and simply never called (headless)
+    _dCallback = dCallback;
+    _sCallback = sCallback;
+    _lCallback = lCallback;
+
     //init the chip8 emulator
     initialize();
 
@@ -55,12 +114,16 @@ void ChippyCore::load_and_run(const uint8_t* data, size_t dataSize, drawPixelCal
     flag.set(QUIRK5, config[1]);
     flag.set(QUIRK6, config[2]);
     flag.set(QUIRK11, config[3]);
+    uint8_t quirks = (config[0] ? QUIRK_MASK_VF_RESET : 0) | (config[1] ? QUIRK_MASK_SHIFT : 0) |
+                     (config[2] ? QUIRK_MASK_WRAP : 0) | (config[3] ? QUIRK_MASK_MEMORY : 0);
+    select_quirk_profile(quirks);
 
     uint8_t error = load_rom(data, dataSize);
     if(error){
         handleError(error);
         return;
     }
+    verify_rom(data, dataSize, quirks);
     flag.set(START,true);      
 }
 
@@ -70,20 +133,110 @@ void ChippyCore::loop(){
         if(!flag.get(PAUSE)){
             cycle(); //Only cycle when not paused
         }  
+        else{
+            sync_clock(); //Time spent paused is not caught up afterwards
+            frame_phase = 0;
+        }
+    }
+}
+
+uint32_t ChippyCore::run_for(uint32_t budgetUs){
+    if(!isRunning()){
+        return 0;
+    }
+    uint32_t start = platform_micros();
+    loopCycle();
+    if(flag.get(PAUSE)){
+        sync_clock();
+        frame_phase = 0;
+        return 0;
     }
+    uint32_t executed = 0;
+    do{
+        sync_clock();
+        uint32_t ran = run_due(SCHEDULER_SLICE);
+        executed += ran;
+        if(ran < SCHEDULER_SLICE){
+            break; //Nothing more due yet, or the emulator stopped
+        }
+        loopCycle();
+        if(flag.get(PAUSE)){
+            break;
+        }
+    } while((platform_micros() - start) < budgetUs);
+    return executed;
 }
 
+void ChippyCore::set_quirk_specialization(bool enabled){
+    _specializeQuirks = enabled;
+}
+
+uint8_t ChippyCore::get_quirk_profile() const{
+    return _quirkProfile;
+}
+
+void ChippyCore::set_speed(uint16_t instructionsPerFrame, uint8_t maxCatchUpFrames){
+    _instructionsPerFrame = instructionsPerFrame;
+    _maxCatchUpFrames = maxCatchUpFrames;
+}
+
+void ChippyCore::set_turbo(bool turbo){
+    flag.set(TURBO, turbo);
+}
+
+SchedulerStats ChippyCore::get_scheduler_stats() const{
+    return _schedulerStats;
+}
+
+void ChippyCore::set_idle_skip(bool enabled){
+    _idleSkip = enabled;
+}
+
+IdleStats ChippyCore::get_idle_stats() const{
+    return _idleStats;
+}
+
+// Time until the scheduler's next opcode share is due, or the next tick once the frame's opcodes ran.
+// With a loop callback it is never past the next poll, paused only the loop callback is polled.
+uint32_t ChippyCore::get_idle_us() const{
+    if(!flag.get(START) || flag.get(TURBO)){
+        return 0;
+    }
+    uint32_t due;
+    if(flag.get(PAUSE)){
+        due = last_interrupt_cycle + LOOP_POLL_US;
+    }
+    else{
+        uint32_t wanted = FRAME_PHASE_UNITS;
+        if(frame_executed < _instructionsPerFrame){
+            wanted = static_cast<uint32_t>((static_cast<uint64_t>(frame_executed + 1) * FRAME_PHASE_UNITS + _instructionsPerFrame - 1) / _instructionsPerFrame);
+        }
+        if(frame_phase >= wanted){
+            return 0;
+        }
+        due = last_schedule_us + (wanted - frame_phase + 59) / 60;
+        if(_lCallback && static_cast<int32_t>(due - (last_interrupt_cycle + LOOP_POLL_US)) > 0){
+            due = last_interrupt_cycle + LOOP_POLL_US;
+        }
+    }
+    int32_t left = static_cast<int32_t>(due - platform_micros());
+    return left > 0 ? left : 0;
+}
+
+// Polls the loop callback every LOOP_POLL_US. A key it reports goes through the event queue like any other,
+// so a press and release between two ticks are both applied, one frame apart.
 void ChippyCore::loopCycle(){
-    uint32_t currentInterruptCycle = millis();
-    if((currentInterruptCycle - last_interrupt_cycle) >= (1000/750)){
+    if(!_lCallback){
+        return;
+    }
+    uint32_t currentInterruptCycle = platform_micros();
+    if((currentInterruptCycle - last_interrupt_cycle) >= LOOP_POLL_US){
         //loop callback with keypad and sound arguments
         uint8_t key = 255;
         bool key_state = false;
         bool pause = flag.get(PAUSE);
         bool stop = false;
-        if(_lCallback){
-            _lCallback(key,key_state,pause,stop);
-        }
+        CHIPPY_PROFILE_CALL(*this, PROFILE_LOOP, _lCallback(key,key_state,pause,stop));
         if(flag.get(PAUSE) != pause){
             flag.set(PAUSE, pause);
         }
@@ -95,7 +248,7 @@ void ChippyCore::loopCycle(){
                 handleError(ERROR_USER_KEYPRESS);
                 return;
             }
-            keys.set(key, key_state);
+            push_key_event(key, key_state);
         }
         last_interrupt_cycle = currentInterruptCycle;
     }
@@ -109,75 +262,304 @@ void ChippyCore::initialize(){
     SOUNDTIMER = 0;
     memset(V,0,sizeof(V));
     memset(STACK,0,sizeof(STACK));
-    memset(RAM, 0, sizeof(RAM));
-    last_cpu_cycle = 0;
-    last_gpu_cycle = 0;
+    _trustedRom = false;
+    display.reset();  // the first present sends the whole (blank) screen
+    memset(audio_pattern,0,sizeof(audio_pattern));
+    audio_pitch = AUDIO_DEFAULT_PITCH;
+    flag.set(AUDIO_PATTERN, false);
+    flag.set(FRAME_DRAWN, false);
+    last_schedule_us = platform_micros();
+    frame_phase = 0;
+    frame_executed = 0;
+    _schedulerStats = {0, 0};
+    _idleStats = {0, 0};
+    _frameOps = 0;
+    set_random_seed(platform_random());
     last_interrupt_cycle = 0;
-    load_fontset();
+    keys.clear_all();
+    _keyEvents.clear();
+    fx0a_key = NO_KEY;
+
+    //Every page back to the shared read-only ones, the DRAM copies stay allocated for reuse
+    _readPages[0] = FONT_PAGES.bytes;
+    _readPages[1] = FONT_PAGES.bytes + MEMORY_PAGE_SIZE;
+    for (uint8_t page = 2; page < MEMORY_PAGES; page++) {
+        _readPages[page] = ZERO_PAGE;
+    }
+    _ownedMask = 0;
+    _dirtyMask = 0;
+    _romMask = 0;
 }
 uint8_t ChippyCore::load_rom(const uint8_t* data, size_t dataSize){
     if (dataSize > (RAM_SIZE - ROM_START_ADDRESS)) {
         return ERROR_ROM_SIZE;
     }
-    memcpy(RAM + ROM_START_ADDRESS, data, dataSize);
+    //Whole pages read a static ROM in place, a partly filled last page gets a zero padded DRAM copy.
+    //Any other ROM (a local array, a file buffer) may be gone after the load, so every page is copied.
+    bool inPlace = _romPlacement == ROM_PLACEMENT_IN_PLACE || (_romPlacement == ROM_PLACEMENT_AUTO && platform_is_static(data));
+    for (size_t offset = 0; offset < dataSize; offset += MEMORY_PAGE_SIZE) {
+        uint8_t page = (ROM_START_ADDRESS + offset) >> MEMORY_PAGE_SHIFT;
+        size_t length = dataSize - offset < MEMORY_PAGE_SIZE ? dataSize - offset : MEMORY_PAGE_SIZE;
+        if (inPlace && length == MEMORY_PAGE_SIZE) {
+            _readPages[page] = data + offset;
+            _romMask |= 1 << page;
+        }
+        else {
+            if (!own_page(page)) {
+                return ERROR_OUT_OF_MEMORY;
+            }
+            memcpy(_ownedPages[page], data + offset, length);
+        }
+    }
+    flush_decode_cache();
+    flush_blocks();
+    _cacheStats = {0, 0, 0};
+    _blockStats = {0, 0, 0, 0};
     return 0;
 }
 
-// load fontset into memory
-void ChippyCore::load_fontset(){
-    const uint8_t FONTSET[80] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    };
-    memcpy(RAM + FONTSET_START_ADDRESS, FONTSET, sizeof(FONTSET));
+// Runs before anything is translated, so every block of a trusted ROM is translated as trusted
+void ChippyCore::verify_rom(const uint8_t* data, size_t dataSize, uint8_t quirks){
+    if (!_verifyRoms) {
+        if (_verifier) {
+            _verifier->~ChippyVerifier();
+            release(_verifier, ALLOC_ANALYSIS);
+            _verifier = nullptr;
+        }
+        return;
+    }
+    if (!_verifier) {
+        void* memory = allocate(sizeof(ChippyVerifier), ALLOC_ANALYSIS);
+        if (!memory) {
+            return;
+        }
+        _verifier = new (memory) ChippyVerifier();
+        _verifier->set_allocator(_aCallback, _fCallback);
+    }
+    _trustedRom = _verifier->verify(data, dataSize, quirks).trusted;
 }
+
+// One scheduler pass: everything that is due, or one frame worth of opcodes in turbo
 void ChippyCore::cycle(){
-    uint32_t currentCpuCycle = millis();
-    if((currentCpuCycle - last_cpu_cycle) >= (1000/500)){
-        executeOpcode();
-        last_cpu_cycle = currentCpuCycle;
+    sync_clock();
+    run_due(flag.get(TURBO) ? _instructionsPerFrame : UINT32_MAX);
+}
+
+// Adds the time since the last sync to the frame phase. Frames beyond the catch-up limit are dropped,
+// the 64 bit product keeps a very late call (minutes) from overflowing.
+void ChippyCore::sync_clock(){
+    uint32_t now = platform_micros();
+    uint64_t phase = frame_phase + static_cast<uint64_t>(now - last_schedule_us) * 60;
+    last_schedule_us = now;
+    uint64_t frames = phase / FRAME_PHASE_UNITS;
+    if(frames > _maxCatchUpFrames){
+        _schedulerStats.dropped_frames += static_cast<uint32_t>(frames - _maxCatchUpFrames);
+        phase = static_cast<uint64_t>(_maxCatchUpFrames) * FRAME_PHASE_UNITS + phase % FRAME_PHASE_UNITS;
     }
-    uint32_t currentGpuCycle = millis();
-    if((currentGpuCycle - last_gpu_cycle) >= (1000/60)){
-        if(DELAYTIMER > 0){
-            DELAYTIMER--;
+    frame_phase = static_cast<uint32_t>(phase);
+}
+
+// Runs at most limit opcodes of the work the frame phase says is due. Every finished frame first runs
+// the rest of its opcodes and then the 60 Hz tick, the current frame runs the share of its opcodes that
+// matches its phase. In turbo the opcodes are not capped, only the ticks follow the phase.
+uint32_t ChippyCore::run_due(uint32_t limit){
+    uint32_t executed = 0;
+    while(executed < limit && isRunning()){
+        uint32_t due;
+        if(flag.get(TURBO)){
+            due = frame_phase >= FRAME_PHASE_UNITS ? 0 : limit - executed;
+        }
+        else if(frame_phase >= FRAME_PHASE_UNITS){
+            due = _instructionsPerFrame > frame_executed ? _instructionsPerFrame - frame_executed : 0;
+        }
+        else{
+            uint32_t target = static_cast<uint32_t>(static_cast<uint64_t>(frame_phase) * _instructionsPerFrame / FRAME_PHASE_UNITS);
+            due = target > frame_executed ? target - frame_executed : 0;
         }
 
-        if(SOUNDTIMER >= 0){
-          if(SOUNDTIMER == 0){
-                if(flag.get(SOUND_STATE)){
-                    flag.set(SOUND_STATE,false);
+        if(due){
+            //An idle loop spins until the tick: the rest of the frame goes at once, past the limit
+            if(_idleSkip && !flag.get(TURBO) && frame_executed < _instructionsPerFrame && idle_loop_length()){
+                due = _instructionsPerFrame - frame_executed;
+            }
+            else if(due > limit - executed){
+                due = limit - executed;
+            }
+            uint32_t ran = run_instructions(due);
+            frame_executed += ran;
+            executed += ran;
+            if(ran < due){
+                break;
+            }
+        }
+        else if(frame_phase >= FRAME_PHASE_UNITS){
+            tick_timers();
+            frame_phase -= FRAME_PHASE_UNITS;
+            frame_executed = 0;
+            _schedulerStats.frames++;
+        }
+        else{
+            break;
+        }
+    }
+    return executed;
+}
+
+// Length in opcodes of the busy-wait loop at PC, 0 when there is none. Only loops whose every turn
+// leaves the machine as the first one did count: what they read (delay timer, keypad, FRAME_DRAWN)
+// does not change before the next tick, so running the rest of the frame is a waste of time.
+uint8_t ChippyCore::idle_loop_length(){
+    uint16_t opcode = read_opcode(PC);
+    uint8_t X = (opcode >> 8) & 0xF;
+    uint16_t jumpBack = 0x1000 | PC;
+    switch(opcode & 0xF000){
+        case 0x1000:
+            return opcode == jumpBack ? 1 : 0;
+        case 0xD000:
+            //Display wait, the sprite is retried until the VBlank
+            return flag.get(QUIRK_DISPWAIT) && flag.get(FRAME_DRAWN) ? 1 : 0;
+        case 0xE000: {
+            //EX9E or EXA1 that does not skip the jump back to it
+            if(read_opcode(PC + 2) != jumpBack){
+                return 0;
+            }
+            bool pressed = is_key_pressed(V[X]);
+            if((opcode & 0xFF) == 0x9E){
+                return pressed ? 0 : 2;
+            }
+            if((opcode & 0xFF) == 0xA1){
+                return pressed ? 2 : 0;
+            }
+            return 0;
+        }
+        case 0xF000:
+            if((opcode & 0xFF) == 0x0A){
+                //FX0A returns -1 again without latching a new key
+                bool waiting = fx0a_key == NO_KEY ? get_pressed_key() == -1 : keys.get(fx0a_key);
+                return waiting ? 1 : 0;
+            }
+            if((opcode & 0xFF) == 0x07){
+                //FX07; 3X00/4XNN; jump back, while the test does not skip the jump
+                uint16_t test = read_opcode(PC + 2);
+                if(((test >> 8) & 0xF) != X || read_opcode(PC + 4) != jumpBack){
+                    return 0;
+                }
+                bool equal = DELAYTIMER == (test & 0xFF);
+                if((test & 0xF000) == 0x3000){
+                    return equal ? 0 : 3;
                 }
-          }
-          if(!flag.get(SOUND_STATE)){
-                flag.set(SOUND_STATE,true);
-          }
-          SOUNDTIMER--;
+                if((test & 0xF000) == 0x4000){
+                    return equal ? 3 : 0;
+                }
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+// Fast-forwards the whole turns of the idle loop at PC that fit in count opcodes, returns the opcodes skipped
+uint32_t ChippyCore::skip_idle(uint32_t count){
+    uint8_t length = idle_loop_length();
+    if(!length){
+        return 0;
+    }
+    uint32_t skipped = count / length * length;
+    uint16_t opcode = read_opcode(PC);
+    if(skipped && (opcode & 0xF0FF) == 0xF007){
+        V[(opcode >> 8) & 0xF] = DELAYTIMER;    // What every turn of a delay poll leaves behind
+    }
+    _idleStats.skipped += skipped;
+    return skipped;
+}
+
+// Runs a whole frame without looking at the clock: the instructions first, then the 60 Hz block.
+// Returns the number of executed instructions, which is less than requested when the emulator stopped.
+uint32_t ChippyCore::run_frame(uint16_t instructionsPerFrame){
+    uint32_t executed = run_instructions(instructionsPerFrame);
+#ifdef CHIPPY_DEBUGGER
+    if (_debugger && _debugger->is_stopped()) {
+        return executed;    //A stopped machine does not tick either
+    }
+#endif
+    tick_timers();
+    return executed;
+}
+
+// The 60 Hz block: delay and sound timers, one frame of audio and the deferred clear screen
+void ChippyCore::tick_timers(){
+#ifdef CHIPPY_PROFILE
+    uint32_t tickStart = _profile ? platform_micros() : 0;
+#endif
+    if(DELAYTIMER > 0){
+        DELAYTIMER--;
+    }
+
+    //The sound plays for every frame that ends with a non-zero sound timer, and stops at zero
+    bool sound = SOUNDTIMER > 0;
+    if(sound){
+        SOUNDTIMER--;
+    }
+    flag.set(SOUND_STATE, sound);
+    if(_audio){
+        _audio->render_frame(sound, flag.get(AUDIO_PATTERN) ? audio_pattern : nullptr, audio_pitch);
+    }
+    if(flag.get(CLEAR_DISPLAY)){
+      flag.set(CLEAR_DISPLAY,false);
+      if(_sCallback){
+          CHIPPY_PROFILE_CALL(*this, PROFILE_SCREEN, _sCallback(1,0));
+      }
+    }
+
+    //VBlank: present everything drawn since the last tick in one go
+    flag.set(FRAME_DRAWN, false);
+    if(_pCallback && display.dirty_rows){
+        CHIPPY_PROFILE_CALL(*this, PROFILE_PRESENT, _pCallback(display.frame()));
+        display.dirty_rows = 0;
+    }
+#ifdef CHIPPY_PROFILE
+    if(_profile){
+        _profile->frame_micros += platform_micros() - tickStart;
+        _profile->end_frame();
+    }
+#endif
+
+    uint32_t frameOps = _frameOps;
+    _frameOps = 0;
+    drain_key_events();
+    if(_recorder){
+        _recorder->end_frame(frameOps);
+    }
+}
+
+// Applies the queued key events for the next frame. Draining stops at an event for a key that already
+// changed in this drain, so a tap shorter than a frame is still seen pressed for one whole frame.
+void ChippyCore::drain_key_events(){
+    uint16_t changed = 0;
+    uint8_t key;
+    bool pressed;
+    while(_keyEvents.peek(key, pressed)){
+        uint16_t bit = static_cast<uint16_t>(1) << key;
+        if(changed & bit){
+            break;
         }
-        if(flag.get(CLEAR_DISPLAY)){
-          flag.set(CLEAR_DISPLAY,false);
-          if(_sCallback){
-              _sCallback(1,0);
-          }
+        if(keys.get(key) != pressed){
+            keys.set(key, pressed);
+            changed |= bit;
         }
+        _keyEvents.pop();
+    }
+}
 
-        last_gpu_cycle = currentGpuCycle;
+void ChippyCore::set_keypad_mask(uint16_t mask){
+    keys.set_all(mask);
+    if(_recorder){
+        _recorder->keypad_changed(_frameOps);
     }
+}
 
+uint16_t ChippyCore::get_keypad_mask() const{
+    return keys.get_all();
 }
 bool ChippyCore::is_key_pressed(uint8_t key) {
     return key < MAX_16 && keys.get(key) == 1; // Return true if key is within range and pressed
@@ -192,22 +574,243 @@ int8_t ChippyCore::get_pressed_key() {
     return -1; // Return -1 if no key is pressed
 }
 
+// FX0A: a key counts once it has been pressed and released again, like on the COSMAC VIP.
+// Returns the key on its release, -1 while still waiting.
+int8_t ChippyCore::get_released_key(){
+    if(fx0a_key == NO_KEY){
+        int8_t pressedKey = get_pressed_key();
+        if(pressedKey != -1){
+            fx0a_key = pressedKey;
+        }
+        return -1;
+    }
+    if(keys.get(fx0a_key)){
+        return -1;
+    }
+    int8_t releasedKey = fx0a_key;
+    fx0a_key = NO_KEY;
+    return releasedKey;
+}
+
 // Set key state in keys array. This is used to track which buttons are currently pressed or not, and thus update game logic accordingly (e.g., player movement).
 void ChippyCore::set_key_state(uint8_t key, bool is_pressed){
     if (key < MAX_16) { 
         keys.set(key, is_pressed);
+        if (_recorder) {
+            _recorder->keypad_changed(_frameOps);
+        }
+    }
+}
+
+// Moves a page to DRAM: allocates its copy on first use and copies what the page reads now.
+// False when the allocation failed, the page then keeps reading its old data.
+bool ChippyCore::own_page(uint8_t page){
+    uint16_t bit = 1 << page;
+    if (_ownedMask & bit) {
+        return true;
+    }
+    if (!_ownedPages[page]) {
+        _ownedPages[page] = static_cast<uint8_t*>(allocate(MEMORY_PAGE_SIZE, ALLOC_GUEST_MEMORY));
+        if (!_ownedPages[page]) {
+            return false;
+        }
+    }
+    memcpy(_ownedPages[page], _readPages[page], MEMORY_PAGE_SIZE);
+    _readPages[page] = _ownedPages[page];
+    _ownedMask |= bit;
+    _romMask &= ~bit;
+    return true;
+}
+
+void* ChippyCore::allocate(size_t size, uint8_t use){
+    if (_aCallback) {
+        return _aCallback(size, use);
+    }
+    return new (std::nothrow) uint8_t[size];
+}
+
+void ChippyCore::release(void* memory, uint8_t use){
+    if (!memory) {
+        return;
     }
+    if (_fCallback) {
+        _fCallback(memory, use);
+    }
+    else {
+        delete[] static_cast<uint8_t*>(memory);
+    }
+}
+
+void* ChippyCore::allocate_history(size_t size){
+    void* memory = allocate(size, ALLOC_HISTORY);
+    if (memory) {
+        _historyBytes += size;
+    }
+    return memory;
+}
+
+void ChippyCore::release_history(void* memory, size_t size){
+    if (memory) {
+        release(memory, ALLOC_HISTORY);
+        _historyBytes -= size;
+    }
+}
+
+bool ChippyCore::set_allocator(allocCallback aCallback, freeCallback fCallback){
+    CoreFootprint footprint = get_footprint();
+    if (!aCallback != !fCallback || footprint.guest_memory || footprint.translation || footprint.analysis || footprint.history) {
+        return false;
+    }
+    _aCallback = aCallback;
+    _fCallback = fCallback;
+    return true;
+}
+
+#ifdef CHIPPY_PROFILE
+bool ChippyCore::start_profile(){
+    if (!_profile) {
+        void* memory = allocate(sizeof(ChippyProfile), ALLOC_ANALYSIS);
+        if (!memory) {
+            return false;
+        }
+        _profile = new (memory) ChippyProfile;
+    }
+    _profile->reset();
+    return true;
+}
+
+const ChippyProfile* ChippyCore::get_profile() const{
+    return _profile;
+}
+#endif
+
+MemoryStats ChippyCore::get_memory_stats() const{
+    MemoryStats stats = {0, 0, 0, 0};
+    for (uint8_t page = 0; page < MEMORY_PAGES; page++) {
+        uint16_t bit = 1 << page;
+        stats.rom_pages += (_romMask & bit) != 0;
+        stats.dirty_pages += (_dirtyMask & bit) != 0;
+        stats.owned_pages += (_ownedMask & bit) != 0;
+        stats.allocated_pages += _ownedPages[page] != nullptr;
+    }
+    return stats;
+}
+
+const uint64_t* ChippyCore::get_framebuffer(uint8_t plane) const{
+    return display.planes[plane < DISPLAY_PLANES ? plane : 0];
+}
+
+DisplayFrame ChippyCore::get_display_frame() const{
+    return display.frame();
+}
+
+DisplayFrame ChippyCore::take_display_frame(){
+    DisplayFrame frame = display.frame();
+    display.dirty_rows = 0;
+    return frame;
+}
+
+bool ChippyCore::is_sound_on() const{
+    return flag.get(SOUND_STATE);
+}
+
+void ChippyCore::stop(){
+    stopEmulator();
+}
+
+CpuState ChippyCore::get_cpu_state() const{
+    CpuState state;
+    state.PC = PC;
+    state.INDEX = INDEX;
+    memcpy(state.STACK, STACK, sizeof(state.STACK));
+    state.SP = SP;
+    state.DELAYTIMER = DELAYTIMER;
+    state.SOUNDTIMER = SOUNDTIMER;
+    memcpy(state.V, V, sizeof(state.V));
+    return state;
+}
+
+// Only rows that held pixels change, so only those are marked dirty
+void ChippyCore::clear_screen(){
+    display.clear();
+    if (!_pCallback) {
+        flag.set(CLEAR_DISPLAY, true);
+    }
+}
+
+// XOR an 8xN (16x16 for N = 0) sprite into the selected planes one row word at a time, VF is set when any
+// lit pixel gets erased. QUIRK6 wraps the sprite around the edges, otherwise it is clipped.
+// Returns false when the display wait quirk holds the draw back until the next 60 Hz tick.
+bool ChippyCore::draw_sprite(uint8_t X, uint8_t Y, uint8_t N){
+    return flag.get(QUIRK6) ? draw_sprite<true>(X, Y, N) : draw_sprite<false>(X, Y, N);
+}
+
+template<bool WRAP>
+bool ChippyCore::draw_sprite(uint8_t X, uint8_t Y, uint8_t N){
+    if (flag.get(QUIRK_DISPWAIT)) {
+        if (flag.get(FRAME_DRAWN)) {
+            return false;
+        }
+        flag.set(FRAME_DRAWN, true);
+    }
+    blit_sprite<WRAP>(X, Y, N);
+    if (!_pCallback && _sCallback) {
+        CHIPPY_PROFILE_CALL(*this, PROFILE_SCREEN, _sCallback(false, true));
+    }
+    return true;
+}
+template bool ChippyCore::draw_sprite<false>(uint8_t X, uint8_t Y, uint8_t N);
+template bool ChippyCore::draw_sprite<true>(uint8_t X, uint8_t Y, uint8_t N);
+
+// Scrolls and resolution changes, hosts without a present callback redraw from get_framebuffer()
+void ChippyCore::display_changed(){
+    if (!_pCallback && _sCallback) {
+        CHIPPY_PROFILE_CALL(*this, PROFILE_SCREEN, _sCallback(false, true));
+    }
+}
+
+template<bool WRAP>
+void ChippyCore::blit_sprite(uint8_t X, uint8_t Y, uint8_t N){
+    V[0xF] = 0;
+    uint8_t x = V[X];
+    uint8_t y = V[Y];
+
+    //The sprite is read in place unless it crosses a page or the end of memory
+    uint8_t length = (N ? N : 32) * display.selected_planes();
+    uint16_t address = INDEX & (RAM_SIZE - 1);
+    uint8_t offset = address & (MEMORY_PAGE_SIZE - 1);
+    uint8_t copy[SPRITE_MAX_BYTES];
+    const uint8_t* sprite = _readPages[address >> MEMORY_PAGE_SHIFT] + offset;
+    if (offset + length > MEMORY_PAGE_SIZE) {
+        for (uint8_t i = 0; i < length; i++) {
+            copy[i] = read_memory(address + i);
+        }
+        sprite = copy;
+    }
+
+    bool collision = display.draw<WRAP>(x, y, N, sprite, [this](uint8_t plane, uint8_t row, uint8_t word, uint64_t bits){
+        //Legacy hosts that keep their own screen still get one call per flipped pixel of the first plane
+        if (_dCallback && plane == 0) {
+            while (bits) {
+                uint8_t px = __builtin_clzll(bits);
+                bool erased = false;
+                CHIPPY_PROFILE_CALL(*this, PROFILE_DRAW_PIXEL, _dCallback(word * 64 + px, row, erased));
+                bits &= ~(FRAMEBUFFER_MSB >> px);
+            }
+        }
+    });
+    V[0xF] = collision ? 1 : 0;
 }
 
 void ChippyCore::executeOpcode() {
     //Fetch Opcode
-    uint16_t OPCODE = (RAM[PC] << 8) | RAM[PC + 1];
+    uint16_t OPCODE = read_opcode(PC);
     //Decode and execute
     switch (OPCODE & 0xF000) {
         case 0x0000:
             switch (OPCODE & 0x00FF) {
                 case 0xE0: // 00E0: Clear the display
-                    flag.set(CLEAR_DISPLAY, true);
+                    clear_screen();
                     PC += 2;
                 break;
                 case 0xEE:
@@ -219,8 +822,38 @@ void ChippyCore::executeOpcode() {
                         PC = STACK[--SP];
                     }
                 break;
+                case 0xFB: // 00FB: Scroll right by 4 pixels
+                    display.scroll_right();
+                    display_changed();
+                    PC += 2;
+                break;
+                case 0xFC: // 00FC: Scroll left by 4 pixels
+                    display.scroll_left();
+                    display_changed();
+                    PC += 2;
+                break;
+                case 0xFD: // 00FD: Exit the interpreter
+                    stopEmulator();
+                break;
+                case 0xFE: // 00FE: Low resolution
+                case 0xFF: // 00FF: High resolution
+                    display.set_hires(OPCODE & 0x1);
+                    display_changed();
+                    PC += 2;
+                break;
                 default:
-                    handleError(UNKNOWN_OPCODE);
+                    if ((OPCODE & 0x00F0) == 0xC0) { // 00CN: Scroll down N rows
+                        display.scroll_down(OPCODE & 0x000F);
+                    }
+                    else if ((OPCODE & 0x00F0) == 0xD0) { // 00DN: Scroll up N rows (XO-CHIP)
+                        display.scroll_up(OPCODE & 0x000F);
+                    }
+                    else {
+                        handleError(UNKNOWN_OPCODE);
+                        break;
+                    }
+                    display_changed();
+                    PC += 2;
                 break;
             }
         break;
@@ -398,41 +1031,14 @@ void ChippyCore::executeOpcode() {
         break;
         case 0xC000:
             // CXNN: Set Vx = random byte AND NN
-            V[(OPCODE & 0x0F00) >> 8] = ((esp_random() & 0xFF) & (OPCODE & 0x00FF));
+            V[(OPCODE & 0x0F00) >> 8] = random_byte() & (OPCODE & 0x00FF);
             PC += 2;
         break;
-        case 0xD000: {
-            V[0xF] = 0; 
-            uint8_t N = (OPCODE & 0x000F);
-            uint8_t X = (OPCODE & 0x0F00) >> MAX_8;
-            uint8_t Y = (OPCODE & 0x00F0) >> 4;
-            for(uint8_t row = 0; row < N; row++){
-                for (uint8_t col = 0; col < MAX_8; col++) {
-                    if (((RAM[INDEX + row]) & (0x80 >> col)) != 0) {
-                        uint8_t x = V[X] + col;
-                        uint8_t y = V[Y] + row;
-                        if (flag.get(QUIRK6)) {
-                            x %= 64;
-                            y %= 32;
-                        }
-                        else if (x >= 64 || y >= 32) {
-                            continue;
-                        }   
-                        bool collision = false;
-                        if (_dCallback) {   
-                            _dCallback(x, y, collision);
-                        }
-                        if (collision) {
-                            V[0xF] = 1;
-                        }
-                    }
-                }
-            }
-            if (_sCallback) {
-                _sCallback(false, true);
+        case 0xD000:
+            // DXYN: Draw an 8xN sprite from I at (Vx, Vy), set VF = collision
+            if (draw_sprite((OPCODE & 0x0F00) >> MAX_8, (OPCODE & 0x00F0) >> 4, OPCODE & 0x000F)) {
+                PC += 2;
             }
-            PC += 2;
-        } 
         break;
         case 0xE000: {
             // EX9E and EXA1: Key operations
@@ -475,8 +1081,8 @@ void ChippyCore::executeOpcode() {
                     SOUNDTIMER = V[(OPCODE & 0x0F00) >> MAX_8];
                     PC += 2;
                 break;
-                case 0x0A: { //FX0A - Wait for a key press and store the value of that pressed button in X */
-                    int8_t pressedKey = get_pressed_key();
+                case 0x0A: { //FX0A - Wait for a key press and release and store the value of that button in X */
+                    int8_t pressedKey = get_released_key();
                     if (pressedKey != -1) {
                         if(pressedKey >= 0 && pressedKey < MAX_16){
                             V[(OPCODE & 0x0F00) >> MAX_8] = pressedKey;
@@ -500,18 +1106,45 @@ void ChippyCore::executeOpcode() {
                     INDEX = 0x50 + (V[(OPCODE & 0x0F00) >> MAX_8] * 5);
                     PC += 2;
                 break;
+                case 0x30:
+                    // FX30: Set I = location of the big sprite for digit Vx (SCHIP)
+                    INDEX = BIG_FONTSET_START_ADDRESS + (V[(OPCODE & 0x0F00) >> MAX_8] & 0xF) * 10;
+                    PC += 2;
+                break;
+                case 0x01:
+                    // FN01: Select the planes N for DXYN, 00E0 and the scrolls (XO-CHIP)
+                    display.plane_mask = ((OPCODE & 0x0F00) >> MAX_8) & ((1 << DISPLAY_PLANES) - 1);
+                    PC += 2;
+                break;
+                case 0x02:
+                    // F002: Load the audio pattern from memory locations I to I+15 (XO-CHIP)
+                    if (OPCODE != 0xF002) {
+                        handleError(UNKNOWN_OPCODE);
+                        break;
+                    }
+                    for (uint8_t byte = 0; byte < AUDIO_PATTERN_BYTES; byte++) {
+                        audio_pattern[byte] = read_memory(INDEX + byte);
+                    }
+                    flag.set(AUDIO_PATTERN, true);
+                    PC += 2;
+                break;
+                case 0x3A:
+                    // FX3A: Set the audio pitch = Vx (XO-CHIP)
+                    audio_pitch = V[(OPCODE & 0x0F00) >> MAX_8];
+                    PC += 2;
+                break;
                 case 0x33:
                     // FX33: Store BCD representation of Vx in memory locations I, I+1, and I+2
-                    RAM[INDEX] = V[(OPCODE & 0x0F00) >> MAX_8] / 100;
-                    RAM[INDEX + 1] = (V[(OPCODE & 0x0F00) >> MAX_8] / 10) % 10;
-                    RAM[INDEX + 2] = V[(OPCODE & 0x0F00) >> MAX_8] % 10;
+                    write_memory(INDEX, V[(OPCODE & 0x0F00) >> MAX_8] / 100);
+                    write_memory(INDEX + 1, (V[(OPCODE & 0x0F00) >> MAX_8] / 10) % 10);
+                    write_memory(INDEX + 2, V[(OPCODE & 0x0F00) >> MAX_8] % 10);
                     PC += 2;
                 break;
                 case 0x55:{
                     // FX55: Store registers V0 through Vx in memory starting at location I
                     uint8_t X = (OPCODE & 0x0F00) >> MAX_8;
                     for (uint8_t reg1 = 0; reg1 <= X; ++reg1) {
-                        RAM[INDEX + reg1] = V[reg1];
+                        write_memory(INDEX + reg1, V[reg1]);
                     }
                     if(flag.get(QUIRK11)){
                         INDEX += X + 1;
@@ -523,7 +1156,7 @@ void ChippyCore::executeOpcode() {
                     uint8_t X = (OPCODE & 0x0F00) >> MAX_8;
                     // FX65: Read registers V0 through Vx from memory starting at location I
                     for (uint8_t reg1 = 0; reg1 <= X; ++reg1) {
-                        V[reg1] = RAM[INDEX + reg1];
+                        V[reg1] = read_memory(INDEX + reg1);
                     }
                     if(flag.get(QUIRK11)){
                         INDEX += X + 1;
@@ -1,9 +1,15 @@
 #ifndef CHIPPYCORE_H
 #define CHIPPYCORE_H
 
-#include <Arduino.h>
+#include "platform.h"
 #include "BitVault.h"
 #include "defines.h"
+#include "KeyEventQueue.h"
+#include "FastRandom.h"
+#include "chippydisplay.h"
+#include "chippyprofile.h"
+#include "chippydebug.h"
+#include "chippyverify.h"
 
 ///***********************************************************************************************///
 ///                                       EMULATOR QUIRKS                                         ///
@@ -23,55 +29,492 @@
                     // Enabled: For CHIP-48/SCHIP-1.0, I is incremented by the value of X. For SCHIP-1.1, I is not incremented. 
                     // Disabled: I is not incremented in either case.
 
-//The ChippyCore Class
-class ChippyCore{
+#define QUIRK_DISPWAIT 9  // Display wait (COSMAC VIP). Only set through set_present_callback().
+                          // Enabled: DXYN draws at most once per 60 Hz frame, a second DXYN waits for the next tick.
+                          // Disabled: DXYN draws immediately.
+
+//Quirk profiles, one bit per quirk. The table, goto, cached and block engines are compiled once per profile
+//with the quirk checks resolved at compile time, load_and_run() picks the profile matching its config.
+#define QUIRK_MASK_VF_RESET 0x01    // QUIRK4
+#define QUIRK_MASK_SHIFT 0x02       // QUIRK5
+#define QUIRK_MASK_WRAP 0x04        // QUIRK6
+#define QUIRK_MASK_MEMORY 0x08      // QUIRK11
+
+namespace QuirkProfile {
+    constexpr uint8_t None = 0;
+    constexpr uint8_t CosmacVIP = QUIRK_MASK_VF_RESET | QUIRK_MASK_MEMORY;
+    constexpr uint8_t Chip48 = QUIRK_MASK_SHIFT | QUIRK_MASK_MEMORY;
+    constexpr uint8_t SChip = QUIRK_MASK_SHIFT;
+    constexpr uint8_t XOChip = QUIRK_MASK_WRAP | QUIRK_MASK_MEMORY;
+    constexpr uint8_t Runtime = 0x80;   // Not specialized, the handlers read the flags (any other config)
+}
+
+///***********************************************************************************************///
+///                                     EXECUTION ENGINES                                         ///
+///                                                                                               ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define ENGINE_SWITCH 0     // Nested switch in executeOpcode(), the reference implementation
+#define ENGINE_TABLE 1      // Handler tables indexed by the high nibble and the sub-opcode
+#define ENGINE_GOTO 2       // Computed goto on GCC/Clang, falls back to ENGINE_TABLE elsewhere
+#define ENGINE_CACHED 3     // Decode cache indexed by PC, falls back to ENGINE_TABLE when it cannot be allocated
+#define ENGINE_BLOCKS 4     // Translated basic blocks with fused superinstructions, falls back to ENGINE_TABLE likewise
+
+//Where load_and_run() keeps the ROM, see set_rom_placement()
+#define ROM_PLACEMENT_AUTO 0        // In place when platform_is_static() vouches for the data, copied otherwise
+#define ROM_PLACEMENT_COPY 1        // Copied to guest RAM pages, the data may go away after load_and_run()
+#define ROM_PLACEMENT_IN_PLACE 2    // Whole pages read in place, the data must stay valid while the ROM runs
+
+//Operands extracted once per opcode by the table and goto engines
+struct DecodedOp {
+    uint16_t opcode;
+    uint16_t NNN;
+    uint8_t X;
+    uint8_t Y;
+    uint8_t N;
+    uint8_t NN;
+};
+DecodedOp decode_opcode(uint16_t opcode);
+
+class ChippyCore;
+typedef void (*OpHandler)(ChippyCore& c, const DecodedOp& op);
+
+//One decode cache slot, handler is nullptr while the slot is empty
+struct CachedOp {
+    OpHandler handler;
+    DecodedOp op;
+};
+
+//Decode cache counters, invalidations only count slots that held a decoded opcode (self-modifying code)
+struct DecodeCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t invalidations;
+};
+
+//Basic block translation, one entry per even start address, ops == 0 while untranslated or invalidated
+struct BlockOp;
+struct BlockEntry {
+    uint16_t start;         // First op in the block pool
+    uint16_t end;           // First guest address after the block
+    uint8_t ops;            // Threaded ops in the pool (a superinstruction is one op)
+    uint8_t instructions;   // Guest instructions covered
+    uint8_t capacity;       // Pool ops owned by the entry, kept across invalidation so retranslation reuses them
+};
+
+//Block engine counters, invalidations count blocks dropped because their code was written
+struct BlockStats {
+    uint32_t translations;
+    uint32_t superinstructions;
+    uint32_t invalidations;
+    uint32_t flushes;
+};
+
+//Copy of the CPU registers, see get_cpu_state()
+struct CpuState {
+    uint16_t PC;
+    uint16_t INDEX;
+    uint16_t STACK[MAX_16];
+    uint8_t SP;
+    uint8_t DELAYTIMER;
+    uint8_t SOUNDTIMER;
+    uint8_t V[MAX_16];
+};
+
+//An error that stopped the emulator, see set_error_callback()
+struct ErrorReport {
+    uint8_t code;           // Error code (defines.h)
+    uint16_t opcode;        // Opcode at cpu.PC, the one that failed for the opcode errors
+    CpuState cpu;           // Registers and stack when it happened
+};
+
+//Registers and state flags, everything most opcodes touch. The first bytes of every ChippyCore, aligned
+//to the cache line: one line on the host, two lines on the ESP32.
+struct alignas(CHIPPY_CACHE_LINE) HotState {
+    uint16_t PC;
+    uint16_t INDEX;
+    uint8_t SP;
+    uint8_t DELAYTIMER;
+    uint8_t SOUNDTIMER;
+    uint8_t fx0a_key;       // Key FX0A saw pressed and now waits to be released, NO_KEY before that
+    uint8_t V[MAX_16];
+    uint16_t STACK[MAX_16];
+    BitVault<uint16_t> flag;    // State flags
+    BitVault<uint16_t> keys;    // Keypad, bit n is key n
+};
+
+//Heap allocations of a ChippyCore, see set_allocator(). The use tells an allocator what a buffer is for.
+#define ALLOC_GUEST_MEMORY 0    // Guest RAM pages (MEMORY_PAGE_SIZE bytes), written by FX33 and FX55
+#define ALLOC_TRANSLATION 1     // Decode cache and block translator, read at every opcode
+#define ALLOC_ANALYSIS 2        // ROM verifier and profile
+#define ALLOC_HISTORY 3         // ChippyRewind ring and ChippyRecorder events, touched about once per frame
+
+//Bytes one instance holds, see get_footprint()
+struct CoreFootprint {
+    uint32_t instance;          // sizeof(ChippyCore), wherever the instance itself lives
+    uint32_t hot_state;         // Of those, the HotState block at its start
+    uint32_t display;           // Of those, the display planes
+    uint32_t guest_memory;      // Allocated guest RAM pages
+    uint32_t translation;       // Decode cache and block translator
+    uint32_t analysis;          // ROM verifier and profile
+    uint32_t history;           // ChippyRewind and ChippyRecorder buffers allocated through this instance
+    uint32_t transient;         // Verifier work memory, only held during every load_and_run() and not in total
+    uint32_t total;             // instance + guest_memory + translation + analysis + history
+};
+
+//Guest memory pages, see get_memory_stats()
+struct MemoryStats {
+    uint8_t rom_pages;          // Pages read straight from the ROM data, no DRAM copy
+    uint8_t dirty_pages;        // Pages the running ROM wrote to (FX33, FX55)
+    uint8_t owned_pages;        // Pages in DRAM: the dirty ones and a partly filled last ROM page
+    uint8_t allocated_pages;    // DRAM pages held by the instance, kept for reuse by the next ROM
+};
+
+//Scheduler counters, dropped_frames counts 60 Hz frames skipped because the catch-up limit was reached
+struct SchedulerStats {
+    uint32_t frames;
+    uint32_t dropped_frames;
+};
+
+//Idle loop counters since load_and_run(), skipped / (executed + skipped) is the share of opcode time saved
+struct IdleStats {
+    uint32_t executed;          // Opcodes the engines really ran
+    uint32_t skipped;           // Opcodes of idle loop turns fast-forwarded instead
+};
+
+///***********************************************************************************************///
+///                                         SNAPSHOTS                                             ///
+///                                                                                               ///
+/// Flat little endian image of everything a ROM can observe: registers, stack, RAM, display     ///
+/// planes, keypad and the state flags. Callbacks, engine and speed are host setup and not part   ///
+/// of it. Version 2 added the hires display and the bitplanes, version 3 the audio pattern and   ///
+/// pitch, version 4 the state of the CXNN random generator.                                      ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define SNAPSHOT_MAGIC "CH8S"
+#define SNAPSHOT_VERSION 4
+#define SNAPSHOT_HEADER_SIZE 8      // Magic, version, reserved byte, total size (uint16)
+#define SNAPSHOT_SIZE (SNAPSHOT_HEADER_SIZE + 19 + MAX_16 + MAX_16 * 2 + AUDIO_PATTERN_BYTES + DISPLAY_PLANES * FRAMEBUFFER_WORDS * 8 + RAM_SIZE)
+
+class ChippyPack;   // chippypack.h
+class ChippyAudio;  // chippyaudio.h
+class ChippyRecorder;   // chippyreplay.h
+
+//The ChippyCore Class. The registers come first (HotState), the rest is ordered from the per-opcode
+//page table down to host setup and statistics.
+class ChippyCore : private HotState{
+    template<uint8_t Q> friend struct ChippyOps;
     public:
+        ChippyCore() = default;
+        ~ChippyCore();
+        //The instance owns its page copies, caches, verifier and profile, so it cannot be copied
+        ChippyCore(const ChippyCore&) = delete;
+        ChippyCore& operator=(const ChippyCore&) = delete;
     
         //Define Callbacks
         typedef void (*screenCallback)(bool clearScreen, bool updateScreen);
         typedef void (*loopCallback)(uint8_t& keySet, bool& keyState, bool& pause, bool& stop);
         typedef void (*drawPixelCallback)(const uint16_t x, const uint16_t y, bool& collisionDetection);
+        typedef void (*presentCallback)(const DisplayFrame& frame);
+        typedef uint32_t (*randomCallback)();
+        typedef void (*errorCallback)(const ErrorReport& error);
+        typedef void* (*allocCallback)(size_t size, uint8_t use);
+        typedef void (*freeCallback)(void* memory, uint8_t use);
 
-        //Method
+        //Method. Whole pages of a ROM in flash or other static data are read in place, any other ROM is copied
+        //(set_rom_placement()). Data read in place must stay valid while the ROM runs: never a local array.
         void load_and_run(const uint8_t* data, size_t dataSize, drawPixelCallback dCallback, screenCallback sCallback, loopCallback lCallback,const bool* config);
+        //Looks the ROM up in a pack by its content hash and runs it with the quirks and speed stored there.
+        //A ROM the pack does not know runs with fallbackConfig. Returns true when the ROM was found.
+        bool load_and_run(const uint8_t* data, size_t dataSize, drawPixelCallback dCallback, screenCallback sCallback, loopCallback lCallback,
+                          const ChippyPack& pack, const bool* fallbackConfig);
         bool isRunning();
         void loop();
+
+        //Opt-in VBlank presentation: one call per 60 Hz tick with the rows changed since the last one.
+        //Replaces the per-DXYN and 00E0 screenCallback calls while set. Pass nullptr to switch back.
+        void set_present_callback(presentCallback pCallback, bool displayWait = false);
+
+        //PCM output: one frame of samples is rendered into audio at every 60 Hz tick, nullptr for none.
+        //Kept across ROM loads, the audio ring is consumed on another task.
+        void set_audio(ChippyAudio* audio);
+
+        //CXNN random source. nullptr (the default) is the built-in xorshift generator, which every
+        //load_and_run() seeds from platform_random(). A callback returns 32 bits, CXNN takes the low byte.
+        void set_random_source(randomCallback rCallback);
+        //Reseeds the built-in generator, the same seed gives the same CXNN numbers on every build
+        void set_random_seed(uint32_t seed);
+        //The seed of the last reseed
+        uint32_t get_random_seed() const;
+
+        //Session recording, ChippyRecorder::start() and stop() set it. nullptr records nothing.
+        void set_recorder(ChippyRecorder* recorder);
+
+        //Called once when an error stops the emulator, from the thread that runs the core. It must not
+        //block. nullptr (the default) logs the error through platform_log() instead.
+        void set_error_callback(errorCallback eCallback);
+
+        //Read-only view of one display plane, width / 64 words per row (one in low resolution),
+        //bit 63 of a row's first word is the leftmost pixel (x = 0)
+        const uint64_t* get_framebuffer(uint8_t plane = 0) const;
+        //Every plane with the current resolution and the rows changed since the last present
+        DisplayFrame get_display_frame() const;
+        //Same frame, and its rows count as presented from now on. For hosts that present on their own
+        //schedule instead of through set_present_callback() (ChippyHost.h).
+        DisplayFrame take_display_frame();
+        //True when the last 60 Hz tick played sound
+        bool is_sound_on() const;
+        //Stops the emulator, like the stop flag of the loop callback
+        void stop();
+
+        //Register snapshot for regression runs and debugging
+        CpuState get_cpu_state() const;
+
+        //Selects the interpreter loop (ENGINE_*), can be changed at any time
+        void set_engine(uint8_t engine);
+        DecodeCacheStats get_decode_cache_stats() const;
+        BlockStats get_block_stats() const;
+
+        //Use the handlers compiled for the quirk profile of the config (default) or always read the quirk
+        //flags at runtime. Takes effect at the next load_and_run().
+        void set_quirk_specialization(bool enabled);
+        //The QuirkProfile the engines run with, QuirkProfile::Runtime when the config has no specialization
+        uint8_t get_quirk_profile() const;
+
+        //Real-time pacing used by loop() and run_for(). instructionsPerFrame opcodes run per 60 Hz frame,
+        //a late caller catches up at most maxCatchUpFrames frames, older ones are dropped.
+        void set_speed(uint16_t instructionsPerFrame, uint8_t maxCatchUpFrames = DEFAULT_MAX_CATCHUP_FRAMES);
+        //Turbo runs opcodes as fast as possible, the timers and presentation stay at 60 Hz
+        void set_turbo(bool turbo);
+        //Polls the loop callback and runs the due opcodes for at most budgetUs microseconds.
+        //Returns early when nothing is due (never in turbo), returns the executed opcode count.
+        uint32_t run_for(uint32_t budgetUs);
+        SchedulerStats get_scheduler_stats() const;
+
+        //Busy-wait loops that only a 60 Hz tick can end (a jump to itself, FX0A waiting for a key, a FX07
+        //delay poll, an EX9E/EXA1 key poll, DXYN waiting for the VBlank) are fast-forwarded instead of run.
+        //The machine ends up exactly as if every turn had run. On by default.
+        void set_idle_skip(bool enabled);
+        IdleStats get_idle_stats() const;
+        //Microseconds until run_for() has work again, 0 when there is work now. After an idle loop this is
+        //the time to the next tick, long enough to yield or light sleep. At most LOOP_POLL_US with a loop callback.
+        uint32_t get_idle_us() const;
+
+        //Keypad input. push_key_event() may be called from an ISR or another thread (one producer),
+        //the events are applied once per 60 Hz frame in order. Returns false when the queue is full.
+        inline bool push_key_event(uint8_t key, bool pressed){
+            return key < MAX_16 && _keyEvents.push(key, pressed);
+        }
+        //Replaces the whole keypad at once, bit n is key n. Only from the thread that runs the core.
+        void set_keypad_mask(uint16_t mask);
+        uint16_t get_keypad_mask() const;
+
+        //Page usage of the guest memory, dirty_pages is reset by every load_and_run()
+        MemoryStats get_memory_stats() const;
+
+        //Heap for the buffers the instance allocates (ALLOC_*), for example guest RAM in PSRAM and the
+        //translation caches in internal RAM. aCallback returns nullptr when it has no memory, the core
+        //then falls back as it does on a failed allocation. Both or neither, nullptr for both is new and delete.
+        //Only before the first allocation (set_engine(), load_and_run(), start_profile()), false afterwards.
+        bool set_allocator(allocCallback aCallback, freeCallback fCallback);
+        //For ChippyRewind and ChippyRecorder: buffers from the set_allocator() heap (ALLOC_HISTORY), counted
+        //in get_footprint(). Release them with the size they were allocated with.
+        void* allocate_history(size_t size);
+        void release_history(void* memory, size_t size);
+        //Memory held right now, the buffers are allocated on first use and kept across ROM loads
+        CoreFootprint get_footprint() const;
+
+        //Static analysis of every loaded ROM (chippyverify.h), a trusted ROM gets longer translated blocks.
+        //On by default, takes effect at the next load_and_run(). Off frees the verifier.
+        void set_rom_verification(bool enabled);
+        //ROM_PLACEMENT_*, ROM_PLACEMENT_AUTO by default. Takes effect at the next load_and_run().
+        void set_rom_placement(uint8_t placement);
+        //Report of the running ROM, not verified when verification is off or could not run
+        RomReport get_rom_report() const;
+        //True for the bytes of the running ROM's reachable opcodes, false for data or without a report
+        bool is_rom_code(uint16_t address) const;
+
+#ifdef CHIPPY_PROFILE
+        //Starts counting into a zeroed profile (about 9 KB, allocated on the first call). False when it
+        //cannot be allocated. Keeps counting across ROM loads until the next start_profile().
+        bool start_profile();
+        //nullptr before start_profile()
+        const ChippyProfile* get_profile() const;
+#endif
+
+#ifdef CHIPPY_DEBUGGER
+        //Attaches a debugger (chippydebug.h), nullptr detaches. It stays attached across ROM loads.
+        void set_debugger(ChippyDebugger* debugger);
+#endif
+
+        //Machine state to and from a SNAPSHOT_SIZE buffer. save_state() returns the bytes written, 0 when
+        //the buffer is too small. load_state() leaves the emulator untouched and returns false when the
+        //snapshot has another version or size, otherwise the next present redraws the whole screen.
+        size_t save_state(uint8_t* buffer, size_t size) const;
+        bool load_state(const uint8_t* buffer, size_t size);
+
+        //Headless execution, not paced by the wall clock (host builds, benchmarks). The counts returned
+        //include fast-forwarded idle loop turns.
+        uint32_t run_frame(uint16_t instructionsPerFrame);
+        uint32_t run_instructions(uint32_t count);
     private:
-        //Ram
-        uint8_t RAM[RAM_SIZE];
-        
-        //Registers
-        uint16_t PC;
-        uint16_t INDEX;
-        alignas(2) uint16_t STACK[MAX_16];
-        uint8_t SP; 
-        uint8_t DELAYTIMER; 
-        uint8_t SOUNDTIMER;
-        uint8_t V[MAX_16];
+        //Guest memory in MEMORY_PAGES pages. Reads go through _readPages, which point at the ROM data,
+        //a shared read-only font or zero page, or at the page's DRAM copy once it has been written.
+        const uint8_t* _readPages[MEMORY_PAGES];
+        uint8_t* _ownedPages[MEMORY_PAGES] = {};  ///< DRAM copies, allocated on first write and kept
+        uint16_t _ownedMask = 0;    ///< Bit n set while page n reads from _ownedPages[n]
+        uint16_t _dirtyMask = 0;    ///< Bit n set once the ROM wrote to page n
+        uint16_t _romMask = 0;      ///< Bit n set while page n reads straight from the ROM data
+
+        uint8_t _engine = ENGINE_SWITCH;
+        uint8_t _quirkProfile = QuirkProfile::Runtime;
+        bool _specializeQuirks = true;
+
+        //Decode cache for ENGINE_CACHED, one slot per even address, allocated on first use
+        CachedOp* _decodeCache = nullptr;
+        DecodeCacheStats _cacheStats = {0, 0, 0};
+
+        //Block translator for ENGINE_BLOCKS, allocated on first use. Blocks are listed in _blockSlots
+        //so invalidation and flushing only touch translated entries.
+        BlockOp* _blockPool = nullptr;
+        BlockEntry* _blockIndex = nullptr;
+        uint16_t* _blockSlots = nullptr;
+        uint16_t _blockPoolUsed = 0;
+        uint16_t _blockCount = 0;
+        uint16_t _blockCodeLow = 0xFFFF;    ///< Lowest translated guest address
+        uint16_t _blockCodeHigh = 0;        ///< One past the highest translated guest address
+        BlockStats _blockStats = {0, 0, 0, 0};
+
+        //Display planes, resolution and the rows changed since the last present
+        ChippyDisplay display;
+
+        //XO-CHIP sound, played while SOUNDTIMER is non-zero
+        uint8_t audio_pattern[AUDIO_PATTERN_BYTES];
+        uint8_t audio_pitch;
+        ChippyAudio* _audio = nullptr;
+
+        //CXNN numbers and session recording
+        FastRandom _random;
+        uint32_t _randomSeed = 0;
+        randomCallback _rCallback = nullptr;
+        ChippyRecorder* _recorder = nullptr;
+        uint32_t _frameOps = 0;     ///< Opcodes run since the last tick, idle loop turns included
+
+#ifdef CHIPPY_PROFILE
+        ChippyProfile* _profile = nullptr;
+#endif
+#ifdef CHIPPY_DEBUGGER
+        ChippyDebugger* _debugger = nullptr;
+#endif
         
         //Define Callbacks
         drawPixelCallback _dCallback;
         screenCallback _sCallback;
         loopCallback _lCallback;
+        presentCallback _pCallback = nullptr;
+        errorCallback _eCallback = nullptr;
 
+        //ROM verification, the verifier is allocated at the first load_and_run() that verifies
+        ChippyVerifier* _verifier = nullptr;
+        bool _verifyRoms = true;
+        bool _trustedRom = false;   ///< The running ROM is trusted and its code unchanged
+        uint8_t _romPlacement = ROM_PLACEMENT_AUTO;
+
+        //Heap of the buffers above, nullptr for new and delete
+        allocCallback _aCallback = nullptr;
+        freeCallback _fCallback = nullptr;
+        uint32_t _historyBytes = 0;     ///< Held by allocate_history()
+
+        //Scheduler, frame_phase counts microseconds * 60 so one frame is exactly FRAME_PHASE_UNITS
+        uint16_t _instructionsPerFrame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+        uint8_t _maxCatchUpFrames = DEFAULT_MAX_CATCHUP_FRAMES;
+        SchedulerStats _schedulerStats = {0, 0};
+        uint32_t last_schedule_us;  ///< Timestamp of the last scheduler clock sync
+        uint32_t frame_phase;  ///< Time since the start of the current frame, FRAME_PHASE_UNITS per frame
+        uint32_t frame_executed;  ///< Opcodes already run in the current frame
+        bool _idleSkip = true;
+        IdleStats _idleStats = {0, 0};
 
         //Old cycle time variables 
-        uint32_t last_cpu_cycle;  ///< Timestamp of the last CPU cycle
-        uint32_t last_gpu_cycle;  ///< Timestamp of the last GPU cycle
         uint32_t last_interrupt_cycle;  ///< Timestamp of the last INTERRUPT cycle
 
-        //Bit containers for state flags and keypad keys
-        BitVault<uint16_t> flag;
-        BitVault<uint16_t> keys;
+        KeyEventQueue _keyEvents;
 
         //Methods
         void initialize();
+        //Maps the ROM's whole pages to data when placed in place, so data must outlive the ROM then
         uint8_t load_rom(const uint8_t* data, size_t dataSize);
-        void load_fontset();
+        void verify_rom(const uint8_t* data, size_t dataSize, uint8_t quirks);
+        bool own_page(uint8_t page);
+#ifdef CHIPPY_DEBUGGER
+        uint32_t run_debug(uint32_t count);
+#endif
+        void* allocate(size_t size, uint8_t use);
+        void release(void* memory, uint8_t use);
         void executeOpcode();
+        void flush_decode_cache();
+        void select_quirk_profile(uint8_t quirks);
+        void flush_blocks();
+        void invalidate_blocks(uint16_t address);
+
+        //Guest addresses wrap at RAM_SIZE
+        inline uint8_t read_memory(uint16_t address) const{
+            address &= RAM_SIZE - 1;
+            return _readPages[address >> MEMORY_PAGE_SHIFT][address & (MEMORY_PAGE_SIZE - 1)];
+        }
+        //One page lookup unless the opcode straddles two pages
+        inline uint16_t read_opcode(uint16_t address) const{
+            address &= RAM_SIZE - 1;
+            uint8_t offset = address & (MEMORY_PAGE_SIZE - 1);
+            if (offset == MEMORY_PAGE_SIZE - 1) {
+                return (read_memory(address) << 8) | read_memory(address + 1);
+            }
+            const uint8_t* bytes = _readPages[address >> MEMORY_PAGE_SHIFT] + offset;
+            return (bytes[0] << 8) | bytes[1];
+        }
+
+        //Every guest memory write goes through here: the first write to a page copies it to DRAM, and
+        //decoded copies of the old bytes are dropped. Slot address >> 1 covers both opcodes that can
+        //contain the byte (the one at address - 1 is odd when address is even and never cached).
+        inline void write_memory(uint16_t address, uint8_t value){
+            address &= RAM_SIZE - 1;
+            uint8_t page = address >> MEMORY_PAGE_SHIFT;
+            if (!(_dirtyMask & (1 << page))) {
+                if (!own_page(page)) {
+                    handleError(ERROR_OUT_OF_MEMORY);
+                    return;
+                }
+                _dirtyMask |= 1 << page;
+            }
+            CHIPPY_DEBUG_WRITE(*this, address, value);
+            _ownedPages[page][address & (MEMORY_PAGE_SIZE - 1)] = value;
+            if (_decodeCache) {
+                CachedOp& slot = _decodeCache[address >> 1];
+                if (slot.handler) {
+                    slot.handler = nullptr;
+                    _cacheStats.invalidations++;
+                }
+            }
+            if (address >= _blockCodeLow && address < _blockCodeHigh) {
+                invalidate_blocks(address);
+            }
+        }
+        bool draw_sprite(uint8_t X, uint8_t Y, uint8_t N);
+        template<bool WRAP> bool draw_sprite(uint8_t X, uint8_t Y, uint8_t N);
+        template<bool WRAP> void blit_sprite(uint8_t X, uint8_t Y, uint8_t N);
+        void clear_screen();
+        void display_changed();
         bool is_key_pressed(uint8_t key);
         int8_t get_pressed_key();
+        int8_t get_released_key();
+        inline uint8_t random_byte(){
+            return _rCallback ? _rCallback() & 0xFF : _random.next_byte();
+        }
+        void drain_key_events();
         void cycle();
+        void sync_clock();
+        uint32_t run_due(uint32_t limit);
+        uint8_t idle_loop_length();
+        uint32_t skip_idle(uint32_t count);
+        void tick_timers();
         void set_key_state(uint8_t key, bool is_pressed);
         void handleError(uint8_t errorCode);
         void stopEmulator();
@@ -0,0 +1,195 @@
+#include "chippyops.h"
+
+///***********************************************************************************************///
+///                                  BASIC BLOCK TRANSLATOR                                       ///
+///                                                                                               ///
+/// Straight-line code is translated once into a run of threaded ops in _blockPool. A block ends  ///
+/// at the first jump, skip, call, return, DXYN, FX0A or memory write, so handlers can run back   ///
+/// to back without checking PC: every op leaves PC exactly where the next one expects it. The    ///
+/// memory writes of a trusted ROM (chippyverify.h) never hit code and do not end blocks.         ///
+/// Common pairs are fused into one superinstruction that runs both handlers in a single call.    ///
+/// The handlers are the table engine ones, so the quirk flags are checked exactly as before.     ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Handlers that can leave PC anywhere but PC + 2, stop the emulator, or write guest memory (only
+// while the ROM is not trusted)
+template<uint8_t Q>
+bool ChippyOps<Q>::ends_block(OpHandler handler, bool trusted){
+    return handler == op_unknown || handler == op_00EE || handler == op_00FD || handler == op_1NNN || handler == op_2NNN ||
+           handler == op_3XNN || handler == op_4XNN || handler == op_5XY0 || handler == op_9XY0 ||
+           handler == op_BNNN || handler == op_DXYN || handler == op_EX9E || handler == op_EXA1 ||
+           handler == op_FX0A || (!trusted && (handler == op_FX33 || handler == op_FX55));
+}
+
+#define BLOCK_SINGLE(H) if (handler == H) { return single<H>; }
+
+// The threaded version of a leaf handler, with the handler inlined into the block op
+template<uint8_t Q>
+BlockHandler ChippyOps<Q>::block_handler(OpHandler handler){
+    BLOCK_SINGLE(op_00E0) BLOCK_SINGLE(op_00EE) BLOCK_SINGLE(op_00CN) BLOCK_SINGLE(op_00DN)
+    BLOCK_SINGLE(op_00FB) BLOCK_SINGLE(op_00FC) BLOCK_SINGLE(op_00FD) BLOCK_SINGLE(op_00FE)
+    BLOCK_SINGLE(op_00FF) BLOCK_SINGLE(op_1NNN) BLOCK_SINGLE(op_2NNN)
+    BLOCK_SINGLE(op_3XNN) BLOCK_SINGLE(op_4XNN) BLOCK_SINGLE(op_5XY0) BLOCK_SINGLE(op_6XNN)
+    BLOCK_SINGLE(op_7XNN) BLOCK_SINGLE(op_8XY0) BLOCK_SINGLE(op_8XY1) BLOCK_SINGLE(op_8XY2)
+    BLOCK_SINGLE(op_8XY3) BLOCK_SINGLE(op_8XY4) BLOCK_SINGLE(op_8XY5) BLOCK_SINGLE(op_8XY6)
+    BLOCK_SINGLE(op_8XY7) BLOCK_SINGLE(op_8XYE) BLOCK_SINGLE(op_9XY0) BLOCK_SINGLE(op_ANNN)
+    BLOCK_SINGLE(op_BNNN) BLOCK_SINGLE(op_CXNN) BLOCK_SINGLE(op_DXYN) BLOCK_SINGLE(op_EX9E)
+    BLOCK_SINGLE(op_EXA1) BLOCK_SINGLE(op_FX07) BLOCK_SINGLE(op_FX0A) BLOCK_SINGLE(op_FX15)
+    BLOCK_SINGLE(op_FX18) BLOCK_SINGLE(op_FX1E) BLOCK_SINGLE(op_FX29) BLOCK_SINGLE(op_FX30)
+    BLOCK_SINGLE(op_FN01) BLOCK_SINGLE(op_F002) BLOCK_SINGLE(op_FX33) BLOCK_SINGLE(op_FX3A)
+    BLOCK_SINGLE(op_FX55) BLOCK_SINGLE(op_FX65)
+    return single<op_unknown>;
+}
+
+#undef BLOCK_SINGLE
+
+// Superinstructions for the pairs that dominate typical game loops, nullptr when the pair does not fuse
+template<uint8_t Q>
+BlockHandler ChippyOps<Q>::superinstruction(OpHandler first, const DecodedOp& a, OpHandler second, const DecodedOp& b){
+    if (first == op_6XNN && second == op_6XNN) {
+        return fused<op_6XNN, op_6XNN>;     // 6XNN 6YNN: load two registers
+    }
+    if (first == op_ANNN && second == op_DXYN) {
+        return fused<op_ANNN, op_DXYN>;     // ANNN DXYN: point at a sprite and draw it
+    }
+    if (first == op_FX07 && second == op_3XNN && a.X == b.X) {
+        return fused<op_FX07, op_3XNN>;     // FX07 3X00: delay timer poll
+    }
+    if (first == op_7XNN && second == op_1NNN) {
+        return fused<op_7XNN, op_1NNN>;     // 7XNN 1NNN: counted loop back edge
+    }
+    return nullptr;
+}
+
+// Translates the block starting at the even address pc. An invalidated block is retranslated into the pool
+// ops it already owns (self-modifying code), otherwise a full pool is flushed first, so this always succeeds.
+template<uint8_t Q>
+const BlockEntry& ChippyOps<Q>::translate(ChippyCore& c, uint16_t pc){
+    BlockEntry& entry = c._blockIndex[pc >> 1];
+    bool reuse = entry.capacity != 0;
+    if (!reuse && (c._blockPoolUsed + BLOCK_MAX_OPS > BLOCK_POOL_SIZE || c._blockCount >= BLOCK_POOL_SIZE)) {
+        c.flush_blocks();
+        c._blockStats.flushes++;
+    }
+
+    if (!reuse) {
+        entry.start = c._blockPoolUsed;
+        entry.capacity = BLOCK_MAX_OPS;
+    }
+    entry.instructions = 0;
+    bool trusted = c._trustedRom;
+    uint8_t ops = 0;
+    uint16_t address = pc;
+    while (ops < entry.capacity && address < RAM_SIZE - 1) {
+        BlockOp& block = c._blockPool[entry.start + ops];
+        block.op = decode_opcode(c.read_opcode(address));
+        OpHandler handler = resolve(block.op);
+        ops++;
+        if (!ends_block(handler, trusted) && address + 3 < RAM_SIZE - 1) {
+            block.second = decode_opcode(c.read_opcode(address + 2));
+            OpHandler next = resolve(block.second);
+            BlockHandler pair = superinstruction(handler, block.op, next, block.second);
+            if (pair) {
+                block.handler = pair;
+                entry.instructions += 2;
+                address += 4;
+                c._blockStats.superinstructions++;
+                if (ends_block(next, trusted)) {
+                    break;
+                }
+                continue;
+            }
+        }
+        block.handler = block_handler(handler);
+        entry.instructions++;
+        address += 2;
+        if (ends_block(handler, trusted)) {
+            break;
+        }
+    }
+    entry.ops = ops;
+    entry.end = address;
+    if (!reuse) {
+        entry.capacity = ops;
+        c._blockPoolUsed += ops;
+        c._blockSlots[c._blockCount++] = pc >> 1;
+    }
+    c._blockStats.translations++;
+    if (pc < c._blockCodeLow) {
+        c._blockCodeLow = pc;
+    }
+    if (address > c._blockCodeHigh) {
+        c._blockCodeHigh = address;
+    }
+    return entry;
+}
+
+// Runs whole blocks while they fit in the remaining budget, the tail of the budget (and odd addresses)
+// is single stepped so the instruction count, and with it the timer ticks, match the interpreter exactly.
+template<uint8_t Q>
+uint32_t ChippyOps<Q>::run_blocks(ChippyCore& c, uint32_t count){
+    uint32_t executed = 0;
+    while (executed < count && c.isRunning()) {
+        uint16_t pc = c.PC;
+        if (!(pc & 1) && pc < RAM_SIZE - 1) {
+            const BlockEntry* entry = &c._blockIndex[pc >> 1];
+            if (!entry->ops) {
+                entry = &translate(c, pc);
+            }
+            if (entry->instructions <= count - executed) {
+                CHIPPY_PROFILE_BLOCK(c, pc, entry->instructions);
+                const BlockOp* op = c._blockPool + entry->start;
+                const BlockOp* end = op + entry->ops;
+                executed += entry->instructions;
+                for (; op != end; ++op) {
+                    op->handler(c, *op);
+                }
+                continue;
+            }
+        }
+        DecodedOp op = decode_opcode(fetch(c));
+        CHIPPY_PROFILE_OP(c, pc, op.opcode);
+        resolve(op)(c, op);
+        executed++;
+    }
+    return executed;
+}
+
+// The block members live here, out of reach of the class instantiation in chippycore_dispatch.cpp
+#define CHIPPY_INSTANTIATE_BLOCKS(P) \
+    template bool ChippyOps<P>::ends_block(OpHandler handler, bool trusted); \
+    template BlockHandler ChippyOps<P>::block_handler(OpHandler handler); \
+    template BlockHandler ChippyOps<P>::superinstruction(OpHandler first, const DecodedOp& a, OpHandler second, const DecodedOp& b); \
+    template const BlockEntry& ChippyOps<P>::translate(ChippyCore& c, uint16_t pc); \
+    template uint32_t ChippyOps<P>::run_blocks(ChippyCore& c, uint32_t count);
+CHIPPY_FOR_EACH_QUIRK_PROFILE(CHIPPY_INSTANTIATE_BLOCKS)
+#undef CHIPPY_INSTANTIATE_BLOCKS
+
+void ChippyCore::flush_blocks(){
+    if (_blockIndex) {
+        for (uint16_t i = 0; i < _blockCount; i++) {
+            _blockIndex[_blockSlots[i]].ops = 0;
+            _blockIndex[_blockSlots[i]].capacity = 0;
+        }
+    }
+    _blockPoolUsed = 0;
+    _blockCount = 0;
+    _blockCodeLow = 0xFFFF;
+    _blockCodeHigh = 0;
+}
+
+// Drops every block whose code contains the written address. The entry keeps its pool ops for the retranslation.
+void ChippyCore::invalidate_blocks(uint16_t address){
+    for (uint16_t i = 0; i < _blockCount; i++) {
+        uint16_t slot = _blockSlots[i];
+        BlockEntry& entry = _blockIndex[slot];
+        if (entry.ops && address >= (slot << 1) && address < entry.end) {
+            entry.ops = 0;
+            _blockStats.invalidations++;
+        }
+    }
+}
+
+BlockStats ChippyCore::get_block_stats() const{
+    return _blockStats;
+}
@@ -0,0 +1,382 @@
+#include "chippyops.h"
+#include <new>
+
+///***********************************************************************************************///
+///                                  TABLE AND GOTO DISPATCH                                      ///
+///                                                                                               ///
+/// Every opcode is decoded once into DecodedOp (X, Y, N, NN, NNN) and handed to a small handler. ///
+/// ENGINE_TABLE reaches the handler through function pointer tables indexed by the high nibble  ///
+/// and the sub-opcode, ENGINE_GOTO jumps straight to labels (GCC/Clang computed goto) with the   ///
+/// handlers inlined. executeOpcode() stays the reference both engines must match.                ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<uint8_t Q>
+const OpHandler ChippyOps<Q>::GROUP_8[16] = {
+    op_8XY0, op_8XY1, op_8XY2, op_8XY3, op_8XY4, op_8XY5, op_8XY6, op_8XY7,
+    op_unknown, op_unknown, op_unknown, op_unknown, op_unknown, op_unknown, op_8XYE, op_unknown
+};
+
+template<uint8_t Q>
+const SubTable ChippyOps<Q>::GROUP_0(ChippyOps<Q>::op_unknown, ChippyOps<Q>::GROUP_0_ENTRIES);
+template<uint8_t Q>
+const SubTable ChippyOps<Q>::GROUP_E(ChippyOps<Q>::op_unknown, ChippyOps<Q>::GROUP_E_ENTRIES);
+template<uint8_t Q>
+const SubTable ChippyOps<Q>::GROUP_F(ChippyOps<Q>::op_unknown, ChippyOps<Q>::GROUP_F_ENTRIES);
+
+template<uint8_t Q>
+const OpHandler ChippyOps<Q>::MAIN[16] = {
+    op_group0, op_1NNN, op_2NNN, op_3XNN, op_4XNN, op_5XY0, op_6XNN, op_7XNN,
+    op_group8, op_9XY0, op_ANNN, op_BNNN, op_CXNN, op_DXYN, op_groupE, op_groupF
+};
+
+DecodedOp decode_opcode(uint16_t opcode){
+    DecodedOp op;
+    op.opcode = opcode;
+    op.NNN = opcode & 0x0FFF;
+    op.X = (opcode >> 8) & 0xF;
+    op.Y = (opcode >> 4) & 0xF;
+    op.N = opcode & 0xF;
+    op.NN = opcode & 0xFF;
+    return op;
+}
+
+template<uint8_t Q>
+uint32_t ChippyOps<Q>::run_table(ChippyCore& c, uint32_t count){
+    uint32_t executed = 0;
+    while (executed < count && c.isRunning()) {
+        DecodedOp op = decode_opcode(fetch(c));
+        CHIPPY_PROFILE_OP(c, c.PC, op.opcode);
+        MAIN[op.opcode >> 12](c, op);
+        executed++;
+    }
+    return executed;
+}
+
+// Decode cache: a hit skips fetch, decode and the group tables and calls the leaf handler directly.
+// Odd addresses (and the last byte of RAM) are rare enough to simply run uncached.
+template<uint8_t Q>
+uint32_t ChippyOps<Q>::run_cached(ChippyCore& c, uint32_t count){
+    CachedOp* cache = c._decodeCache;
+    uint32_t executed = 0;
+    while (executed < count && c.isRunning()) {
+        uint16_t pc = c.PC;
+        if ((pc & 1) || pc >= RAM_SIZE - 1) {
+            DecodedOp op = decode_opcode(fetch(c));
+            CHIPPY_PROFILE_OP(c, pc, op.opcode);
+            c._cacheStats.misses++;
+            resolve(op)(c, op);
+        }
+        else {
+            CachedOp& slot = cache[pc >> 1];
+            if (slot.handler) {
+                c._cacheStats.hits++;
+            }
+            else {
+                slot.op = decode_opcode(fetch(c));
+                slot.handler = resolve(slot.op);
+                c._cacheStats.misses++;
+            }
+            CHIPPY_PROFILE_OP(c, pc, slot.op.opcode);
+            slot.handler(c, slot.op);
+        }
+        executed++;
+    }
+    return executed;
+}
+
+#if defined(__GNUC__)
+// Computed goto: one indirect jump per opcode straight into the inlined handler body
+template<uint8_t Q>
+uint32_t ChippyOps<Q>::run_goto(ChippyCore& c, uint32_t count){
+    static void* const MAIN_LABELS[16] = {
+        &&group0, &&op1, &&op2, &&op3, &&op4, &&op5, &&op6, &&op7,
+        &&group8, &&op9, &&opA, &&opB, &&opC, &&opD, &&groupE, &&groupF
+    };
+    static void* const GROUP_8_LABELS[16] = {
+        &&op8XY0, &&op8XY1, &&op8XY2, &&op8XY3, &&op8XY4, &&op8XY5, &&op8XY6, &&op8XY7,
+        &&unknown, &&unknown, &&unknown, &&unknown, &&unknown, &&unknown, &&op8XYE, &&unknown
+    };
+
+    uint32_t executed = 0;
+    DecodedOp op;
+
+    #define DISPATCH() \
+        if (executed >= count || !c.isRunning()) { return executed; } \
+        op = decode_opcode(fetch(c)); \
+        CHIPPY_PROFILE_OP(c, c.PC, op.opcode); \
+        executed++; \
+        goto *MAIN_LABELS[op.opcode >> 12]
+
+    DISPATCH();
+    group0:
+        switch (op.NN) {
+            case 0xE0: op_00E0(c, op); break;
+            case 0xEE: op_00EE(c, op); break;
+            default: GROUP_0.handler[op.NN](c, op); break;  // SCHIP/XO-CHIP display opcodes
+        }
+        DISPATCH();
+    op1: op_1NNN(c, op); DISPATCH();
+    op2: op_2NNN(c, op); DISPATCH();
+    op3: op_3XNN(c, op); DISPATCH();
+    op4: op_4XNN(c, op); DISPATCH();
+    op5: op_5XY0(c, op); DISPATCH();
+    op6: op_6XNN(c, op); DISPATCH();
+    op7: op_7XNN(c, op); DISPATCH();
+    group8: goto *GROUP_8_LABELS[op.N];
+    op8XY0: op_8XY0(c, op); DISPATCH();
+    op8XY1: op_8XY1(c, op); DISPATCH();
+    op8XY2: op_8XY2(c, op); DISPATCH();
+    op8XY3: op_8XY3(c, op); DISPATCH();
+    op8XY4: op_8XY4(c, op); DISPATCH();
+    op8XY5: op_8XY5(c, op); DISPATCH();
+    op8XY6: op_8XY6(c, op); DISPATCH();
+    op8XY7: op_8XY7(c, op); DISPATCH();
+    op8XYE: op_8XYE(c, op); DISPATCH();
+    op9: op_9XY0(c, op); DISPATCH();
+    opA: op_ANNN(c, op); DISPATCH();
+    opB: op_BNNN(c, op); DISPATCH();
+    opC: op_CXNN(c, op); DISPATCH();
+    opD: op_DXYN(c, op); DISPATCH();
+    groupE:
+        switch (op.NN) {
+            case 0x9E: op_EX9E(c, op); break;
+            case 0xA1: op_EXA1(c, op); break;
+            default: op_unknown(c, op); break;
+        }
+        DISPATCH();
+    groupF:
+        switch (op.NN) {
+            case 0x07: op_FX07(c, op); break;
+            case 0x0A: op_FX0A(c, op); break;
+            case 0x15: op_FX15(c, op); break;
+            case 0x18: op_FX18(c, op); break;
+            case 0x1E: op_FX1E(c, op); break;
+            case 0x29: op_FX29(c, op); break;
+            case 0x33: op_FX33(c, op); break;
+            case 0x55: op_FX55(c, op); break;
+            case 0x65: op_FX65(c, op); break;
+            default: GROUP_F.handler[op.NN](c, op); break;  // FN01, F002, FX30, FX3A
+        }
+        DISPATCH();
+    unknown: op_unknown(c, op); DISPATCH();
+
+    #undef DISPATCH
+}
+#else
+// No computed goto on this compiler, fall back to the tables
+template<uint8_t Q>
+uint32_t ChippyOps<Q>::run_goto(ChippyCore& c, uint32_t count){
+    return run_table(c, count);
+}
+#endif
+
+void ChippyCore::set_engine(uint8_t engine){
+    if (engine == ENGINE_CACHED && !_decodeCache) {
+        _decodeCache = static_cast<CachedOp*>(allocate(sizeof(CachedOp) * (RAM_SIZE / 2), ALLOC_TRANSLATION));
+        if (!_decodeCache) {
+            engine = ENGINE_TABLE;
+        }
+    }
+    if (engine == ENGINE_BLOCKS && !_blockIndex) {
+        _blockPool = static_cast<BlockOp*>(allocate(sizeof(BlockOp) * BLOCK_POOL_SIZE, ALLOC_TRANSLATION));
+        _blockSlots = static_cast<uint16_t*>(allocate(sizeof(uint16_t) * BLOCK_POOL_SIZE, ALLOC_TRANSLATION));
+        _blockIndex = static_cast<BlockEntry*>(allocate(sizeof(BlockEntry) * (RAM_SIZE / 2), ALLOC_TRANSLATION));
+        if (_blockIndex) {
+            memset(_blockIndex, 0, sizeof(BlockEntry) * (RAM_SIZE / 2));
+        }
+        if (!_blockPool || !_blockSlots || !_blockIndex) {
+            release(_blockPool, ALLOC_TRANSLATION);
+            release(_blockSlots, ALLOC_TRANSLATION);
+            release(_blockIndex, ALLOC_TRANSLATION);
+            _blockPool = nullptr;
+            _blockSlots = nullptr;
+            _blockIndex = nullptr;
+            engine = ENGINE_TABLE;
+        }
+    }
+    flush_decode_cache();
+    flush_blocks();
+    _engine = engine;
+}
+
+ChippyCore::~ChippyCore(){
+#ifdef CHIPPY_PROFILE
+    if (_profile) {
+        _profile->~ChippyProfile();
+        release(_profile, ALLOC_ANALYSIS);
+    }
+#endif
+    release(_decodeCache, ALLOC_TRANSLATION);
+    release(_blockPool, ALLOC_TRANSLATION);
+    release(_blockSlots, ALLOC_TRANSLATION);
+    release(_blockIndex, ALLOC_TRANSLATION);
+    if (_verifier) {
+        _verifier->~ChippyVerifier();
+        release(_verifier, ALLOC_ANALYSIS);
+    }
+    for (uint8_t page = 0; page < MEMORY_PAGES; page++) {
+        release(_ownedPages[page], ALLOC_GUEST_MEMORY);
+    }
+}
+
+CoreFootprint ChippyCore::get_footprint() const{
+    CoreFootprint footprint = {sizeof(ChippyCore), sizeof(HotState), sizeof(ChippyDisplay), 0, 0, 0, _historyBytes, 0, 0};
+    for (uint8_t page = 0; page < MEMORY_PAGES; page++) {
+        footprint.guest_memory += _ownedPages[page] ? MEMORY_PAGE_SIZE : 0;
+    }
+    if (_decodeCache) {
+        footprint.translation += sizeof(CachedOp) * (RAM_SIZE / 2);
+    }
+    if (_blockIndex) {
+        footprint.translation += (sizeof(BlockOp) + sizeof(uint16_t)) * BLOCK_POOL_SIZE + sizeof(BlockEntry) * (RAM_SIZE / 2);
+    }
+    if (_verifier) {
+        footprint.analysis += sizeof(ChippyVerifier);
+    }
+    if (_verifyRoms) {
+        footprint.transient = ChippyVerifier::work_size();
+    }
+#ifdef CHIPPY_PROFILE
+    if (_profile) {
+        footprint.analysis += sizeof(ChippyProfile);
+    }
+#endif
+    footprint.total = footprint.instance + footprint.guest_memory + footprint.translation + footprint.analysis + footprint.history;
+    return footprint;
+}
+
+void ChippyCore::flush_decode_cache(){
+    if (_decodeCache) {
+        memset(_decodeCache, 0, sizeof(CachedOp) * (RAM_SIZE / 2));
+    }
+}
+
+DecodeCacheStats ChippyCore::get_decode_cache_stats() const{
+    return _cacheStats;
+}
+
+void ChippyCore::select_quirk_profile(uint8_t quirks){
+    _quirkProfile = QuirkProfile::Runtime;
+    if (!_specializeQuirks) {
+        return;
+    }
+    #define CHIPPY_MATCH_PROFILE(P) if (P != QuirkProfile::Runtime && quirks == P) { _quirkProfile = P; }
+    CHIPPY_FOR_EACH_QUIRK_PROFILE(CHIPPY_MATCH_PROFILE)
+    #undef CHIPPY_MATCH_PROFILE
+}
+
+template<uint8_t Q>
+static uint32_t run_engine(ChippyCore& c, uint8_t engine, uint32_t count){
+    switch (engine) {
+        case ENGINE_GOTO:
+            return ChippyOps<Q>::run_goto(c, count);
+        case ENGINE_CACHED:
+            return ChippyOps<Q>::run_cached(c, count);
+        case ENGINE_BLOCKS:
+            return ChippyOps<Q>::run_blocks(c, count);
+        default:
+            return ChippyOps<Q>::run_table(c, count);
+    }
+}
+
+// Executes up to count opcodes with the selected engine, stops early when the emulator stops
+uint32_t ChippyCore::run_instructions(uint32_t count){
+#ifdef CHIPPY_PROFILE
+    uint32_t start = _profile ? platform_micros() : 0;
+#endif
+    uint32_t executed = 0;
+#ifdef CHIPPY_DEBUGGER
+    //The debugger runs everything itself, nothing is left for the engines
+    if (_debugger) {
+        executed = run_debug(count);
+        _idleStats.executed += executed;
+        count = executed;
+    }
+#endif
+    //With idle skipping the engines run in slices, an idle loop is looked for before each one
+    while (executed < count && isRunning()) {
+        uint32_t slice = count - executed;
+        if (_idleSkip) {
+            uint32_t skipped = skip_idle(slice);
+            executed += skipped;
+            slice -= skipped;
+            if (slice > IDLE_CHECK_SLICE) {
+                slice = IDLE_CHECK_SLICE;
+            }
+        }
+        uint32_t ran = 0;
+        if (_engine == ENGINE_SWITCH) {
+            while (ran < slice && isRunning()) {
+                CHIPPY_PROFILE_OP(*this, PC, read_opcode(PC));
+                executeOpcode();
+                ran++;
+            }
+        }
+        else {
+            switch (_quirkProfile) {
+                #define CHIPPY_RUN_PROFILE(P) case P: ran = run_engine<P>(*this, _engine, slice); break;
+                CHIPPY_FOR_EACH_QUIRK_PROFILE(CHIPPY_RUN_PROFILE)
+                #undef CHIPPY_RUN_PROFILE
+                default:
+                    ran = run_engine<QuirkProfile::Runtime>(*this, _engine, slice);
+                break;
+            }
+        }
+        executed += ran;
+        _idleStats.executed += ran;
+        if (ran < slice) {
+            break;
+        }
+    }
+    _frameOps += executed;
+#ifdef CHIPPY_PROFILE
+    //The engines and run_debug() count the opcodes, their time goes to the frame in progress
+    if (_profile) {
+        _profile->frame_micros += platform_micros() - start;
+    }
+#endif
+    return executed;
+}
+
+#ifdef CHIPPY_DEBUGGER
+// One opcode at a time through the reference interpreter, which every engine matches, with the
+// debugger asked before and told after each one
+uint32_t ChippyCore::run_debug(uint32_t count){
+    uint32_t executed = 0;
+    while (executed < count && isRunning()) {
+        uint16_t pc = PC & (RAM_SIZE - 1);
+        if (_debugger->stops_before(pc)) {
+            break;
+        }
+        uint8_t before[MAX_16];
+        memcpy(before, V, sizeof(before));
+        uint16_t index = INDEX;
+        uint16_t opcode = read_opcode(pc);
+        CHIPPY_PROFILE_OP(*this, pc, opcode);
+        executeOpcode();
+        executed++;
+
+        uint8_t x = (opcode >> 8) & 0xF;
+        TraceRecord record = {pc, opcode, 0, INDEX, V[x], V[0xF], SP, 0};
+        for (uint8_t reg = 0; reg < MAX_16; reg++) {
+            record.changed |= (V[reg] != before[reg]) << reg;
+        }
+        if (INDEX != index) {
+            record.flags |= TRACE_INDEX;
+        }
+        _debugger->executed(record, PC & (RAM_SIZE - 1));
+        if (_debugger->is_stopped()) {
+            break;
+        }
+    }
+    return executed;
+}
+
+void ChippyCore::set_debugger(ChippyDebugger* debugger){
+    _debugger = debugger;
+}
+#endif
+
+#define CHIPPY_INSTANTIATE_OPS(P) template struct ChippyOps<P>;
+CHIPPY_FOR_EACH_QUIRK_PROFILE(CHIPPY_INSTANTIATE_OPS)
+#undef CHIPPY_INSTANTIATE_OPS
@@ -0,0 +1,146 @@
+#include "chippycore.h"
+
+///***********************************************************************************************///
+///                                         SNAPSHOTS                                             ///
+///                                                                                               ///
+/// Layout after the header: PC, INDEX (uint16), SP, DELAYTIMER, SOUNDTIMER, fx0a_key, flags,     ///
+/// keys (uint16), hires, plane mask, audio pitch, random state (uint32), V0-VF, STACK (uint16),  ///
+/// audio pattern, every display plane (FRAMEBUFFER_WORDS uint64), RAM. Multi byte values are     ///
+/// little endian so a snapshot moves between the ESP32 and a host build unchanged.               ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//State flags a ROM can observe, the host settings (PAUSE, TURBO, QUIRK_DISPWAIT) stay as they are
+#define SNAPSHOT_FLAGS ((1 << START) | (1 << CLEAR_DISPLAY) | (1 << SOUND_STATE) | (1 << QUIRK4) | (1 << QUIRK5) | \
+                        (1 << QUIRK6) | (1 << QUIRK11) | (1 << FRAME_DRAWN) | (1 << AUDIO_PATTERN))
+
+static inline uint8_t* put16(uint8_t* p, uint16_t value){
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static inline uint16_t get16(const uint8_t* p){
+    return p[0] | (p[1] << 8);
+}
+
+size_t ChippyCore::save_state(uint8_t* buffer, size_t size) const{
+    if (size < SNAPSHOT_SIZE) {
+        return 0;
+    }
+    uint8_t* p = buffer;
+    memcpy(p, SNAPSHOT_MAGIC, 4);
+    p[4] = SNAPSHOT_VERSION;
+    p[5] = 0;
+    p = put16(p + 6, SNAPSHOT_SIZE);
+
+    p = put16(p, PC);
+    p = put16(p, INDEX);
+    *p++ = SP;
+    *p++ = DELAYTIMER;
+    *p++ = SOUNDTIMER;
+    *p++ = fx0a_key;
+    p = put16(p, flag.get_all() & SNAPSHOT_FLAGS);
+    p = put16(p, keys.get_all());
+    *p++ = display.hires();
+    *p++ = display.plane_mask;
+    *p++ = audio_pitch;
+    p = put16(put16(p, _random.state() & 0xFFFF), _random.state() >> 16);
+    memcpy(p, V, MAX_16);
+    p += MAX_16;
+    for (uint8_t level = 0; level < MAX_16; level++) {
+        p = put16(p, STACK[level]);
+    }
+    memcpy(p, audio_pattern, AUDIO_PATTERN_BYTES);
+    p += AUDIO_PATTERN_BYTES;
+    for (uint8_t plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (uint8_t word = 0; word < FRAMEBUFFER_WORDS; word++) {
+            uint64_t value = display.planes[plane][word];
+            for (uint8_t byte = 0; byte < 8; byte++) {
+                *p++ = static_cast<uint8_t>(value >> (byte * 8));
+            }
+        }
+    }
+    for (uint8_t page = 0; page < MEMORY_PAGES; page++, p += MEMORY_PAGE_SIZE) {
+        memcpy(p, _readPages[page], MEMORY_PAGE_SIZE);
+    }
+    return SNAPSHOT_SIZE;
+}
+
+bool ChippyCore::load_state(const uint8_t* buffer, size_t size){
+    if (size < SNAPSHOT_SIZE || memcmp(buffer, SNAPSHOT_MAGIC, 4) || buffer[4] != SNAPSHOT_VERSION ||
+        get16(buffer + 6) != SNAPSHOT_SIZE) {
+        return false;
+    }
+    //Pages that differ from what they read now need a DRAM copy, allocate those first so a failure
+    //leaves the emulator untouched. Unchanged ROM pages keep reading the ROM in place.
+    const uint8_t* memory = buffer + SNAPSHOT_SIZE - RAM_SIZE;
+    uint16_t changed = 0;
+    for (uint8_t page = 0; page < MEMORY_PAGES; page++) {
+        if (memcmp(_readPages[page], memory + page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE)) {
+            if (!own_page(page)) {
+                return false;
+            }
+            changed |= 1 << page;
+        }
+    }
+    const uint8_t* p = buffer + SNAPSHOT_HEADER_SIZE;
+    PC = get16(p);
+    INDEX = get16(p + 2);
+    SP = p[4];
+    DELAYTIMER = p[5];
+    SOUNDTIMER = p[6];
+    fx0a_key = p[7];
+    flag.set_all((flag.get_all() & ~SNAPSHOT_FLAGS) | (get16(p + 8) & SNAPSHOT_FLAGS));
+    keys.set_all(get16(p + 10));
+    display.set_hires(p[12]);
+    display.plane_mask = p[13] & ((1 << DISPLAY_PLANES) - 1);
+    audio_pitch = p[14];
+    _random.set_state(get16(p + 15) | (static_cast<uint32_t>(get16(p + 17)) << 16));
+    p += 19;
+    memcpy(V, p, MAX_16);
+    p += MAX_16;
+    for (uint8_t level = 0; level < MAX_16; level++, p += 2) {
+        STACK[level] = get16(p);
+    }
+    memcpy(audio_pattern, p, AUDIO_PATTERN_BYTES);
+    p += AUDIO_PATTERN_BYTES;
+    for (uint8_t plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (uint8_t word = 0; word < FRAMEBUFFER_WORDS; word++) {
+            uint64_t value = 0;
+            for (uint8_t byte = 0; byte < 8; byte++) {
+                value |= static_cast<uint64_t>(*p++) << (byte * 8);
+            }
+            display.planes[plane][word] = value;
+        }
+    }
+    for (uint8_t page = 0; page < MEMORY_PAGES; page++) {
+        if (changed & (1 << page)) {
+            memcpy(_ownedPages[page], memory + page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+            _dirtyMask |= 1 << page;
+        }
+    }
+
+    //Decoded copies of the old code are stale, the quirks may differ, and the host redraws everything
+    flush_decode_cache();
+    flush_blocks();
+    uint8_t quirks = (flag.get(QUIRK4) ? QUIRK_MASK_VF_RESET : 0) | (flag.get(QUIRK5) ? QUIRK_MASK_SHIFT : 0) |
+                     (flag.get(QUIRK6) ? QUIRK_MASK_WRAP : 0) | (flag.get(QUIRK11) ? QUIRK_MASK_MEMORY : 0);
+    select_quirk_profile(quirks);
+    //The trust only covers the verified code under the verified quirks, entered where the ROM can be
+    if (_trustedRom) {
+        bool keep = quirks == _verifier->report().quirks && _verifier->same_code(memory) && !(PC & 1) &&
+                    _verifier->is_code(PC) && SP <= MAX_16;
+        for (uint8_t level = 0; level < SP && keep; level++) {
+            keep = !(STACK[level] & 1) && _verifier->is_code(STACK[level]);
+        }
+        if (!keep) {
+            _trustedRom = false;
+            _verifier->revoke();
+        }
+    }
+    display.dirty_rows = display.all_rows();
+    last_schedule_us = platform_micros();
+    frame_phase = 0;
+    frame_executed = 0;
+    return true;
+}
@@ -0,0 +1,137 @@
+#include "chippydebug.h"
+
+ChippyDebugger::ChippyDebugger(){
+    clear();
+}
+
+void ChippyDebugger::set_breakpoint(uint16_t pc, bool enabled){
+    pc &= RAM_SIZE - 1;
+    if (enabled) {
+        _breakpoints[pc >> 3] |= 1 << (pc & 7);
+    }
+    else {
+        _breakpoints[pc >> 3] &= ~(1 << (pc & 7));
+    }
+}
+
+bool ChippyDebugger::has_breakpoint(uint16_t pc) const{
+    pc &= RAM_SIZE - 1;
+    return _breakpoints[pc >> 3] & (1 << (pc & 7));
+}
+
+void ChippyDebugger::set_watchpoint(uint16_t address, bool enabled){
+    address &= RAM_SIZE - 1;
+    if (enabled) {
+        _watchpoints[address >> 3] |= 1 << (address & 7);
+    }
+    else {
+        _watchpoints[address >> 3] &= ~(1 << (address & 7));
+    }
+}
+
+bool ChippyDebugger::has_watchpoint(uint16_t address) const{
+    address &= RAM_SIZE - 1;
+    return _watchpoints[address >> 3] & (1 << (address & 7));
+}
+
+void ChippyDebugger::clear(){
+    memset(_breakpoints, 0, sizeof(_breakpoints));
+    memset(_watchpoints, 0, sizeof(_watchpoints));
+    memset(_trace, 0, sizeof(_trace));
+    _traced = 0;
+    _stop = {DEBUG_RUNNING, 0, 0, 0, 0, 0};
+    _pending = _stop;
+    _steps = 0;
+    _skipBreak = false;
+    _wrote = false;
+}
+
+const DebugStop& ChippyDebugger::stopped() const{
+    return _stop;
+}
+
+bool ChippyDebugger::is_stopped() const{
+    return _stop.reason != DEBUG_RUNNING;
+}
+
+void ChippyDebugger::resume(){
+    _skipBreak = is_stopped();
+    _stop.reason = DEBUG_RUNNING;
+    _pending.reason = DEBUG_RUNNING;
+    _steps = 0;
+}
+
+void ChippyDebugger::step(uint32_t count){
+    resume();
+    _steps = count;
+}
+
+void ChippyDebugger::request_stop(){
+    _pending.reason = DEBUG_REQUEST;
+}
+
+uint16_t ChippyDebugger::trace_count() const{
+    return _traced < DEBUG_TRACE_SIZE ? _traced : DEBUG_TRACE_SIZE;
+}
+
+const TraceRecord& ChippyDebugger::trace(uint16_t age) const{
+    return _trace[(_traced - 1 - age) & (DEBUG_TRACE_SIZE - 1)];
+}
+
+bool ChippyDebugger::stops_before(uint16_t pc){
+    if (is_stopped()) {
+        return true;
+    }
+    if (_pending.reason == DEBUG_REQUEST) {
+        _pending.pc = pc;
+        stop(_pending);
+        return true;
+    }
+    if (_skipBreak) {
+        _skipBreak = false;
+        return false;
+    }
+    if (has_breakpoint(pc)) {
+        stop({DEBUG_BREAKPOINT, pc, 0, 0, 0, 0});
+        return true;
+    }
+    return false;
+}
+
+void ChippyDebugger::executed(const TraceRecord& record, uint16_t nextPc){
+    TraceRecord& entry = _trace[_traced++ & (DEBUG_TRACE_SIZE - 1)];
+    entry = record;
+    if (_wrote) {
+        entry.flags |= TRACE_WRITE;
+        _wrote = false;
+    }
+    if (is_stopped()) {
+        return;     // The opcode raised an error
+    }
+    if (_pending.reason == DEBUG_WATCHPOINT) {
+        _pending.pc = nextPc;
+        stop(_pending);
+    }
+    else if (_steps && !--_steps) {
+        stop({DEBUG_STEP, nextPc, 0, 0, 0, 0});
+    }
+}
+
+// Only the first watched write of an opcode is reported, FX55 may write several
+void ChippyDebugger::memory_written(uint16_t pc, uint16_t address, uint8_t oldValue, uint8_t newValue){
+    address &= RAM_SIZE - 1;
+    _wrote = true;
+    if (_pending.reason == DEBUG_RUNNING && has_watchpoint(address)) {
+        _pending = {DEBUG_WATCHPOINT, pc, address, oldValue, newValue, 0};
+    }
+}
+
+void ChippyDebugger::error(uint16_t pc, uint8_t errorCode){
+    stop({DEBUG_ERROR, static_cast<uint16_t>(pc & (RAM_SIZE - 1)), 0, 0, 0, errorCode});
+}
+
+void ChippyDebugger::stop(const DebugStop& stop){
+    _stop = stop;
+    _pending.reason = DEBUG_RUNNING;
+    _steps = 0;
+}
@@ -0,0 +1,113 @@
+#ifndef CHIPPYDEBUG_H
+#define CHIPPYDEBUG_H
+
+#include "platform.h"
+#include "defines.h"
+
+///***********************************************************************************************///
+///                                         DEBUGGER                                              ///
+///                                                                                               ///
+/// Built only with CHIPPY_DEBUGGER defined (defines.h or -DCHIPPY_DEBUGGER), without it the hooks ///
+/// below compile to nothing. With it, ChippyCore::set_debugger() attaches a ChippyDebugger: from  ///
+/// then on every opcode runs one at a time through the reference interpreter (whatever engine is  ///
+/// selected, idle loops are not skipped) and the debugger sees each of them. It stops before an   ///
+/// opcode at a breakpoint, after an opcode that wrote a watched address, after the steps asked    ///
+/// for and at an error. A stopped machine runs no opcodes and no timer ticks until resume() or    ///
+/// step(). The last DEBUG_TRACE_SIZE opcodes are kept in a ring with what they changed.           ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef DEBUG_TRACE_SIZE
+    #define DEBUG_TRACE_SIZE 64     // Trace records kept, a power of two
+#endif
+
+//Why the machine stopped, DEBUG_RUNNING while it runs
+#define DEBUG_RUNNING 0
+#define DEBUG_BREAKPOINT 1      // Before the opcode at a breakpoint
+#define DEBUG_WATCHPOINT 2      // After the opcode that wrote a watched address
+#define DEBUG_STEP 3            // After the opcodes step() asked for
+#define DEBUG_REQUEST 4         // request_stop()
+#define DEBUG_ERROR 5           // After the opcode that raised an error, the emulator is stopped
+
+#define TRACE_INDEX 0x01        // The opcode changed I
+#define TRACE_WRITE 0x02        // The opcode wrote guest memory
+
+//One executed opcode and its register delta
+struct TraceRecord {
+    uint16_t pc;            // Address of the opcode
+    uint16_t opcode;
+    uint16_t changed;       // Bit n set when the opcode changed Vn
+    uint16_t index;         // I after the opcode
+    uint8_t vx;             // VX after the opcode, X from the opcode
+    uint8_t vf;             // VF after the opcode
+    uint8_t sp;             // Stack depth after the opcode
+    uint8_t flags;          // TRACE_*
+};
+
+//Where and why the machine stopped
+struct DebugStop {
+    uint8_t reason;         // DEBUG_*
+    uint16_t pc;            // Next opcode to run
+    uint16_t address;       // DEBUG_WATCHPOINT: the first watched address written
+    uint8_t old_value;
+    uint8_t new_value;
+    uint8_t error;          // DEBUG_ERROR: the error code (defines.h)
+};
+
+class ChippyDebugger{
+    public:
+        ChippyDebugger();
+
+        //Addresses wrap at RAM_SIZE. A breakpoint at an odd address or inside data never triggers.
+        void set_breakpoint(uint16_t pc, bool enabled = true);
+        bool has_breakpoint(uint16_t pc) const;
+        //Stops after an opcode (FX33, FX55) wrote the address
+        void set_watchpoint(uint16_t address, bool enabled = true);
+        bool has_watchpoint(uint16_t address) const;
+        //Drops every breakpoint, watchpoint and trace record, the machine runs on
+        void clear();
+
+        //Only from the thread that runs the core
+        const DebugStop& stopped() const;
+        bool is_stopped() const;
+        //Runs on until the next stop, a breakpoint at the current PC does not stop it again
+        void resume();
+        //Runs count opcodes and stops, breakpoints and watchpoints still stop it earlier
+        void step(uint32_t count = 1);
+        //Stops before the next opcode
+        void request_stop();
+
+        //Opcodes in the trace, at most DEBUG_TRACE_SIZE
+        uint16_t trace_count() const;
+        //age 0 is the last executed opcode
+        const TraceRecord& trace(uint16_t age) const;
+
+        //Called by the core: before and after every opcode, at every guest memory write and every error
+        bool stops_before(uint16_t pc);
+        void executed(const TraceRecord& record, uint16_t nextPc);
+        void memory_written(uint16_t pc, uint16_t address, uint8_t oldValue, uint8_t newValue);
+        void error(uint16_t pc, uint8_t errorCode);
+
+    private:
+        uint8_t _breakpoints[RAM_SIZE / 8];
+        uint8_t _watchpoints[RAM_SIZE / 8];
+        TraceRecord _trace[DEBUG_TRACE_SIZE];
+        uint32_t _traced;           ///< Records ever written, the newest is at (_traced - 1) % DEBUG_TRACE_SIZE
+        DebugStop _stop;
+        DebugStop _pending;         ///< Stop raised by request_stop() or by a write of the running opcode
+        uint32_t _steps;            ///< Opcodes left before DEBUG_STEP, 0 when not stepping
+        bool _skipBreak;            ///< The next opcode ignores its breakpoint (resume() and step())
+        bool _wrote;                ///< The running opcode wrote guest memory
+
+        void stop(const DebugStop& stop);
+};
+
+#ifdef CHIPPY_DEBUGGER
+    #define CHIPPY_DEBUG_WRITE(c, address, value) \
+        do { if ((c)._debugger) { (c)._debugger->memory_written((c).PC, (address), (c).read_memory(address), (value)); } } while (0)
+    #define CHIPPY_DEBUG_ERROR(c, errorCode) \
+        do { if ((c)._debugger) { (c)._debugger->error((c).PC, (errorCode)); } } while (0)
+#else
+    #define CHIPPY_DEBUG_WRITE(c, address, value) do { } while (0)
+    #define CHIPPY_DEBUG_ERROR(c, errorCode) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef CHIPPYDISPLAY_H
+#define CHIPPYDISPLAY_H
+
+#include "platform.h"
+#include "defines.h"
+
+///***********************************************************************************************///
+///                                          DISPLAY                                              ///
+///                                                                                               ///
+/// DISPLAY_PLANES bitplanes of packed row words: a row is width / 64 uint64 words and bit 63 of  ///
+/// its first word is x = 0. Low resolution is DISPLAY_WIDTH x DISPLAY_HEIGHT with one word per   ///
+/// row, exactly the old framebuffer. 00FF switches to HIRES_WIDTH x HIRES_HEIGHT with two words  ///
+/// per row. Sprites XOR whole words, scrolls move or shift words, nothing is done per pixel.     ///
+/// DXYN, 00E0 and the scrolls work on the planes selected by FN01 (plane 1 after a reset).       ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//The fontsets in guest memory, FX29 points at FONTSET and FX30 at BIG_FONTSET
+static constexpr uint8_t FONTSET[80] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+static constexpr uint8_t BIG_FONTSET[160] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+//Sprite bytes one DXYN can read: 16x16 rows on every plane
+#define SPRITE_MAX_BYTES (32 * DISPLAY_PLANES)
+
+//A view of the display for the present callback
+struct DisplayFrame {
+    const uint64_t* planes[DISPLAY_PLANES];
+    uint8_t width;
+    uint8_t height;
+    uint8_t row_words;      // Words per row, width / 64
+    uint64_t dirty_rows;    // Bit n set when row n changed on any plane
+};
+
+class ChippyDisplay{
+    public:
+        uint64_t planes[DISPLAY_PLANES][FRAMEBUFFER_WORDS];
+        uint64_t dirty_rows;    ///< Bit n set when row n changed since the last present
+        uint8_t width;
+        uint8_t height;
+        uint8_t row_words;
+        uint8_t plane_mask;     ///< FN01 selection, bit n is plane n
+
+        //Low resolution, plane 1 selected, blank, every row dirty so the first present sends the whole screen
+        void reset(){
+            memset(planes, 0, sizeof(planes));
+            set_geometry(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+            plane_mask = 1;
+        }
+
+        //00FE/00FF. The row layout changes, so every plane is cleared (as Octo does).
+        void set_hires(bool hires){
+            memset(planes, 0, sizeof(planes));
+            if (hires) {
+                set_geometry(HIRES_WIDTH, HIRES_HEIGHT);
+            }
+            else {
+                set_geometry(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+            }
+        }
+
+        inline bool hires() const{
+            return width == HIRES_WIDTH;
+        }
+
+        inline uint64_t all_rows() const{
+            return height == 64 ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << height) - 1;
+        }
+
+        //Number of selected planes, DXYN reads this many sprites one after the other
+        inline uint8_t selected_planes() const{
+            return __builtin_popcount(plane_mask);
+        }
+
+        //00E0 on the selected planes. Only rows that held pixels are marked dirty.
+        void clear(){
+            for (uint8_t plane = 0; plane < DISPLAY_PLANES; plane++) {
+                if (!(plane_mask & (1 << plane))) {
+                    continue;
+                }
+                uint64_t* words = planes[plane];
+                for (uint8_t row = 0; row < height; row++, words += row_words) {
+                    uint64_t lit = 0;
+                    for (uint8_t word = 0; word < row_words; word++) {
+                        lit |= words[word];
+                        words[word] = 0;
+                    }
+                    if (lit) {
+                        dirty_rows |= static_cast<uint64_t>(1) << row;
+                    }
+                }
+            }
+        }
+
+        //00CN and 00DN: whole rows move, so one memmove per plane
+        void scroll_down(uint8_t rows){
+            scroll_vertical(rows, true);
+        }
+        void scroll_up(uint8_t rows){
+            scroll_vertical(rows, false);
+        }
+
+        //00FB and 00FC: 4 pixels, each row word takes the bits shifted out of its neighbour
+        void scroll_right(){
+            for_each_selected_row([this](uint64_t* words){
+                for (uint8_t word = row_words - 1; word > 0; word--) {
+                    words[word] = (words[word] >> 4) | (words[word - 1] << 60);
+                }
+                words[0] >>= 4;
+            });
+        }
+        void scroll_left(){
+            for_each_selected_row([this](uint64_t* words){
+                for (uint8_t word = 0; word + 1 < row_words; word++) {
+                    words[word] = (words[word] << 4) | (words[word + 1] >> 60);
+                }
+                words[row_words - 1] <<= 4;
+            });
+        }
+
+        //XORs an 8xN sprite (16x16 for N = 0) into every selected plane, the sprite of the next plane follows
+        //in sprite[]. A sprite row is at most two row words wide: the part past the last word wraps to the
+        //first one (WRAP) or is clipped, rows past the bottom likewise. Out of range coordinates draw nothing
+        //without WRAP. onFlip(plane, row, word, bits) sees every word that changed. Returns the collision.
+        template<bool WRAP, typename OnFlip>
+        bool draw(uint8_t x, uint8_t y, uint8_t N, const uint8_t* sprite, OnFlip onFlip){
+            if (WRAP) {
+                x &= width - 1;
+                y &= height - 1;
+            }
+            else if (x >= width || y >= height) {
+                return false;
+            }
+            uint8_t rows = N ? N : 16;
+            uint8_t rowBytes = N ? 1 : 2;
+            uint8_t spriteWidth = rowBytes * MAX_8;
+            uint8_t first = x >> 6;
+            uint8_t offset = x & 63;
+            bool spills = offset + spriteWidth > 64;
+            uint8_t second = first + 1 < row_words ? first + 1 : 0;
+            bool collision = false;
+            for (uint8_t plane = 0; plane < DISPLAY_PLANES; plane++) {
+                if (!(plane_mask & (1 << plane))) {
+                    continue;
+                }
+                for (uint8_t row = 0; row < rows; row++) {
+                    uint8_t py = y + row;
+                    if (py >= height) {
+                        if (!WRAP) {
+                            break;
+                        }
+                        py -= height;
+                    }
+                    const uint8_t* bytes = sprite + row * rowBytes;
+                    uint64_t bits = static_cast<uint64_t>(rowBytes == 2 ? (bytes[0] << 8) | bytes[1] : bytes[0]) << (64 - spriteWidth);
+                    uint64_t left = bits >> offset;
+                    uint64_t right = spills && (WRAP || second) ? bits << (64 - offset) : 0;
+                    if (!(left | right)) {
+                        continue;
+                    }
+                    uint64_t* words = planes[plane] + py * row_words;
+                    if (left) {
+                        collision |= flip(words, first, left, plane, py, onFlip);
+                    }
+                    if (right) {
+                        collision |= flip(words, second, right, plane, py, onFlip);
+                    }
+                    dirty_rows |= static_cast<uint64_t>(1) << py;
+                }
+                sprite += rows * rowBytes;
+            }
+            return collision;
+        }
+
+        DisplayFrame frame() const{
+            DisplayFrame frame;
+            for (uint8_t plane = 0; plane < DISPLAY_PLANES; plane++) {
+                frame.planes[plane] = planes[plane];
+            }
+            frame.width = width;
+            frame.height = height;
+            frame.row_words = row_words;
+            frame.dirty_rows = dirty_rows;
+            return frame;
+        }
+
+    private:
+        void set_geometry(uint8_t newWidth, uint8_t newHeight){
+            width = newWidth;
+            height = newHeight;
+            row_words = newWidth / 64;
+            dirty_rows = all_rows();
+        }
+
+        template<typename OnFlip>
+        static inline bool flip(uint64_t* words, uint8_t word, uint64_t bits, uint8_t plane, uint8_t row, OnFlip& onFlip){
+            bool collision = (words[word] & bits) != 0;
+            words[word] ^= bits;
+            onFlip(plane, row, word, bits);
+            return collision;
+        }
+
+        template<typename RowOp>
+        void for_each_selected_row(RowOp op){
+            for (uint8_t plane = 0; plane < DISPLAY_PLANES; plane++) {
+                if (plane_mask & (1 << plane)) {
+                    for (uint8_t row = 0; row < height; row++) {
+                        op(planes[plane] + row * row_words);
+                    }
+                }
+            }
+            dirty_rows = all_rows();
+        }
+
+        void scroll_vertical(uint8_t rows, bool down){
+            if (rows > height) {
+                rows = height;
+            }
+            size_t moved = static_cast<size_t>(height - rows) * row_words;
+            size_t cleared = static_cast<size_t>(rows) * row_words;
+            for (uint8_t plane = 0; plane < DISPLAY_PLANES; plane++) {
+                if (!(plane_mask & (1 << plane))) {
+                    continue;
+                }
+                uint64_t* words = planes[plane];
+                if (down) {
+                    memmove(words + cleared, words, moved * sizeof(uint64_t));
+                    memset(words, 0, cleared * sizeof(uint64_t));
+                }
+                else {
+                    memmove(words, words + cleared, moved * sizeof(uint64_t));
+                    memset(words + moved, 0, cleared * sizeof(uint64_t));
+                }
+            }
+            if (rows) {
+                dirty_rows = all_rows();
+            }
+        }
+};
+
+#endif
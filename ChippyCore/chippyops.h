@@ -0,0 +1,387 @@
+#ifndef CHIPPYOPS_H
+#define CHIPPYOPS_H
+
+#include "chippycore.h"
+
+// Opcode handlers shared by the table, goto, cached and block engines. Private to the core sources.
+// Everything is instantiated once per quirk profile: for a specialized profile quirk() is a compile time
+// constant and the quirk branches disappear, QuirkProfile::Runtime reads the flags like executeOpcode().
+
+// The profiles with an instantiation, load_and_run() falls back to QuirkProfile::Runtime for any other config.
+// Build with CHIPPY_SPECIALIZE_QUIRKS=0 to keep only the runtime one, each profile costs about 20 KB of flash.
+#ifndef CHIPPY_SPECIALIZE_QUIRKS
+    #define CHIPPY_SPECIALIZE_QUIRKS 1
+#endif
+#if CHIPPY_SPECIALIZE_QUIRKS
+    #define CHIPPY_FOR_EACH_QUIRK_PROFILE(X) \
+        X(QuirkProfile::None) X(QuirkProfile::CosmacVIP) X(QuirkProfile::Chip48) X(QuirkProfile::SChip) \
+        X(QuirkProfile::XOChip) X(QuirkProfile::Runtime)
+#else
+    #define CHIPPY_FOR_EACH_QUIRK_PROFILE(X) X(QuirkProfile::Runtime)
+#endif
+
+struct BlockOp;
+typedef void (*BlockHandler)(ChippyCore& c, const BlockOp& block);
+
+//One threaded op of a translated block, second is only used by superinstructions
+struct BlockOp {
+    BlockHandler handler;
+    DecodedOp op;
+    DecodedOp second;
+};
+
+struct SubEntry {
+    uint8_t key;
+    OpHandler handler;
+};
+
+// 256 entry sub-opcode table built at compile time, unlisted keys go to the fallback
+struct SubTable {
+    OpHandler handler[256];
+
+    template<size_t COUNT>
+    constexpr SubTable(OpHandler fallback, const SubEntry (&entries)[COUNT]) : handler() {
+        for (size_t i = 0; i < 256; i++) {
+            handler[i] = fallback;
+        }
+        for (size_t i = 0; i < COUNT; i++) {
+            handler[entries[i].key] = entries[i].handler;
+        }
+    }
+};
+
+template<uint8_t Q>
+struct ChippyOps {
+    static inline bool quirk(const ChippyCore& c, uint8_t mask, uint8_t flagBit){
+        return Q == QuirkProfile::Runtime ? c.flag.get(flagBit) : (Q & mask) != 0;
+    }
+
+    static inline uint16_t fetch(const ChippyCore& c){
+        return c.read_opcode(c.PC);
+    }
+
+    static inline void skip_if(ChippyCore& c, bool condition){
+        c.PC += condition ? 4 : 2;
+    }
+
+    static inline void op_unknown(ChippyCore& c, const DecodedOp& op){
+        c.handleError(UNKNOWN_OPCODE);
+    }
+
+    // 0NNN group
+    static inline void op_00E0(ChippyCore& c, const DecodedOp& op){
+        c.clear_screen();
+        c.PC += 2;
+    }
+    static inline void op_00EE(ChippyCore& c, const DecodedOp& op){
+        if (c.SP <= 0) {
+            c.handleError(STACK_UNDERFLOW_ERROR);
+        }
+        else {
+            c.PC = c.STACK[--c.SP];
+        }
+    }
+
+    // SCHIP/XO-CHIP display, word level operations in chippydisplay.h
+    static inline void op_00CN(ChippyCore& c, const DecodedOp& op){
+        c.display.scroll_down(op.N);
+        c.display_changed();
+        c.PC += 2;
+    }
+    static inline void op_00DN(ChippyCore& c, const DecodedOp& op){
+        c.display.scroll_up(op.N);
+        c.display_changed();
+        c.PC += 2;
+    }
+    static inline void op_00FB(ChippyCore& c, const DecodedOp& op){
+        c.display.scroll_right();
+        c.display_changed();
+        c.PC += 2;
+    }
+    static inline void op_00FC(ChippyCore& c, const DecodedOp& op){
+        c.display.scroll_left();
+        c.display_changed();
+        c.PC += 2;
+    }
+    static inline void op_00FD(ChippyCore& c, const DecodedOp& op){
+        c.stopEmulator();
+    }
+    static inline void op_00FE(ChippyCore& c, const DecodedOp& op){
+        c.display.set_hires(false);
+        c.display_changed();
+        c.PC += 2;
+    }
+    static inline void op_00FF(ChippyCore& c, const DecodedOp& op){
+        c.display.set_hires(true);
+        c.display_changed();
+        c.PC += 2;
+    }
+
+    // Flow control and immediates
+    static inline void op_1NNN(ChippyCore& c, const DecodedOp& op){
+        c.PC = op.NNN;
+    }
+    static inline void op_2NNN(ChippyCore& c, const DecodedOp& op){
+        if (c.SP < MAX_16) {
+            c.STACK[c.SP++] = c.PC + 2;
+            c.PC = op.NNN;
+        }
+        else {
+            c.handleError(STACK_OVERFLOW_ERROR);
+        }
+    }
+    static inline void op_3XNN(ChippyCore& c, const DecodedOp& op){
+        skip_if(c, c.V[op.X] == op.NN);
+    }
+    static inline void op_4XNN(ChippyCore& c, const DecodedOp& op){
+        skip_if(c, c.V[op.X] != op.NN);
+    }
+    static inline void op_5XY0(ChippyCore& c, const DecodedOp& op){
+        skip_if(c, c.V[op.X] == c.V[op.Y]);
+    }
+    static inline void op_6XNN(ChippyCore& c, const DecodedOp& op){
+        c.V[op.X] = op.NN;
+        c.PC += 2;
+    }
+    static inline void op_7XNN(ChippyCore& c, const DecodedOp& op){
+        c.V[op.X] += op.NN;
+        c.PC += 2;
+    }
+
+    // 8XYN group
+    static inline void op_8XY0(ChippyCore& c, const DecodedOp& op){
+        c.V[op.X] = c.V[op.Y];
+        c.PC += 2;
+    }
+    static inline void op_8XY1(ChippyCore& c, const DecodedOp& op){
+        c.V[op.X] |= c.V[op.Y];
+        if (quirk(c, QUIRK_MASK_VF_RESET, QUIRK4)) {
+            c.V[0xF] = 0;
+        }
+        c.PC += 2;
+    }
+    static inline void op_8XY2(ChippyCore& c, const DecodedOp& op){
+        c.V[op.X] &= c.V[op.Y];
+        if (quirk(c, QUIRK_MASK_VF_RESET, QUIRK4)) {
+            c.V[0xF] = 0;
+        }
+        c.PC += 2;
+    }
+    static inline void op_8XY3(ChippyCore& c, const DecodedOp& op){
+        c.V[op.X] ^= c.V[op.Y];
+        if (quirk(c, QUIRK_MASK_VF_RESET, QUIRK4)) {
+            c.V[0xF] = 0;
+        }
+        c.PC += 2;
+    }
+    // VF is written before the result like in executeOpcode(), which matters when X or Y is F
+    static inline void op_8XY4(ChippyCore& c, const DecodedOp& op){
+        c.V[0xF] = ((c.V[op.X] + c.V[op.Y]) > 0xFF) ? 1 : 0;
+        c.V[op.X] = (c.V[op.X] + c.V[op.Y]) & 0xFF;
+        c.PC += 2;
+    }
+    static inline void op_8XY5(ChippyCore& c, const DecodedOp& op){
+        c.V[0xF] = (c.V[op.X] > c.V[op.Y]) ? 1 : 0;
+        c.V[op.X] -= c.V[op.Y];
+        c.PC += 2;
+    }
+    static inline void op_8XY6(ChippyCore& c, const DecodedOp& op){
+        if (quirk(c, QUIRK_MASK_SHIFT, QUIRK5)) {
+            c.V[0xF] = c.V[op.X] & 0x1;
+            c.V[op.X] >>= 1;
+        }
+        else {
+            c.V[0xF] = c.V[op.Y] & 0x1;
+            c.V[op.X] = c.V[op.Y] >> 1;
+        }
+        c.PC += 2;
+    }
+    static inline void op_8XY7(ChippyCore& c, const DecodedOp& op){
+        c.V[0xF] = (c.V[op.Y] > c.V[op.X]) ? 1 : 0;
+        c.V[op.X] = c.V[op.Y] - c.V[op.X];
+        c.PC += 2;
+    }
+    static inline void op_8XYE(ChippyCore& c, const DecodedOp& op){
+        if (quirk(c, QUIRK_MASK_SHIFT, QUIRK5)) {
+            c.V[0xF] = (c.V[op.X] & 0x80) ? 1 : 0;
+            c.V[op.X] <<= 1;
+        }
+        else {
+            c.V[0xF] = (c.V[op.Y] & 0x80) ? 1 : 0;
+            c.V[op.X] = c.V[op.Y] << 1;
+        }
+        c.PC += 2;
+    }
+
+    static inline void op_9XY0(ChippyCore& c, const DecodedOp& op){
+        skip_if(c, c.V[op.X] != c.V[op.Y]);
+    }
+    static inline void op_ANNN(ChippyCore& c, const DecodedOp& op){
+        c.INDEX = op.NNN;
+        c.PC += 2;
+    }
+    static inline void op_BNNN(ChippyCore& c, const DecodedOp& op){
+        c.PC = op.NNN + c.V[0];
+    }
+    static inline void op_CXNN(ChippyCore& c, const DecodedOp& op){
+        c.V[op.X] = c.random_byte() & op.NN;
+        c.PC += 2;
+    }
+    static inline void op_DXYN(ChippyCore& c, const DecodedOp& op){
+        bool drawn = Q == QuirkProfile::Runtime ? c.draw_sprite(op.X, op.Y, op.N)
+                                                : c.draw_sprite<(Q & QUIRK_MASK_WRAP) != 0>(op.X, op.Y, op.N);
+        if (drawn) {
+            c.PC += 2;
+        }
+    }
+
+    // EXNN group
+    static inline void op_EX9E(ChippyCore& c, const DecodedOp& op){
+        skip_if(c, c.is_key_pressed(c.V[op.X]));
+    }
+    static inline void op_EXA1(ChippyCore& c, const DecodedOp& op){
+        skip_if(c, !c.is_key_pressed(c.V[op.X]));
+    }
+
+    // FXNN group
+    static inline void op_FX07(ChippyCore& c, const DecodedOp& op){
+        c.V[op.X] = c.DELAYTIMER;
+        c.PC += 2;
+    }
+    static inline void op_FX0A(ChippyCore& c, const DecodedOp& op){
+        int8_t pressedKey = c.get_released_key();
+        if (pressedKey != -1) {
+            c.V[op.X] = pressedKey;
+            c.PC += 2;
+        }
+    }
+    static inline void op_FX15(ChippyCore& c, const DecodedOp& op){
+        c.DELAYTIMER = c.V[op.X];
+        c.PC += 2;
+    }
+    static inline void op_FX18(ChippyCore& c, const DecodedOp& op){
+        c.SOUNDTIMER = c.V[op.X];
+        c.PC += 2;
+    }
+    static inline void op_FX1E(ChippyCore& c, const DecodedOp& op){
+        c.INDEX += c.V[op.X];
+        c.V[0xF] = (c.INDEX > 0xFFF) ? 1 : 0;
+        c.INDEX &= 0xFFF;
+        c.PC += 2;
+    }
+    static inline void op_FX29(ChippyCore& c, const DecodedOp& op){
+        c.INDEX = FONTSET_START_ADDRESS + (c.V[op.X] * 5);
+        c.PC += 2;
+    }
+    static inline void op_FX30(ChippyCore& c, const DecodedOp& op){
+        c.INDEX = BIG_FONTSET_START_ADDRESS + (c.V[op.X] & 0xF) * 10;
+        c.PC += 2;
+    }
+    static inline void op_FN01(ChippyCore& c, const DecodedOp& op){
+        c.display.plane_mask = op.X & ((1 << DISPLAY_PLANES) - 1);
+        c.PC += 2;
+    }
+    static inline void op_F002(ChippyCore& c, const DecodedOp& op){
+        if (op.X != 0) {
+            op_unknown(c, op); // Only F002 itself, not any FX02
+            return;
+        }
+        for (uint8_t byte = 0; byte < AUDIO_PATTERN_BYTES; byte++) {
+            c.audio_pattern[byte] = c.read_memory(c.INDEX + byte);
+        }
+        c.flag.set(AUDIO_PATTERN, true);
+        c.PC += 2;
+    }
+    static inline void op_FX3A(ChippyCore& c, const DecodedOp& op){
+        c.audio_pitch = c.V[op.X];
+        c.PC += 2;
+    }
+    static inline void op_FX33(ChippyCore& c, const DecodedOp& op){
+        c.write_memory(c.INDEX, c.V[op.X] / 100);
+        c.write_memory(c.INDEX + 1, (c.V[op.X] / 10) % 10);
+        c.write_memory(c.INDEX + 2, c.V[op.X] % 10);
+        c.PC += 2;
+    }
+    static inline void op_FX55(ChippyCore& c, const DecodedOp& op){
+        for (uint8_t reg = 0; reg <= op.X; ++reg) {
+            c.write_memory(c.INDEX + reg, c.V[reg]);
+        }
+        if (quirk(c, QUIRK_MASK_MEMORY, QUIRK11)) {
+            c.INDEX += op.X + 1;
+        }
+        c.PC += 2;
+    }
+    static inline void op_FX65(ChippyCore& c, const DecodedOp& op){
+        for (uint8_t reg = 0; reg <= op.X; ++reg) {
+            c.V[reg] = c.read_memory(c.INDEX + reg);
+        }
+        if (quirk(c, QUIRK_MASK_MEMORY, QUIRK11)) {
+            c.INDEX += op.X + 1;
+        }
+        c.PC += 2;
+    }
+
+    // Second level of the table engine
+    static constexpr SubEntry GROUP_0_ENTRIES[] = {
+        {0xC0, op_00CN}, {0xC1, op_00CN}, {0xC2, op_00CN}, {0xC3, op_00CN}, {0xC4, op_00CN}, {0xC5, op_00CN},
+        {0xC6, op_00CN}, {0xC7, op_00CN}, {0xC8, op_00CN}, {0xC9, op_00CN}, {0xCA, op_00CN}, {0xCB, op_00CN},
+        {0xCC, op_00CN}, {0xCD, op_00CN}, {0xCE, op_00CN}, {0xCF, op_00CN},
+        {0xD0, op_00DN}, {0xD1, op_00DN}, {0xD2, op_00DN}, {0xD3, op_00DN}, {0xD4, op_00DN}, {0xD5, op_00DN},
+        {0xD6, op_00DN}, {0xD7, op_00DN}, {0xD8, op_00DN}, {0xD9, op_00DN}, {0xDA, op_00DN}, {0xDB, op_00DN},
+        {0xDC, op_00DN}, {0xDD, op_00DN}, {0xDE, op_00DN}, {0xDF, op_00DN},
+        {0xE0, op_00E0}, {0xEE, op_00EE},
+        {0xFB, op_00FB}, {0xFC, op_00FC}, {0xFD, op_00FD}, {0xFE, op_00FE}, {0xFF, op_00FF}
+    };
+    static constexpr SubEntry GROUP_E_ENTRIES[] = {{0x9E, op_EX9E}, {0xA1, op_EXA1}};
+    static constexpr SubEntry GROUP_F_ENTRIES[] = {
+        {0x01, op_FN01}, {0x02, op_F002}, {0x07, op_FX07}, {0x0A, op_FX0A}, {0x15, op_FX15}, {0x18, op_FX18}, {0x1E, op_FX1E},
+        {0x29, op_FX29}, {0x30, op_FX30}, {0x33, op_FX33}, {0x3A, op_FX3A}, {0x55, op_FX55}, {0x65, op_FX65}
+    };
+    static const OpHandler GROUP_8[16];
+    static const SubTable GROUP_0;
+    static const SubTable GROUP_E;
+    static const SubTable GROUP_F;
+    static const OpHandler MAIN[16];
+
+    static void op_group0(ChippyCore& c, const DecodedOp& op){ GROUP_0.handler[op.NN](c, op); }
+    static void op_group8(ChippyCore& c, const DecodedOp& op){ GROUP_8[op.N](c, op); }
+    static void op_groupE(ChippyCore& c, const DecodedOp& op){ GROUP_E.handler[op.NN](c, op); }
+    static void op_groupF(ChippyCore& c, const DecodedOp& op){ GROUP_F.handler[op.NN](c, op); }
+
+    // The leaf handler of an opcode, with the group level of the tables already applied
+    static OpHandler resolve(const DecodedOp& op){
+        switch (op.opcode >> 12) {
+            case 0x0: return GROUP_0.handler[op.NN];
+            case 0x8: return GROUP_8[op.N];
+            case 0xE: return GROUP_E.handler[op.NN];
+            case 0xF: return op.NN == 0x02 && op.X != 0 ? op_unknown : GROUP_F.handler[op.NN];
+            default: return MAIN[op.opcode >> 12];
+        }
+    }
+
+    static uint32_t run_table(ChippyCore& c, uint32_t count);
+    static uint32_t run_goto(ChippyCore& c, uint32_t count);
+    static uint32_t run_cached(ChippyCore& c, uint32_t count);
+
+    // Block engine, see chippycore_blocks.cpp
+    template<OpHandler H>
+    static void single(ChippyCore& c, const BlockOp& block){
+        H(c, block.op);
+    }
+    template<OpHandler FIRST, OpHandler SECOND>
+    static void fused(ChippyCore& c, const BlockOp& block){
+        FIRST(c, block.op);
+        SECOND(c, block.second);
+    }
+    static bool ends_block(OpHandler handler, bool trusted);
+    static BlockHandler block_handler(OpHandler handler);
+    static BlockHandler superinstruction(OpHandler first, const DecodedOp& a, OpHandler second, const DecodedOp& b);
+    static const BlockEntry& translate(ChippyCore& c, uint16_t pc);
+    static uint32_t run_blocks(ChippyCore& c, uint32_t count);
+};
+
+#define CHIPPY_EXTERN_OPS(P) extern template struct ChippyOps<P>;
+CHIPPY_FOR_EACH_QUIRK_PROFILE(CHIPPY_EXTERN_OPS)
+#undef CHIPPY_EXTERN_OPS
+
+#endif
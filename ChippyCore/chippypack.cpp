@@ -0,0 +1,112 @@
+#include "chippypack.h"
+
+static inline uint16_t get16(const uint8_t* p){
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get32(const uint8_t* p){
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint32_t ChippyPack::hash_rom(const uint8_t* data, size_t size){
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool ChippyPack::open(const uint8_t* data, size_t size){
+    _data = nullptr;
+    _count = 0;
+    if (!data || size < PACK_HEADER_SIZE || memcmp(data, PACK_MAGIC, 4) || data[4] != PACK_VERSION) {
+        return false;
+    }
+    uint16_t count = get16(data + 6);
+    uint32_t names = get32(data + 8);
+    uint32_t total = get32(data + 12);
+    if (total > size || names > total || PACK_HEADER_SIZE + static_cast<uint32_t>(count) * PACK_ENTRY_SIZE > names) {
+        return false;
+    }
+    uint32_t previous = 0;
+    for (uint16_t index = 0; index < count; index++) {
+        const uint8_t* e = data + PACK_HEADER_SIZE + index * PACK_ENTRY_SIZE;
+        uint32_t hash = get32(e);
+        uint32_t offset = get32(e + 4);
+        uint16_t romSize = get16(e + 8);
+        uint32_t name = names + get16(e + 12);
+        //Strictly ascending hashes, payloads inside the image and below the names, a terminated name
+        if ((index && hash <= previous) || (offset % PACK_ALIGN) || offset > names || romSize > names - offset ||
+            romSize > RAM_SIZE - ROM_START_ADDRESS || name >= total || !memchr(data + name, 0, total - name)) {
+            return false;
+        }
+        previous = hash;
+    }
+    _data = data;
+    _count = count;
+    _names = names;
+    _size = total;
+    return true;
+}
+
+uint16_t ChippyPack::count() const{
+    return _count;
+}
+
+bool ChippyPack::entry(uint16_t index, PackEntry& out) const{
+    if (index >= _count) {
+        return false;
+    }
+    const uint8_t* e = _data + PACK_HEADER_SIZE + index * PACK_ENTRY_SIZE;
+    out.hash = get32(e);
+    out.data = _data + get32(e + 4);
+    out.size = get16(e + 8);
+    out.instructions_per_frame = get16(e + 10);
+    out.name = reinterpret_cast<const char*>(_data + _names + get16(e + 12));
+    out.quirks = e[14];
+    return true;
+}
+
+bool ChippyPack::find(uint32_t hash, PackEntry& out) const{
+    uint16_t low = 0;
+    uint16_t high = _count;
+    while (low < high) {
+        uint16_t middle = low + (high - low) / 2;
+        uint32_t key = get32(_data + PACK_HEADER_SIZE + middle * PACK_ENTRY_SIZE);
+        if (key == hash) {
+            return entry(middle, out);
+        }
+        if (key < hash) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return false;
+}
+
+bool ChippyPack::find(const uint8_t* rom, size_t size, PackEntry& out) const{
+    return find(hash_rom(rom, size), out) && out.size == size;
+}
+
+bool ChippyCore::load_and_run(const uint8_t* data, size_t dataSize, drawPixelCallback dCallback, screenCallback sCallback,
+                              loopCallback lCallback, const ChippyPack& pack, const bool* fallbackConfig){
+    PackEntry found;
+    bool known = pack.find(data, dataSize, found);
+    bool config[4];
+    if (known) {
+        config[0] = found.quirks & QUIRK_MASK_VF_RESET;
+        config[1] = found.quirks & QUIRK_MASK_SHIFT;
+        config[2] = found.quirks & QUIRK_MASK_WRAP;
+        config[3] = found.quirks & QUIRK_MASK_MEMORY;
+        if (found.instructions_per_frame) {
+            set_speed(found.instructions_per_frame, _maxCatchUpFrames);
+        }
+    }
+    else {
+        memcpy(config, fallbackConfig, sizeof(config));
+    }
+    load_and_run(data, dataSize, dCallback, sCallback, lCallback, config);
+    return known;
+}
@@ -0,0 +1,59 @@
+#ifndef CHIPPYPACK_H
+#define CHIPPYPACK_H
+
+#include "chippycore.h"
+
+///***********************************************************************************************///
+///                                         ROM PACKS                                             ///
+///                                                                                               ///
+/// One read-only image holding many ROMs with their quirks and speed, built by the chippy_pack   ///
+/// host tool. All values are little endian and read byte by byte, so the image works in place    ///
+/// from a flash partition, a const array or an mmap without alignment requirements.              ///
+///                                                                                               ///
+///   header   magic "CH8K", version, 0, ROM count (uint16), names offset (uint32), size (uint32)  ///
+///   index    one PACK_ENTRY_SIZE entry per ROM, sorted by hash: hash (uint32), ROM offset       ///
+///            (uint32), ROM size (uint16), instructions per frame (uint16, 0 keeps the current   ///
+///            speed), name offset into the names (uint16), QUIRK_MASK_* bits, 0                  ///
+///   ROMs     each starting at a PACK_ALIGN boundary                                             ///
+///   names    zero terminated                                                                    ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define PACK_MAGIC "CH8K"
+#define PACK_VERSION 1
+#define PACK_HEADER_SIZE 16
+#define PACK_ENTRY_SIZE 16
+#define PACK_ALIGN 2
+
+struct PackEntry {
+    uint32_t hash;
+    const uint8_t* data;                // Points into the pack
+    uint16_t size;
+    uint16_t instructions_per_frame;    // 0 when the pack leaves the speed alone
+    uint8_t quirks;                     // QUIRK_MASK_* bits
+    const char* name;
+};
+
+class ChippyPack{
+    public:
+        //Checks the header and every index entry once, the lookups after that trust the image.
+        //False for a damaged or foreign image, the pack is then empty. data must stay valid.
+        bool open(const uint8_t* data, size_t size);
+
+        uint16_t count() const;
+        //Entries in hash order. False when index is out of range.
+        bool entry(uint16_t index, PackEntry& out) const;
+        //Binary search of the index
+        bool find(uint32_t hash, PackEntry& out) const;
+        //Same, and the size has to match too
+        bool find(const uint8_t* rom, size_t size, PackEntry& out) const;
+
+        //FNV-1a of the ROM bytes, the key of the index
+        static uint32_t hash_rom(const uint8_t* data, size_t size);
+
+    private:
+        const uint8_t* _data = nullptr;
+        uint16_t _count = 0;
+        uint32_t _names = 0;
+        uint32_t _size = 0;
+};
+
+#endif
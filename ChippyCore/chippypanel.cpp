@@ -0,0 +1,205 @@
+#include "chippypanel.h"
+#include <string.h>
+
+//Each pixel of a nibble twice, for the 2x SSD1306 scaling
+static const uint8_t DOUBLE_NIBBLE[16] = {
+    0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F, 0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF
+};
+
+static const uint16_t DEFAULT_PALETTE[4] = {0x0000, 0xFFFF, 0xAD55, 0x52AA};
+
+// 8x8 bit transpose: byte n of rows is panel row n with the leftmost pixel in bit 7. Writes the 8 column
+// bytes with row n in bit n, the SSD1306 page layout.
+static inline void rows_to_columns(uint64_t rows, uint8_t* columns){
+    uint64_t t = (rows ^ (rows >> 7)) & 0x00AA00AA00AA00AAull;
+    rows ^= t ^ (t << 7);
+    t = (rows ^ (rows >> 14)) & 0x0000CCCC0000CCCCull;
+    rows ^= t ^ (t << 14);
+    t = (rows ^ (rows >> 28)) & 0x00000000F0F0F0F0ull;
+    rows ^= t ^ (t << 28);
+    for (uint8_t column = 0; column < 8; column++) {
+        columns[column] = static_cast<uint8_t>(rows >> ((7 - column) * 8));
+    }
+}
+
+const uint8_t* Ssd1306Converter::buffer() const{
+    return _pages[0];
+}
+
+void Ssd1306Converter::invalidate(){
+    _full = true;
+}
+
+uint8_t Ssd1306Converter::dirty_pages(const DisplayFrame& frame){
+    if (frame.width != _width) {
+        _width = frame.width;
+        _full = true;
+    }
+    if (_full) {
+        return 0xFF;
+    }
+    uint8_t rowsPerPage = frame.width == HIRES_WIDTH ? 8 : 4;
+    uint64_t pageRows = (static_cast<uint64_t>(1) << rowsPerPage) - 1;
+    uint8_t pages = 0;
+    for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+        if (frame.dirty_rows & (pageRows << (page * rowsPerPage))) {
+            pages |= 1 << page;
+        }
+    }
+    return pages;
+}
+
+// Builds the page in a scratch buffer, then narrows it to the columns that differ from the panel
+bool Ssd1306Converter::convert_page(const DisplayFrame& frame, uint8_t page, uint8_t& first, uint8_t& length){
+    uint8_t fresh[SSD1306_WIDTH];
+    if (frame.width == HIRES_WIDTH) {
+        uint64_t rows[8][2];
+        for (uint8_t n = 0; n < 8; n++) {
+            uint16_t word = (page * 8 + n) * 2;
+            rows[n][0] = frame.planes[0][word] | frame.planes[1][word];
+            rows[n][1] = frame.planes[0][word + 1] | frame.planes[1][word + 1];
+        }
+        for (uint8_t group = 0; group < SSD1306_WIDTH / 8; group++) {
+            uint8_t shift = 56 - (group & 7) * 8;
+            uint64_t block = 0;
+            for (uint8_t n = 0; n < 8; n++) {
+                block |= ((rows[n][group >> 3] >> shift) & 0xFF) << (n * 8);
+            }
+            rows_to_columns(block, fresh + group * 8);
+        }
+    }
+    else {
+        uint64_t rows[4];
+        for (uint8_t n = 0; n < 4; n++) {
+            rows[n] = frame.planes[0][page * 4 + n] | frame.planes[1][page * 4 + n];
+        }
+        for (uint8_t group = 0; group < SSD1306_WIDTH / 8; group++) {
+            uint8_t shift = 60 - group * 4;
+            uint64_t block = 0;
+            for (uint8_t n = 0; n < 4; n++) {
+                uint64_t doubled = DOUBLE_NIBBLE[(rows[n] >> shift) & 0xF];
+                block |= (doubled | (doubled << 8)) << (n * 16);
+            }
+            rows_to_columns(block, fresh + group * 8);
+        }
+    }
+
+    uint8_t* shown = _pages[page];
+    uint8_t low = 0;
+    uint8_t high = SSD1306_WIDTH;
+    if (!_full) {
+        while (low < high && fresh[low] == shown[low]) {
+            low++;
+        }
+        while (high > low && fresh[high - 1] == shown[high - 1]) {
+            high--;
+        }
+        if (low == high) {
+            return false;
+        }
+    }
+    memcpy(shown + low, fresh + low, high - low);
+    first = low;
+    length = high - low;
+    return true;
+}
+
+Rgb565Converter::Rgb565Converter(uint16_t panelWidth, uint16_t panelHeight, bool swapBytes)
+    : _panelWidth(panelWidth < RGB565_MAX_WIDTH ? panelWidth : RGB565_MAX_WIDTH), _panelHeight(panelHeight), _swapBytes(swapBytes){
+    set_palette(DEFAULT_PALETTE);
+}
+
+void Rgb565Converter::set_palette(const uint16_t colors[4]){
+    for (uint8_t i = 0; i < 4; i++) {
+        _palette[i] = _swapBytes ? static_cast<uint16_t>((colors[i] << 8) | (colors[i] >> 8)) : colors[i];
+    }
+    for (uint16_t index = 0; index < 256; index++) {
+        for (uint8_t pixel = 0; pixel < 4; pixel++) {
+            uint8_t shift = 3 - pixel;
+            _lut[index][pixel] = _palette[((index >> shift) & 1) | (((index >> (shift + 4)) & 1) << 1)];
+        }
+    }
+    _width = 0;     // the border color may have changed too
+}
+
+uint8_t Rgb565Converter::scale() const{
+    return _scale;
+}
+
+void Rgb565Converter::invalidate(){
+    _full = true;
+}
+
+void Rgb565Converter::configure(const DisplayFrame& frame){
+    _width = frame.width;
+    _height = frame.height;
+    uint16_t scaleX = _panelWidth / _width;
+    uint16_t scaleY = _panelHeight / _height;
+    _scale = scaleX < scaleY ? scaleX : scaleY;
+    if (!_scale) {
+        _scale = 1;     // Too small a panel, the frame is cropped
+    }
+    _x0 = _panelWidth > _width * _scale ? (_panelWidth - _width * _scale) / 2 : 0;
+    _y0 = _panelHeight > _height * _scale ? (_panelHeight - _height * _scale) / 2 : 0;
+    _full = true;
+}
+
+// Renders the changed part of row y, rounded out to whole 4 pixel groups, into _line at the panel scale
+bool Rgb565Converter::render_row(const DisplayFrame& frame, uint8_t y, uint16_t& x, uint16_t& width){
+    uint8_t words = frame.row_words;
+    uint64_t changed[HIRES_WIDTH / 64] = {};
+    for (uint8_t plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (uint8_t word = 0; word < words; word++) {
+            uint64_t bits = frame.planes[plane][y * words + word];
+            changed[word] |= bits ^ _shown[plane][y * words + word];
+            _shown[plane][y * words + word] = bits;
+        }
+    }
+    uint16_t first = 0;
+    uint16_t last = _width;
+    if (!_full) {
+        uint8_t low = 0;
+        while (low < words && !changed[low]) {
+            low++;
+        }
+        if (low == words) {
+            return false;
+        }
+        uint8_t high = words - 1;
+        while (!changed[high]) {
+            high--;
+        }
+        first = (low * 64 + __builtin_clzll(changed[low])) & ~3;
+        last = (high * 64 + 64 - __builtin_ctzll(changed[high]) + 3) & ~3;
+    }
+    //Clip to the panel when the frame does not fit
+    uint16_t visible = (_panelWidth - _x0) / _scale;
+    if (last > visible) {
+        last = visible & ~3;
+    }
+    if (first >= last || _y0 + y * _scale >= _panelHeight) {
+        return false;
+    }
+
+    uint16_t* out = _line;
+    for (uint16_t group = first / 4; group < last / 4; group++) {
+        uint16_t word = y * words + (group >> 4);
+        uint8_t shift = 60 - (group & 15) * 4;
+        uint8_t index = ((frame.planes[0][word] >> shift) & 0xF) | (((frame.planes[1][word] >> shift) & 0xF) << 4);
+        const uint16_t* colors = _lut[index];
+        if (_scale == 1) {
+            memcpy(out, colors, sizeof(_lut[0]));
+            out += 4;
+        }
+        else {
+            for (uint8_t pixel = 0; pixel < 4; pixel++) {
+                for (uint8_t repeat = 0; repeat < _scale; repeat++) {
+                    *out++ = colors[pixel];
+                }
+            }
+        }
+    }
+    x = first;
+    width = last - first;
+    return true;
+}
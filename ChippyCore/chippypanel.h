@@ -0,0 +1,119 @@
+#ifndef CHIPPYPANEL_H
+#define CHIPPYPANEL_H
+
+#include "chippydisplay.h"
+
+///***********************************************************************************************///
+///                                     PANEL CONVERTERS                                          ///
+///                                                                                               ///
+/// Turn a DisplayFrame into the native layout of a panel and hand out only what changed, so the  ///
+/// I2C/SPI transfer is as small as the frame allows. Each converter keeps a copy of what the     ///
+/// panel shows: rows marked dirty that end up unchanged (a sprite drawn twice) send nothing.     ///
+/// Both planes are shown: the SSD1306 lights a pixel set on any plane, RGB565 panels use a four  ///
+/// color palette indexed by plane 0 | plane 1 << 1. A change of resolution resends everything.   ///
+/// The write callbacks are templates, so a lambda that starts the transfer is inlined.           ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define SSD1306_WIDTH 128
+#define SSD1306_PAGES 8             // 8 rows per page, bit 0 is the top row
+#define RGB565_MAX_WIDTH 480        // Longest panel line the converter renders
+
+//128x64 monochrome OLED in page addressing mode. The 64x32 mode is scaled 2x to fill the panel.
+class Ssd1306Converter{
+    public:
+        //Converts the pages holding dirty rows and calls write(page, column, bytes, length) for the changed
+        //columns of each page: set the page and column address, then send length bytes.
+        //Returns the bytes handed to write.
+        template<typename Write>
+        size_t update(const DisplayFrame& frame, Write write){
+            uint8_t pages = dirty_pages(frame);
+            size_t sent = 0;
+            for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+                uint8_t first;
+                uint8_t length;
+                if ((pages & (1 << page)) && convert_page(frame, page, first, length)) {
+                    write(page, first, _pages[page] + first, length);
+                    sent += length;
+                }
+            }
+            _full = false;
+            return sent;
+        }
+
+        //The panel image, SSD1306_PAGES pages of SSD1306_WIDTH column bytes like the controller's RAM
+        const uint8_t* buffer() const;
+        //The next update() sends every page, e.g. after the panel was reset
+        void invalidate();
+
+    private:
+        uint8_t _pages[SSD1306_PAGES][SSD1306_WIDTH] = {};
+        uint8_t _width = 0;     // Frame width of the panel image
+        bool _full = true;
+
+        uint8_t dirty_pages(const DisplayFrame& frame);
+        bool convert_page(const DisplayFrame& frame, uint8_t page, uint8_t& first, uint8_t& length);
+};
+
+//ST7735, ILI9341 and other RGB565 panels. The frame is scaled by the largest integer factor that fits
+//and centered, the border keeps palette color 0.
+class Rgb565Converter{
+    public:
+        //swapBytes stores the colors high byte first, the order the panels expect over SPI
+        Rgb565Converter(uint16_t panelWidth, uint16_t panelHeight, bool swapBytes = true);
+
+        //Colors for plane 0 | plane 1 << 1, plain RGB565. Resends everything at the next update().
+        void set_palette(const uint16_t colors[4]);
+
+        //Calls write(x, y, width, height, line) for every changed span: set the address window to the
+        //rectangle and send the width pixels of line height times. Returns the bytes sent to the panel.
+        template<typename Write>
+        size_t update(const DisplayFrame& frame, Write write){
+            size_t sent = 0;
+            if (frame.width != _width || frame.height != _height) {
+                configure(frame);
+                sent += clear_panel(write);
+            }
+            for (uint8_t y = 0; y < _height; y++) {
+                uint16_t x;
+                uint16_t width;
+                if ((_full || (frame.dirty_rows >> y) & 1) && render_row(frame, y, x, width)) {
+                    write(_x0 + x * _scale, _y0 + y * _scale, width * _scale, _scale, _line);
+                    sent += static_cast<size_t>(width) * _scale * _scale * sizeof(uint16_t);
+                }
+            }
+            _full = false;
+            return sent;
+        }
+
+        //Pixels per frame pixel, 0 before the first update()
+        uint8_t scale() const;
+        void invalidate();
+
+    private:
+        uint64_t _shown[DISPLAY_PLANES][FRAMEBUFFER_WORDS] = {};    // Planes as on the panel
+        uint16_t _lut[256][4];      // Colors of 4 pixels, plane 0 nibble | plane 1 nibble << 4
+        uint16_t _line[RGB565_MAX_WIDTH];
+        uint16_t _palette[4];
+        uint16_t _panelWidth;
+        uint16_t _panelHeight;
+        uint16_t _x0 = 0;
+        uint16_t _y0 = 0;
+        uint8_t _scale = 0;
+        uint8_t _width = 0;
+        uint8_t _height = 0;
+        bool _swapBytes;
+        bool _full = true;
+
+        void configure(const DisplayFrame& frame);
+        bool render_row(const DisplayFrame& frame, uint8_t y, uint16_t& x, uint16_t& width);
+
+        template<typename Write>
+        size_t clear_panel(Write write){
+            for (uint16_t i = 0; i < _panelWidth; i++) {
+                _line[i] = _lut[0][0];
+            }
+            write(0, 0, _panelWidth, _panelHeight, _line);
+            return static_cast<size_t>(_panelWidth) * _panelHeight * sizeof(uint16_t);
+        }
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "chippyprofile.h"
+
+static const char* const OP_CLASS_NAMES[PROFILE_OP_CLASSES] = {
+    "00E0", "00EE", "00XX", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+    "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE", "9XY0",
+    "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1", "FX07", "FX0A", "FX15", "FX18",
+    "FX1E", "FX29", "FX33", "FX55", "FX65", "FXXX", "unknown"
+};
+
+#define OP_CLASS_00E0 0
+#define OP_CLASS_00EE 1
+#define OP_CLASS_00XX 2     // SCHIP/XO-CHIP scrolls, resolution and exit
+#define OP_CLASS_8XY0 10
+#define OP_CLASS_8XYE 18
+#define OP_CLASS_EX9E 24
+#define OP_CLASS_EXA1 25
+#define OP_CLASS_FXXX 35    // FN01, F002, FX30, FX3A
+#define OP_CLASS_UNKNOWN 36
+
+//Classes of the opcodes identified by the high nibble alone
+static const uint8_t MAIN_CLASSES[16] = {
+    OP_CLASS_UNKNOWN, 3, 4, 5, 6, 7, 8, 9, OP_CLASS_UNKNOWN, 19, 20, 21, 22, 23, OP_CLASS_UNKNOWN, OP_CLASS_UNKNOWN
+};
+
+uint8_t ChippyProfile::op_class(uint16_t opcode){
+    uint8_t low = opcode & 0xFF;
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00E0) {
+                return OP_CLASS_00E0;
+            }
+            return opcode == 0x00EE ? OP_CLASS_00EE : OP_CLASS_00XX;
+        case 0x8:
+            if ((opcode & 0xF) < 8) {
+                return OP_CLASS_8XY0 + (opcode & 0xF);
+            }
+            return (opcode & 0xF) == 0xE ? OP_CLASS_8XYE : OP_CLASS_UNKNOWN;
+        case 0xE:
+            if (low == 0x9E) {
+                return OP_CLASS_EX9E;
+            }
+            return low == 0xA1 ? OP_CLASS_EXA1 : OP_CLASS_UNKNOWN;
+        case 0xF:
+            switch (low) {
+                case 0x07: return 26;
+                case 0x0A: return 27;
+                case 0x15: return 28;
+                case 0x18: return 29;
+                case 0x1E: return 30;
+                case 0x29: return 31;
+                case 0x33: return 32;
+                case 0x55: return 33;
+                case 0x65: return 34;
+                case 0x02: return opcode == 0xF002 ? OP_CLASS_FXXX : OP_CLASS_UNKNOWN;
+                case 0x01:
+                case 0x30:
+                case 0x3A: return OP_CLASS_FXXX;
+                default: return OP_CLASS_UNKNOWN;
+            }
+        default:
+            return MAIN_CLASSES[opcode >> 12];
+    }
+}
+
+const char* ChippyProfile::op_class_name(uint8_t opClass){
+    return opClass < PROFILE_OP_CLASSES ? OP_CLASS_NAMES[opClass] : "";
+}
+
+uint8_t ChippyProfile::frame_bucket(uint32_t micros){
+    if (micros < 4) {
+        return micros;
+    }
+    uint8_t exponent = 31 - __builtin_clz(micros);
+    uint32_t bucket = (exponent - 1) * 4 + ((micros >> (exponent - 2)) & 3);
+    return bucket < PROFILE_FRAME_BUCKETS ? bucket : PROFILE_FRAME_BUCKETS - 1;
+}
+
+uint32_t ChippyProfile::bucket_limit(uint8_t bucket){
+    if (bucket < 4) {
+        return bucket;
+    }
+    uint8_t exponent = bucket / 4 + 1;
+    return ((5 + (bucket & 3)) << (exponent - 2)) - 1;
+}
+
+void ChippyProfile::reset(){
+    memset(this, 0, sizeof(*this));
+}
+
+void ChippyProfile::end_frame(){
+    frame_buckets[frame_bucket(frame_micros)]++;
+    if (frame_micros > max_frame_micros) {
+        max_frame_micros = frame_micros;
+    }
+    frames++;
+    frame_micros = 0;
+}
+
+uint32_t ChippyProfile::frame_percentile(uint8_t percent) const{
+    uint64_t wanted = (static_cast<uint64_t>(frames) * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint8_t bucket = 0; bucket < PROFILE_FRAME_BUCKETS; bucket++) {
+        seen += frame_buckets[bucket];
+        if (seen && seen >= wanted) {
+            uint32_t limit = bucket_limit(bucket);
+            return limit < max_frame_micros ? limit : max_frame_micros;
+        }
+    }
+    return max_frame_micros;
+}
+
+static inline uint8_t* put16(uint8_t* p, uint16_t value){
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static inline uint8_t* put32(uint8_t* p, uint32_t value){
+    return put16(put16(p, value & 0xFFFF), value >> 16);
+}
+
+size_t ChippyProfile::record_size() const{
+    size_t hot = 0;
+    for (uint16_t slot = 0; slot < RAM_SIZE / 2; slot++) {
+        hot += pc_hits[slot] != 0;
+    }
+    return PROFILE_HEADER_SIZE + 4 * (PROFILE_OP_CLASSES + 3 * PROFILE_CALLBACKS + PROFILE_FRAME_BUCKETS) + 2 + hot * 6;
+}
+
+size_t ChippyProfile::write_record(uint8_t* out, size_t size) const{
+    size_t needed = record_size();
+    if (size < needed) {
+        return 0;
+    }
+    uint8_t* p = out;
+    memcpy(p, PROFILE_MAGIC, 4);
+    p[4] = PROFILE_VERSION;
+    p[5] = PROFILE_OP_CLASSES;
+    p[6] = PROFILE_CALLBACKS;
+    p[7] = PROFILE_FRAME_BUCKETS;
+    p = put32(p + 8, frames);
+    p = put32(p, max_frame_micros);
+    for (uint8_t opClass = 0; opClass < PROFILE_OP_CLASSES; opClass++) {
+        p = put32(p, op_counts[opClass]);
+    }
+    for (uint8_t callback = 0; callback < PROFILE_CALLBACKS; callback++) {
+        p = put32(p, callbacks[callback].calls);
+        p = put32(p, callbacks[callback].micros);
+        p = put32(p, callbacks[callback].max_micros);
+    }
+    for (uint8_t bucket = 0; bucket < PROFILE_FRAME_BUCKETS; bucket++) {
+        p = put32(p, frame_buckets[bucket]);
+    }
+    uint8_t* hotCount = p;
+    p += 2;
+    uint16_t hot = 0;
+    for (uint16_t slot = 0; slot < RAM_SIZE / 2; slot++) {
+        if (pc_hits[slot]) {
+            p = put16(p, slot << 1);
+            p = put32(p, pc_hits[slot]);
+            hot++;
+        }
+    }
+    put16(hotCount, hot);
+    return needed;
+}
@@ -0,0 +1,101 @@
+#ifndef CHIPPYPROFILE_H
+#define CHIPPYPROFILE_H
+
+#include "platform.h"
+#include "defines.h"
+
+///***********************************************************************************************///
+///                                        PROFILING                                              ///
+///                                                                                               ///
+/// Built only with CHIPPY_PROFILE defined (defines.h or -DCHIPPY_PROFILE), without it the hooks  ///
+/// below compile to nothing. With it, nothing is counted until start_profile() allocates a      ///
+/// ChippyProfile: every engine then counts each executed opcode by class and by PC, the         ///
+/// callbacks are timed, and the busy time of every 60 Hz frame (opcodes, timers and callbacks)   ///
+/// goes into a log scale histogram. write_record() packs it all into a compact little endian     ///
+/// record to send over Serial; the chippy_profile host tool prints records as CSV.               ///
+///                                                                                               ///
+///   record   magic "CH8P", version, PROFILE_OP_CLASSES, PROFILE_CALLBACKS, PROFILE_FRAME_BUCKETS, ///
+///            frames (uint32), slowest frame in us (uint32), op class counts (uint32 each),       ///
+///            per callback calls, total us and slowest us (uint32 each), frame buckets (uint32   ///
+///            each), hot PC count (uint16), then per hot PC its address (uint16) and hits        ///
+///            (uint32) in address order                                                          ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define PROFILE_MAGIC "CH8P"
+#define PROFILE_VERSION 1
+#define PROFILE_OP_CLASSES 37
+#define PROFILE_FRAME_BUCKETS 80    // 4 per power of two, up to about 1 s
+#define PROFILE_HEADER_SIZE 16
+
+enum ProfileCallback : uint8_t {
+    PROFILE_DRAW_PIXEL,
+    PROFILE_SCREEN,
+    PROFILE_LOOP,
+    PROFILE_PRESENT,
+    PROFILE_CALLBACKS
+};
+
+struct ProfileCallbackTime {
+    uint32_t calls;
+    uint32_t micros;
+    uint32_t max_micros;
+};
+
+class ChippyProfile{
+    public:
+        uint32_t op_counts[PROFILE_OP_CLASSES];
+        uint32_t pc_hits[RAM_SIZE / 2];     // Index PC >> 1, an odd PC counts with the even one below
+        ProfileCallbackTime callbacks[PROFILE_CALLBACKS];
+        uint32_t frame_buckets[PROFILE_FRAME_BUCKETS];
+        uint32_t frames;
+        uint32_t max_frame_micros;
+        uint32_t frame_micros;              // Busy time of the frame in progress
+
+        void reset();
+
+        inline void count_op(uint16_t pc, uint16_t opcode){
+            op_counts[op_class(opcode)]++;
+            pc_hits[(pc & (RAM_SIZE - 1)) >> 1]++;
+        }
+        inline void count_callback(ProfileCallback callback, uint32_t micros){
+            ProfileCallbackTime& time = callbacks[callback];
+            time.calls++;
+            time.micros += micros;
+            if (micros > time.max_micros) {
+                time.max_micros = micros;
+            }
+        }
+        //Closes the frame in progress, called from the timer tick
+        void end_frame();
+
+        //Upper bound in us of the frame time below which percent of the frames stay
+        uint32_t frame_percentile(uint8_t percent) const;
+
+        //Bytes write_record() needs right now, it grows with the number of hot PCs
+        size_t record_size() const;
+        //Returns the bytes written, 0 when size is too small
+        size_t write_record(uint8_t* out, size_t size) const;
+
+        static uint8_t op_class(uint16_t opcode);
+        static const char* op_class_name(uint8_t opClass);
+        static uint8_t frame_bucket(uint32_t micros);
+        //Largest frame time in us that falls into the bucket
+        static uint32_t bucket_limit(uint8_t bucket);
+};
+
+#ifdef CHIPPY_PROFILE
+    #define CHIPPY_PROFILE_OP(c, pc, opcode) \
+        do { if ((c)._profile) { (c)._profile->count_op((pc), (opcode)); } } while (0)
+    //A translated block runs count straight-line opcodes starting at pc
+    #define CHIPPY_PROFILE_BLOCK(c, pc, count) \
+        do { if ((c)._profile) { for (uint16_t _i = 0; _i < (count); _i++) { \
+            (c)._profile->count_op((pc) + _i * 2, (c).read_opcode((pc) + _i * 2)); } } } while (0)
+    #define CHIPPY_PROFILE_CALL(c, callback, call) \
+        do { if ((c)._profile) { uint32_t _start = platform_micros(); call; \
+            (c)._profile->count_callback((callback), platform_micros() - _start); } else { call; } } while (0)
+#else
+    #define CHIPPY_PROFILE_OP(c, pc, opcode) do { } while (0)
+    #define CHIPPY_PROFILE_BLOCK(c, pc, count) do { } while (0)
+    #define CHIPPY_PROFILE_CALL(c, callback, call) call
+#endif
+
+#endif
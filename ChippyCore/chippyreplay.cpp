@@ -0,0 +1,183 @@
+#include "chippyreplay.h"
+
+#include <new>
+
+static inline uint8_t* put32(uint8_t* p, uint32_t value){
+    for (uint8_t byte = 0; byte < 4; byte++) {
+        *p++ = static_cast<uint8_t>(value >> (byte * 8));
+    }
+    return p;
+}
+
+static inline uint32_t get32(const uint8_t* p){
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+ChippyRecorder::ChippyRecorder(uint32_t maxEvents){
+    allocate(maxEvents);
+}
+
+ChippyRecorder::ChippyRecorder(ChippyCore& owner, uint32_t maxEvents) : _owner(&owner){
+    allocate(maxEvents);
+}
+
+ChippyRecorder::~ChippyRecorder(){
+    stop();
+    if (_owner) {
+        _owner->release_history(_memory, _bytes);
+    }
+    else {
+        delete[] _memory;
+    }
+}
+
+void ChippyRecorder::allocate(uint32_t maxEvents){
+    _bytes = sizeof(ReplayEvent) * maxEvents + SNAPSHOT_SIZE;
+    _memory = static_cast<uint8_t*>(_owner ? _owner->allocate_history(_bytes) : new (std::nothrow) uint8_t[_bytes]);
+    _events = reinterpret_cast<ReplayEvent*>(_memory);
+    _snapshot = _memory + sizeof(ReplayEvent) * maxEvents;
+    _capacity = _memory ? maxEvents : 0;
+}
+
+bool ChippyRecorder::start(ChippyCore& core){
+    stop();
+    if (!_capacity) {
+        return false;
+    }
+    _count = 0;
+    _frames = 0;
+    _started = false;
+    _full = false;
+    _core = &core;
+    core.set_recorder(this);
+    return true;
+}
+
+void ChippyRecorder::stop(){
+    if (_core) {
+        _core->set_recorder(nullptr);
+        _core = nullptr;
+    }
+}
+
+bool ChippyRecorder::push(uint8_t kind, uint32_t ops, uint32_t value){
+    if (_count == _capacity) {
+        _full = true;
+        stop();
+        return false;
+    }
+    _events[_count++] = {kind, _frames, ops, value};
+    return true;
+}
+
+void ChippyRecorder::end_frame(uint32_t ops){
+    if (!_started) {
+        //The frame that just ended is not part of the recording, the state after its tick is
+        _core->save_state(_snapshot, SNAPSHOT_SIZE);
+        _keys = _core->get_keypad_mask();
+        _length = UINT32_MAX;
+        _started = true;
+        return;
+    }
+    if (ops != _length) {
+        if (!push(REPLAY_LENGTH, 0, ops)) {
+            return;
+        }
+        _length = ops;
+    }
+    _frames++;
+    //Keys the tick drained from the event queue take effect at the start of the next frame
+    keypad_changed(0);
+}
+
+void ChippyRecorder::keypad_changed(uint32_t ops){
+    uint16_t keys = _core->get_keypad_mask();
+    if (_started && keys != _keys && push(REPLAY_KEYS, ops, keys)) {
+        _keys = keys;
+    }
+}
+
+// The events of a frame are in recording order: its key changes by opcode count, then its length
+uint32_t ChippyRecorder::replay(ChippyCore& core, uint32_t frames) const{
+    if (!_started || !core.load_state(_snapshot, SNAPSHOT_SIZE)) {
+        return 0;
+    }
+    if (frames > _frames) {
+        frames = _frames;
+    }
+    uint32_t length = 0;
+    uint32_t next = 0;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        uint32_t done = 0;
+        for (; next < _count && _events[next].frame == frame; next++) {
+            const ReplayEvent& event = _events[next];
+            if (event.kind == REPLAY_LENGTH) {
+                length = event.value;
+                continue;
+            }
+            if (event.ops > done) {
+                done += core.run_instructions(event.ops - done);
+            }
+            core.set_keypad_mask(event.value);
+        }
+        if (length > done) {
+            core.run_instructions(length - done);
+        }
+        if (!core.isRunning()) {
+            return frame;
+        }
+        core.run_frame(0);  // The tick only
+    }
+    return frames;
+}
+
+size_t ChippyRecorder::record_size() const{
+    return REPLAY_HEADER_SIZE + SNAPSHOT_SIZE + static_cast<size_t>(_count) * REPLAY_EVENT_SIZE;
+}
+
+size_t ChippyRecorder::write_record(uint8_t* out, size_t size) const{
+    size_t needed = record_size();
+    if (size < needed || !_started) {
+        return 0;
+    }
+    memcpy(out, REPLAY_MAGIC, 4);
+    out[4] = REPLAY_VERSION;
+    out[5] = out[6] = out[7] = 0;
+    uint8_t* p = put32(out + 8, _frames);
+    p = put32(p, _count);
+    memcpy(p, _snapshot, SNAPSHOT_SIZE);
+    p += SNAPSHOT_SIZE;
+    for (uint32_t i = 0; i < _count; i++) {
+        const ReplayEvent& event = _events[i];
+        *p++ = event.kind;
+        p = put32(p, event.frame);
+        p = put32(p, event.ops);
+        p = put32(p, event.value);
+    }
+    return needed;
+}
+
+bool ChippyRecorder::read_record(const uint8_t* data, size_t size){
+    if (size < REPLAY_HEADER_SIZE + SNAPSHOT_SIZE || memcmp(data, REPLAY_MAGIC, 4) || data[4] != REPLAY_VERSION) {
+        return false;
+    }
+    uint32_t count = get32(data + 12);
+    if (count > _capacity || size < REPLAY_HEADER_SIZE + SNAPSHOT_SIZE + static_cast<size_t>(count) * REPLAY_EVENT_SIZE) {
+        return false;
+    }
+    stop();
+    _frames = get32(data + 8);
+    _count = count;
+    memcpy(_snapshot, data + REPLAY_HEADER_SIZE, SNAPSHOT_SIZE);
+    const uint8_t* p = data + REPLAY_HEADER_SIZE + SNAPSHOT_SIZE;
+    for (uint32_t i = 0; i < count; i++, p += REPLAY_EVENT_SIZE) {
+        _events[i] = {p[0], get32(p + 1), get32(p + 5), get32(p + 9)};
+    }
+    _started = true;
+    _full = false;
+    return true;
+}
+
+ReplayStats ChippyRecorder::get_stats() const{
+    return {_frames, _count, _capacity, _full};
+}
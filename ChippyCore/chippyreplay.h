@@ -0,0 +1,98 @@
+#ifndef CHIPPYREPLAY_H
+#define CHIPPYREPLAY_H
+
+#include "chippycore.h"
+
+///***********************************************************************************************///
+///                                     RECORD AND REPLAY                                         ///
+///                                                                                               ///
+/// Records a session so it can be run again bit for bit, headless and faster than real time.    ///
+/// Recording starts at the next 60 Hz tick with a snapshot, which also holds the CXNN generator  ///
+/// state. From there only what the ROM cannot compute itself is logged: every keypad change with ///
+/// the number of opcodes the frame had run before it, and the opcodes of a frame whenever that   ///
+/// differs from the frame before (speed changes, turbo). A session with the built-in random      ///
+/// generator and the same display wait setting replays exactly, on any engine.                   ///
+///                                                                                               ///
+///   record   magic "CH8R", version, reserved (3 bytes), frames (uint32), events (uint32),       ///
+///            snapshot (SNAPSHOT_SIZE), then per event its kind, frame, opcodes and value        ///
+///            (uint8 and 3 x uint32), little endian                                              ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define REPLAY_MAGIC "CH8R"
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 16
+#define REPLAY_EVENT_SIZE 13
+#define REPLAY_MAX_EVENTS 1024          // About 16 KB of events
+
+enum ReplayEventKind : uint8_t {
+    REPLAY_KEYS,        // value is the new keypad mask, ops the opcodes of the frame run before it
+    REPLAY_LENGTH       // value is the opcodes of this frame and the next ones, logged at the frame's end
+};
+
+struct ReplayEvent {
+    uint8_t kind;
+    uint32_t frame;     // 0 is the first frame after the starting snapshot
+    uint32_t ops;
+    uint32_t value;
+};
+
+struct ReplayStats {
+    uint32_t frames;            // Whole frames recorded
+    uint32_t events;
+    uint32_t capacity;          // 0 when the buffers could not be allocated
+    bool full;                  // Recording stopped early, the events did not fit
+};
+
+class ChippyRecorder{
+    public:
+        //Needs SNAPSHOT_SIZE bytes plus 16 bytes per event, from new
+        explicit ChippyRecorder(uint32_t maxEvents = REPLAY_MAX_EVENTS);
+        //The same from owner's set_allocator() heap (ALLOC_HISTORY), counted in its get_footprint(). owner
+        //must outlive the recorder, any core can still be recorded and replayed.
+        explicit ChippyRecorder(ChippyCore& owner, uint32_t maxEvents = REPLAY_MAX_EVENTS);
+        ~ChippyRecorder();
+        //Owns the snapshot and event buffers, and a core points at one recorder through set_recorder()
+        ChippyRecorder(const ChippyRecorder&) = delete;
+        ChippyRecorder& operator=(const ChippyRecorder&) = delete;
+
+        //Drops what was recorded and records core from its next tick on. False without buffers.
+        bool start(ChippyCore& core);
+        void stop();
+
+        //Runs the recorded frames (at most frames of them) on core, headless. Any ROM may be loaded in
+        //core, the snapshot brings the memory. Returns the frames replayed, 0 when the record is empty.
+        uint32_t replay(ChippyCore& core, uint32_t frames = UINT32_MAX) const;
+
+        //Bytes write_record() needs right now
+        size_t record_size() const;
+        //Returns the bytes written, 0 when size is too small
+        size_t write_record(uint8_t* out, size_t size) const;
+        //Replaces the recording, false for a damaged record or one with more events than fit
+        bool read_record(const uint8_t* data, size_t size);
+
+        ReplayStats get_stats() const;
+
+        //Called by the core while recording: after every tick with the opcodes the frame ran, and after
+        //every keypad change outside the tick with the opcodes the current frame ran so far
+        void end_frame(uint32_t ops);
+        void keypad_changed(uint32_t ops);
+
+    private:
+        ChippyCore* _core = nullptr;
+        ChippyCore* _owner = nullptr;   // Allocated the buffers, nullptr for new
+        uint8_t* _memory;               // Events, then the snapshot
+        size_t _bytes;
+        uint8_t* _snapshot;
+        ReplayEvent* _events;
+        uint32_t _capacity;
+        uint32_t _count = 0;
+        uint32_t _frames = 0;
+        uint32_t _length = 0;       // Opcodes of the frame before, as logged
+        uint16_t _keys = 0;         // Keypad as logged
+        bool _started = false;      // The starting snapshot was taken
+        bool _full = false;
+
+        void allocate(uint32_t maxEvents);
+        bool push(uint8_t kind, uint32_t ops, uint32_t value);
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "chippyrewind.h"
+
+// Encoded capture: a list of (zero run, literal run, literal bytes) with the run lengths as 7 bit varints.
+// The bytes are the snapshot XOR the base, a keyframe has no base. A literal run ends at two zero bytes
+// in a row, a single zero inside it costs less than starting a new pair of runs.
+
+static inline size_t put_varint(uint8_t* out, size_t value){
+    size_t length = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (out) {
+            out[length] = byte | (value ? 0x80 : 0);
+        }
+        length++;
+    } while (value);
+    return length;
+}
+
+static inline size_t get_varint(const uint8_t* in, size_t& position){
+    size_t value = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+    do {
+        byte = in[position++];
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+// Returns the encoded size, out == nullptr only measures
+static size_t rle_encode(const uint8_t* state, const uint8_t* base, uint8_t* out){
+    size_t length = 0;
+    size_t i = 0;
+    while (i < SNAPSHOT_SIZE) {
+        size_t zeros = 0;
+        while (i < SNAPSHOT_SIZE && state[i] == (base ? base[i] : 0)) {
+            zeros++;
+            i++;
+        }
+        size_t start = i;
+        while (i < SNAPSHOT_SIZE) {
+            bool zero = state[i] == (base ? base[i] : 0);
+            bool nextZero = i + 1 >= SNAPSHOT_SIZE || state[i + 1] == (base ? base[i + 1] : 0);
+            if (zero && nextZero) {
+                break;
+            }
+            i++;
+        }
+        length += put_varint(out ? out + length : nullptr, zeros);
+        length += put_varint(out ? out + length : nullptr, i - start);
+        if (out) {
+            for (size_t k = start; k < i; k++) {
+                out[length + k - start] = state[k] ^ (base ? base[k] : 0);
+            }
+        }
+        length += i - start;
+    }
+    return length;
+}
+
+// XORs an encoded capture into a SNAPSHOT_SIZE buffer
+static void rle_apply(const uint8_t* in, size_t length, uint8_t* state){
+    size_t position = 0;
+    size_t i = 0;
+    while (position < length) {
+        i += get_varint(in, position);
+        size_t literals = get_varint(in, position);
+        for (size_t k = 0; k < literals && i < SNAPSHOT_SIZE; k++) {
+            state[i++] ^= in[position++];
+        }
+    }
+}
+
+ChippyRewind::ChippyRewind(ChippyCore& core, size_t bufferSize, uint16_t maxFrames, uint16_t keyframeInterval)
+    : _core(core), _capacity(static_cast<uint32_t>(bufferSize)), _maxFrames(maxFrames),
+      _keyframeInterval(keyframeInterval ? keyframeInterval : 1){
+    _bytes = sizeof(Entry) * maxFrames + 2 * SNAPSHOT_SIZE + bufferSize;
+    _memory = static_cast<uint8_t*>(core.allocate_history(_bytes));
+    _entries = reinterpret_cast<Entry*>(_memory);
+    _keyframe = _memory + sizeof(Entry) * maxFrames;
+    _scratch = _keyframe + SNAPSHOT_SIZE;
+    _data = _scratch + SNAPSHOT_SIZE;
+    if (!_memory || !maxFrames) {
+        _capacity = 0;
+    }
+}
+
+ChippyRewind::~ChippyRewind(){
+    _core.release_history(_memory, _bytes);
+}
+
+ChippyRewind::Entry& ChippyRewind::entry(uint16_t index){
+    return _entries[(_first + index) % _maxFrames];
+}
+
+void ChippyRewind::clear(){
+    _first = 0;
+    _count = 0;
+    _keyframes = 0;
+    _sinceKeyframe = 0;
+    _head = 0;
+    _used = 0;
+    _lastBytes = 0;
+}
+
+// Finds length contiguous free bytes after the newest entry, wrapping to the start of the ring
+bool ChippyRewind::reserve(size_t length, uint32_t& offset){
+    if (!_count) {
+        _head = 0;
+        offset = 0;
+        return length <= _capacity;
+    }
+    if (_count >= _maxFrames) {
+        return false;
+    }
+    uint32_t tail = entry(0).offset;
+    if (_head > tail) {
+        if (_head + length <= _capacity) {
+            offset = _head;
+            return true;
+        }
+        offset = 0;
+        return length <= tail;
+    }
+    offset = _head;
+    return _head < tail && _head + length <= tail;
+}
+
+// The oldest keyframe and its deltas, so the oldest entry is always a keyframe
+void ChippyRewind::drop_oldest_segment(){
+    do {
+        Entry& oldest = entry(0);
+        _used -= oldest.length;
+        _keyframes -= oldest.keyframe;
+        _first = (_first + 1) % _maxFrames;
+        _count--;
+    } while (_count && !entry(0).keyframe);
+}
+
+void ChippyRewind::drop_newest(){
+    Entry& newest = entry(_count - 1);
+    _used -= newest.length;
+    _keyframes -= newest.keyframe;
+    _count--;
+}
+
+bool ChippyRewind::capture(){
+    if (!_capacity) {
+        return false;
+    }
+    _core.save_state(_scratch, SNAPSHOT_SIZE);
+
+    uint32_t offset = 0;
+    bool keyframe = !_count || _sinceKeyframe >= _keyframeInterval;
+    size_t length = 0;
+    if (!keyframe) {
+        length = rle_encode(_scratch, _keyframe, nullptr);
+        while (!reserve(length, offset) && _keyframes > 1) {
+            drop_oldest_segment();
+        }
+        //Only the newest keyframe's segment is left and it fills the ring, start a new one
+        keyframe = !reserve(length, offset);
+    }
+    if (keyframe) {
+        length = rle_encode(_scratch, nullptr, nullptr);
+        while (!reserve(length, offset) && _count) {
+            drop_oldest_segment();
+        }
+        if (!reserve(length, offset)) {
+            return false;
+        }
+        memcpy(_keyframe, _scratch, SNAPSHOT_SIZE);
+        _sinceKeyframe = 0;
+        _keyframes++;
+    }
+
+    rle_encode(_scratch, keyframe ? nullptr : _keyframe, _data + offset);
+    Entry& added = entry(_count++);
+    added.offset = offset;
+    added.length = static_cast<uint16_t>(length);
+    added.keyframe = keyframe;
+    _head = offset + static_cast<uint32_t>(length);
+    _used += static_cast<uint32_t>(length);
+    _lastBytes = static_cast<uint16_t>(length);
+    _sinceKeyframe++;
+    return true;
+}
+
+bool ChippyRewind::rewind(uint16_t frames){
+    if (frames >= _count) {
+        return false;
+    }
+    uint16_t target = _count - 1 - frames;
+    uint16_t key = target;
+    while (!entry(key).keyframe) {
+        key--;
+    }
+    uint16_t newestKey = _count - 1;
+    while (!entry(newestKey).keyframe) {
+        newestKey--;
+    }
+    while (_count > target + 1) {
+        drop_newest();
+    }
+
+    //_keyframe already holds the newest segment's keyframe, an older segment decodes its own
+    if (key != newestKey) {
+        memset(_keyframe, 0, SNAPSHOT_SIZE);
+        rle_apply(_data + entry(key).offset, entry(key).length, _keyframe);
+    }
+    memcpy(_scratch, _keyframe, SNAPSHOT_SIZE);
+    if (target != key) {
+        rle_apply(_data + entry(target).offset, entry(target).length, _scratch);
+    }
+    Entry& newest = entry(target);
+    _head = newest.offset + newest.length;
+    _lastBytes = newest.length;
+    _sinceKeyframe = target - key + 1;
+    return _core.load_state(_scratch, SNAPSHOT_SIZE);
+}
+
+RewindStats ChippyRewind::get_stats() const{
+    RewindStats stats;
+    stats.frames = _count;
+    stats.keyframes = _keyframes;
+    stats.bytes_used = _used;
+    stats.bytes_capacity = _capacity;
+    stats.last_bytes = _lastBytes;
+    return stats;
+}
@@ -0,0 +1,79 @@
+#ifndef CHIPPYREWIND_H
+#define CHIPPYREWIND_H
+
+#include "chippycore.h"
+
+///***********************************************************************************************///
+///                                        REWIND BUFFER                                          ///
+///                                                                                               ///
+/// Ring of snapshots, one capture() per frame. Every REWIND_KEYFRAME_INTERVAL captures a         ///
+/// keyframe is stored, the captures in between are XOR deltas against that keyframe. Keyframes   ///
+/// and deltas are run length encoded (zero runs and literal runs), so a frame that changed a few ///
+/// registers and rows costs tens of bytes instead of SNAPSHOT_SIZE. When the ring is full the    ///
+/// oldest keyframe goes together with its deltas.                                                ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define REWIND_BUFFER_SIZE 8192         // Bytes of encoded snapshots
+#define REWIND_MAX_FRAMES 600           // Index entries, 10 s at one capture per frame
+#define REWIND_KEYFRAME_INTERVAL 60
+
+struct RewindStats {
+    uint16_t frames;            // Captures that can be restored
+    uint16_t keyframes;
+    uint32_t bytes_used;
+    uint32_t bytes_capacity;    // 0 when the buffers could not be allocated
+    uint16_t last_bytes;        // Encoded size of the newest capture
+};
+
+class ChippyRewind{
+    public:
+        //Needs bufferSize bytes for the ring plus two SNAPSHOT_SIZE work buffers and 8 bytes per frame, in one
+        //block from the core's set_allocator() heap (ALLOC_HISTORY). The core must outlive the rewind buffer.
+        explicit ChippyRewind(ChippyCore& core, size_t bufferSize = REWIND_BUFFER_SIZE, uint16_t maxFrames = REWIND_MAX_FRAMES,
+                              uint16_t keyframeInterval = REWIND_KEYFRAME_INTERVAL);
+        ~ChippyRewind();
+        //Owns the ring and the work buffers
+        ChippyRewind(const ChippyRewind&) = delete;
+        ChippyRewind& operator=(const ChippyRewind&) = delete;
+
+        //Stores the current state, once per frame. False when even a keyframe does not fit the empty ring.
+        bool capture();
+        //Restores the capture `frames` before the newest one (0 is the newest) and drops the captures after
+        //it, so the next rewind continues further back. False when there are not that many captures.
+        bool rewind(uint16_t frames = 1);
+        void clear();
+
+        RewindStats get_stats() const;
+
+    private:
+        struct Entry {
+            uint32_t offset;
+            uint16_t length;
+            bool keyframe;
+        };
+
+        ChippyCore& _core;
+        uint8_t* _memory;       // Entries, keyframe, scratch and ring in one allocation
+        size_t _bytes;
+        uint8_t* _data;
+        uint32_t _capacity;
+        Entry* _entries;
+        uint16_t _maxFrames;
+        uint16_t _keyframeInterval;
+        uint8_t* _keyframe;     // Decoded keyframe of the newest capture
+        uint8_t* _scratch;
+
+        uint16_t _first = 0;    // Oldest entry
+        uint16_t _count = 0;
+        uint16_t _keyframes = 0;
+        uint16_t _sinceKeyframe = 0;
+        uint32_t _head = 0;     // Next free byte
+        uint32_t _used = 0;
+        uint16_t _lastBytes = 0;
+
+        Entry& entry(uint16_t index);
+        bool reserve(size_t length, uint32_t& offset);
+        void drop_oldest_segment();
+        void drop_newest();
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include "chippyruntime.h"
+
+#ifndef ARDUINO
+    #include <chrono>
+#endif
+
+ChippyRuntime::ChippyRuntime(ChippyCore& core) : _core(core){
+    memset(presented_planes, 0, sizeof(presented_planes));
+}
+
+ChippyRuntime::~ChippyRuntime(){
+    stop();
+}
+
+bool ChippyRuntime::start(ChippyCore::presentCallback frameCallback){
+    if (isRunning() || !_core.isRunning()) {
+        return false;
+    }
+    _frameCallback = frameCallback;
+    _stop.store(false);
+    //Nothing is on the display yet, the first frame reports every row
+    memset(presented_planes, 0, sizeof(presented_planes));
+    presented_width = 0;
+    _emuRunning.store(true);
+    _displayRunning.store(frameCallback != nullptr);
+
+#ifdef ARDUINO
+    if (xTaskCreatePinnedToCore(emulator_task, "chippy_emu", RUNTIME_TASK_STACK, this, RUNTIME_TASK_PRIORITY,
+                                &_emuTask, RUNTIME_EMU_CORE) != pdPASS) {
+        _emuRunning.store(false);
+        _displayRunning.store(false);
+        return false;
+    }
+    if (frameCallback && xTaskCreatePinnedToCore(display_task, "chippy_display", RUNTIME_TASK_STACK, this,
+                                                 RUNTIME_TASK_PRIORITY, &_displayTask, RUNTIME_DISPLAY_CORE) != pdPASS) {
+        _displayRunning.store(false);
+        stop();
+        return false;
+    }
+#else
+    _emuThread = std::thread(&ChippyRuntime::emulator_loop, this);
+    if (frameCallback) {
+        _displayThread = std::thread(&ChippyRuntime::display_loop, this);
+    }
+#endif
+    return true;
+}
+
+// Asks both tasks to finish and waits until they did
+void ChippyRuntime::stop(){
+    _stop.store(true);
+#ifdef ARDUINO
+    while (_emuRunning.load() || _displayRunning.load()) {
+        vTaskDelay(1);
+    }
+    _emuTask = nullptr;
+    _displayTask = nullptr;
+#else
+    if (_emuThread.joinable()) {
+        _emuThread.join();
+    }
+    if (_displayThread.joinable()) {
+        _displayThread.join();
+    }
+#endif
+}
+
+bool ChippyRuntime::isRunning() const{
+    return _emuRunning.load() || _displayRunning.load();
+}
+
+// Copies the used part of the display planes into the free slot and hands it over
+void ChippyRuntime::publish_frame(uint32_t sequence){
+    RuntimeFrame& frame = _frames.write_buffer();
+    DisplayFrame display = _core.get_display_frame();
+    for (uint8_t plane = 0; plane < DISPLAY_PLANES; plane++) {
+        memcpy(frame.planes[plane], display.planes[plane], display.row_words * display.height * sizeof(uint64_t));
+    }
+    frame.width = display.width;
+    frame.height = display.height;
+    frame.sequence = sequence;
+    frame.published_us = platform_micros();
+    if (!_frames.publish()) {
+        _skipped.fetch_add(1, std::memory_order_relaxed);
+    }
+    _published.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Emulator task: paced (or turbo) execution, one published frame per 60 Hz tick
+void ChippyRuntime::emulator_loop(){
+    uint32_t lastFrame = _core.get_scheduler_stats().frames;
+    while (!_stop.load(std::memory_order_relaxed) && _core.isRunning()) {
+        uint32_t executed = _core.run_for(RUNTIME_SLICE_US);
+        _executed.fetch_add(executed, std::memory_order_relaxed);
+        uint32_t frame = _core.get_scheduler_stats().frames;
+        if (frame != lastFrame) {
+            publish_frame(frame);
+            lastFrame = frame;
+        }
+        else if (!executed) {
+            idle(_core.get_idle_us());
+        }
+    }
+    //The last frame the emulator drew before it stopped
+    publish_frame(_core.get_scheduler_stats().frames);
+    _emuRunning.store(false);
+}
+
+bool ChippyRuntime::present(ChippyCore::presentCallback frameCallback){
+    if (!_frames.update()) {
+        return false;
+    }
+    const RuntimeFrame& frame = _frames.read_buffer();
+    DisplayFrame display;
+    display.width = frame.width;
+    display.height = frame.height;
+    display.row_words = frame.width / 64;
+    display.dirty_rows = 0;
+    //A resolution change redraws everything, otherwise only the rows that differ on some plane
+    bool resized = frame.width != presented_width;
+    presented_width = frame.width;
+    for (uint8_t plane = 0; plane < DISPLAY_PLANES; plane++) {
+        display.planes[plane] = frame.planes[plane];
+        const uint64_t* words = frame.planes[plane];
+        uint64_t* presented = presented_planes[plane];
+        for (uint8_t row = 0; row < display.height; row++, words += display.row_words, presented += display.row_words) {
+            for (uint8_t word = 0; word < display.row_words; word++) {
+                if (resized || words[word] != presented[word]) {
+                    display.dirty_rows |= static_cast<uint64_t>(1) << row;
+                    presented[word] = words[word];
+                }
+            }
+        }
+    }
+    if (display.dirty_rows && frameCallback) {
+        frameCallback(display);
+    }
+
+    uint32_t latency = platform_micros() - frame.published_us;
+    uint32_t average = _latencyAvg.load(std::memory_order_relaxed);
+    average = _presented.load(std::memory_order_relaxed) ? average + (static_cast<int32_t>(latency - average) >> 4) : latency;
+    _latencyAvg.store(average, std::memory_order_relaxed);
+    if (latency > _latencyMax.load(std::memory_order_relaxed)) {
+        _latencyMax.store(latency, std::memory_order_relaxed);
+    }
+    _presented.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Display task: presents until the emulator task is gone and its last frame is out
+void ChippyRuntime::display_loop(){
+    while (true) {
+        bool emulatorDone = !_emuRunning.load();
+        if (!present(_frameCallback)) {
+            if (emulatorDone || _stop.load(std::memory_order_relaxed)) {
+                break;
+            }
+            idle(0);
+        }
+    }
+    _displayRunning.store(false);
+}
+
+RuntimeStats ChippyRuntime::get_stats() const{
+    RuntimeStats stats;
+    stats.executed = _executed.load(std::memory_order_relaxed);
+    stats.published = _published.load(std::memory_order_relaxed);
+    stats.presented = _presented.load(std::memory_order_relaxed);
+    stats.skipped = _skipped.load(std::memory_order_relaxed);
+    stats.latency_avg_us = _latencyAvg.load(std::memory_order_relaxed);
+    stats.latency_max_us = _latencyMax.load(std::memory_order_relaxed);
+    return stats;
+}
+
+#ifdef ARDUINO
+// Whole ticks up to the time the core has work again, at least one, so the idle task feeds the watchdog.
+// With automatic light sleep configured FreeRTOS sleeps through them.
+void ChippyRuntime::idle(uint32_t us){
+    TickType_t ticks = pdMS_TO_TICKS(us / 1000);
+    vTaskDelay(ticks ? ticks : 1);
+}
+
+void ChippyRuntime::emulator_task(void* runtime){
+    static_cast<ChippyRuntime*>(runtime)->emulator_loop();
+    vTaskDelete(nullptr);
+}
+
+void ChippyRuntime::display_task(void* runtime){
+    static_cast<ChippyRuntime*>(runtime)->display_loop();
+    vTaskDelete(nullptr);
+}
+#else
+void ChippyRuntime::idle(uint32_t us){
+    std::this_thread::sleep_for(std::chrono::microseconds(us ? us : 100));
+}
+#endif
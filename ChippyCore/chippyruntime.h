@@ -0,0 +1,107 @@
+#ifndef CHIPPYRUNTIME_H
+#define CHIPPYRUNTIME_H
+
+#include "chippycore.h"
+#include "TripleBuffer.h"
+
+#ifdef ARDUINO
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/task.h>
+#else
+    #include <thread>
+#endif
+
+///***********************************************************************************************///
+///                                     THREADED RUNTIME                                          ///
+///                                                                                               ///
+/// Optional two task pipeline: the emulator runs ChippyCore::run_for() on its own task (core 1  ///
+/// on the ESP32) and publishes the framebuffer through a TripleBuffer at every 60 Hz tick. The   ///
+/// display task (core 0) picks up the newest frame and hands it to the frame callback together  ///
+/// with the rows that changed since the last frame it presented. Frames the display task was too ///
+/// slow for are skipped, never queued. On other targets both tasks are std::threads.            ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define RUNTIME_EMU_CORE 1
+#define RUNTIME_DISPLAY_CORE 0
+#define RUNTIME_TASK_STACK 4096
+#define RUNTIME_TASK_PRIORITY 5
+#define RUNTIME_SLICE_US 1000       // run_for() budget per emulator task iteration
+
+//One published frame, the display planes at the resolution of the time
+struct RuntimeFrame {
+    uint64_t planes[DISPLAY_PLANES][FRAMEBUFFER_WORDS];
+    uint8_t width;
+    uint8_t height;
+    uint32_t sequence;      // Scheduler frame number
+    uint32_t published_us;  // platform_micros() at publish time
+};
+
+//Pipeline counters. skipped counts frames replaced before the display task took them,
+//latency is publish to frame callback return, executed wraps like the other 32 bit counters.
+struct RuntimeStats {
+    uint32_t executed;
+    uint32_t published;
+    uint32_t presented;
+    uint32_t skipped;
+    uint32_t latency_avg_us;    // Moving average over about the last 16 frames
+    uint32_t latency_max_us;
+};
+
+class ChippyRuntime{
+    public:
+        explicit ChippyRuntime(ChippyCore& core);
+        ~ChippyRuntime();
+
+        //Starts the emulator task and, when frameCallback is set, the display task. The ROM must already be
+        //loaded with load_and_run(). From here until stop() only the emulator task may touch the core, so the
+        //loop callback runs on that task and no present callback should be set on the core.
+        bool start(ChippyCore::presentCallback frameCallback);
+        void stop();
+        bool isRunning() const;
+
+        //Presents the newest frame if there is one. The display task calls this, call it yourself when
+        //start() got no frame callback. Returns true when the callback was called.
+        bool present(ChippyCore::presentCallback frameCallback);
+
+        RuntimeStats get_stats() const;
+
+    private:
+        ChippyCore& _core;
+        ChippyCore::presentCallback _frameCallback = nullptr;
+        TripleBuffer<RuntimeFrame> _frames;
+
+        std::atomic<bool> _stop{false};
+        std::atomic<bool> _emuRunning{false};
+        std::atomic<bool> _displayRunning{false};
+
+        //Written by one task each, read by get_stats()
+        std::atomic<uint32_t> _executed{0};
+        std::atomic<uint32_t> _published{0};
+        std::atomic<uint32_t> _presented{0};
+        std::atomic<uint32_t> _skipped{0};
+        std::atomic<uint32_t> _latencyAvg{0};
+        std::atomic<uint32_t> _latencyMax{0};
+
+        //Display task only, the frame last handed to the callback for the dirty row diff
+        uint64_t presented_planes[DISPLAY_PLANES][FRAMEBUFFER_WORDS];
+        uint8_t presented_width = 0;
+
+#ifdef ARDUINO
+        TaskHandle_t _emuTask = nullptr;
+        TaskHandle_t _displayTask = nullptr;
+#else
+        std::thread _emuThread;
+        std::thread _displayThread;
+#endif
+
+        void publish_frame(uint32_t sequence);
+        void emulator_loop();
+        void display_loop();
+        //Sleeps about us microseconds, 0 for the shortest sleep
+        static void idle(uint32_t us);
+#ifdef ARDUINO
+        static void emulator_task(void* runtime);
+        static void display_task(void* runtime);
+#endif
+};
+
+#endif
@@ -0,0 +1,383 @@
+#include "chippyverify.h"
+#include "chippycore.h"
+#include <new>
+#include <string.h>
+
+#define VERIFY_MAX_DEPTH (MAX_16 + 1)
+#define VERIFY_ANY_INDEX 0xFFFF
+
+static inline uint16_t min16(uint16_t a, uint16_t b){
+    return a < b ? a : b;
+}
+
+static inline uint16_t max16(uint16_t a, uint16_t b){
+    return a > b ? a : b;
+}
+
+//The opcodes the engines' tables and executeOpcode() know, everything else raises UNKNOWN_OPCODE
+bool ChippyVerifier::is_known(uint16_t opcode){
+    uint8_t low = opcode & 0xFF;
+    switch (opcode >> 12) {
+        case 0x0:
+            return (low & 0xF0) == 0xC0 || (low & 0xF0) == 0xD0 || low == 0xE0 || low == 0xEE || low >= 0xFB;
+        case 0x8:
+            return (opcode & 0xF) < 8 || (opcode & 0xF) == 0xE;
+        case 0xE:
+            return low == 0x9E || low == 0xA1;
+        case 0xF:
+            switch (low) {
+                case 0x02:
+                    return opcode == 0xF002;
+                case 0x01: case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E:
+                case 0x29: case 0x30: case 0x33: case 0x3A: case 0x55: case 0x65:
+                    return true;
+                default:
+                    return false;
+            }
+        default:
+            return true;
+    }
+}
+
+uint8_t ChippyVerifier::byte_at(uint16_t address) const{
+    address &= RAM_SIZE - 1;
+    if (address < ROM_START_ADDRESS || static_cast<size_t>(address - ROM_START_ADDRESS) >= _romSize) {
+        return 0;
+    }
+    return _rom[address - ROM_START_ADDRESS];
+}
+
+uint16_t ChippyVerifier::opcode_at(uint16_t address) const{
+    return (byte_at(address) << 8) | byte_at(address + 1);
+}
+
+//FNV-1a over the code bytes in address order, nullptr hashes the ROM being verified
+uint32_t ChippyVerifier::hash_code(const uint8_t* memory) const{
+    uint32_t hash = 2166136261u;
+    for (uint16_t address = 0; address < RAM_SIZE; address++) {
+        if (is_code(address)) {
+            hash = (hash ^ (memory ? memory[address] : byte_at(address))) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+void ChippyVerifier::mark_code(uint16_t address){
+    address &= RAM_SIZE - 1;
+    _code[address >> 3] |= 1 << (address & 7);
+}
+
+bool ChippyVerifier::is_code(uint16_t address) const{
+    address &= RAM_SIZE - 1;
+    return _code[address >> 3] & (1 << (address & 7));
+}
+
+// Joins a path into the state of an even address and queues it when that state grew. An interval
+// that keeps growing is widened so loops that move I (FX1E, FX55) settle after a few turns.
+void ChippyVerifier::flow(uint16_t to, const SlotState& path){
+    to &= RAM_SIZE - 1;
+    SlotState& slot = _slots[to >> 1];
+    if (slot.low > slot.high) {
+        slot = {path.low, path.high, path.min_depth, path.max_depth, path.assigned, path.moved, 0, slot.queued};
+    }
+    else {
+        SlotState joined = slot;
+        joined.low = min16(slot.low, path.low);
+        joined.high = max16(slot.high, path.high);
+        joined.min_depth = path.min_depth < slot.min_depth ? path.min_depth : slot.min_depth;
+        joined.max_depth = path.max_depth > slot.max_depth ? path.max_depth : slot.max_depth;
+        joined.assigned = slot.assigned && path.assigned;
+        joined.moved = slot.moved || path.moved;
+        if (joined.low == slot.low && joined.high == slot.high && joined.min_depth == slot.min_depth &&
+            joined.max_depth == slot.max_depth && joined.assigned == slot.assigned && joined.moved == slot.moved) {
+            return;
+        }
+        if ((joined.low != slot.low || joined.high != slot.high) && ++joined.visits >= VERIFY_WIDEN_VISITS) {
+            joined.low = joined.low < slot.low ? 0 : joined.low;
+            joined.high = joined.high > slot.high ? VERIFY_ANY_INDEX : joined.high;
+        }
+        slot = joined;
+    }
+    if (!slot.queued) {
+        slot.queued = true;
+        _queue[_queued++] = to >> 1;
+    }
+}
+
+// Passes the state of pc on to every address the opcode there can continue at. Returns true when a
+// return changed what the calls get back.
+bool ChippyVerifier::step(uint16_t pc, ReturnState& returns){
+    SlotState path = _slots[pc >> 1];
+    uint16_t opcode = opcode_at(pc);
+    uint16_t NNN = opcode & 0x0FFF;
+    uint8_t X = (opcode >> 8) & 0xF;
+    uint8_t low = opcode & 0xFF;
+    uint16_t next = pc + 2;
+    if (!is_known(opcode)) {
+        return false;
+    }
+    switch (opcode >> 12) {
+        case 0x0:
+            if (low == 0xEE) {
+                //An empty stack stops the emulator, nothing returns
+                if (!path.max_depth) {
+                    return false;
+                }
+                ReturnState joined = returns;
+                if (path.assigned || path.moved) {
+                    joined.low = returns.low > returns.high ? path.low : min16(returns.low, path.low);
+                    joined.high = returns.low > returns.high ? path.high : max16(returns.high, path.high);
+                    joined.moves = returns.moves || !path.assigned;
+                }
+                else {
+                    joined.keeps = true;
+                }
+                if (joined.low == returns.low && joined.high == returns.high && joined.keeps == returns.keeps &&
+                    joined.moves == returns.moves) {
+                    return false;
+                }
+                if (++joined.changes >= VERIFY_WIDEN_VISITS) {
+                    joined.low = 0;
+                    joined.high = VERIFY_ANY_INDEX;
+                }
+                returns = joined;
+                return true;
+            }
+            if (low == 0xFD) {
+                return false;
+            }
+            break;
+        case 0x1:
+            if (!(NNN & 1)) {
+                flow(NNN, path);
+            }
+            return false;
+        case 0x2:
+            if (!(NNN & 1)) {
+                SlotState callee = path;
+                callee.min_depth = path.min_depth < VERIFY_MAX_DEPTH ? path.min_depth + 1 : VERIFY_MAX_DEPTH;
+                callee.max_depth = path.max_depth < VERIFY_MAX_DEPTH ? path.max_depth + 1 : VERIFY_MAX_DEPTH;
+                callee.assigned = false;
+                callee.moved = false;
+                flow(NNN, callee);
+            }
+            //Any reachable return may come back here: I is what the returns saw, or the caller's when
+            //some return leaves it alone
+            if (returns.low <= returns.high || returns.keeps) {
+                SlotState back = path;
+                back.low = returns.low <= returns.high ? returns.low : 0xFFFF;
+                back.high = returns.low <= returns.high ? returns.high : 0;
+                if (returns.keeps) {
+                    back.low = min16(back.low, path.low);
+                    back.high = max16(back.high, path.high);
+                }
+                back.assigned = path.assigned || !(returns.keeps || returns.moves);
+                back.moved = path.moved || returns.moves;
+                flow(next, back);
+            }
+            return false;
+        case 0x3: case 0x4: case 0x5: case 0x9: case 0xE:
+            flow(next + 2, path);
+            break;
+        case 0xA:
+            path.low = path.high = NNN;
+            path.assigned = true;
+            break;
+        case 0xB:
+            return false;
+        case 0xF:
+            if (low == 0x1E) {
+                path.low = path.high + 255 > RAM_SIZE - 1 ? 0 : path.low;
+                path.high = path.high + 255 > RAM_SIZE - 1 ? RAM_SIZE - 1 : path.high + 255;
+                path.moved = true;
+            }
+            else if (low == 0x29) {
+                path.low = FONTSET_START_ADDRESS;
+                path.high = FONTSET_START_ADDRESS + 255 * 5;
+                path.assigned = true;
+            }
+            else if (low == 0x30) {
+                path.low = BIG_FONTSET_START_ADDRESS;
+                path.high = BIG_FONTSET_START_ADDRESS + 15 * 10;
+                path.assigned = true;
+            }
+            else if ((low == 0x55 || low == 0x65) && (_report.quirks & QUIRK_MASK_MEMORY)) {
+                path.low = path.high + X + 1 > VERIFY_ANY_INDEX ? 0 : path.low + X + 1;
+                path.high = path.high + X + 1 > VERIFY_ANY_INDEX ? VERIFY_ANY_INDEX : path.high + X + 1;
+                path.moved = true;
+            }
+            break;
+    }
+    flow(next, path);
+    return false;
+}
+
+// Findings of one reachable opcode, after every state has settled and the code is marked
+void ChippyVerifier::check(uint16_t pc, uint8_t planes){
+    const SlotState& state = _slots[pc >> 1];
+    uint16_t opcode = opcode_at(pc);
+    uint8_t X = (opcode >> 8) & 0xF;
+    uint8_t low = opcode & 0xFF;
+    if (!is_known(opcode)) {
+        if (!_report.unknown_opcodes || pc < _report.first_unknown) {
+            _report.first_unknown = pc;
+        }
+        _report.unknown_opcodes++;
+        return;
+    }
+    if (state.max_depth > _report.max_stack_depth) {
+        _report.max_stack_depth = state.max_depth;
+    }
+
+    uint8_t length = 0;
+    bool write = false;
+    switch (opcode >> 12) {
+        case 0x0:
+            if (low == 0xEE && !state.min_depth) {
+                _report.unmatched_returns++;
+            }
+            return;
+        case 0x1: case 0x2:
+            if (opcode & 1) {
+                _report.computed_jumps++;
+            }
+            return;
+        case 0xB:
+            _report.computed_jumps++;
+            return;
+        case 0xD:
+            length = ((opcode & 0xF) ? (opcode & 0xF) : 32) * planes;
+            break;
+        case 0xF:
+            if (opcode == 0xF002) {
+                length = AUDIO_PATTERN_BYTES;
+            }
+            else if (low == 0x33) {
+                length = 3;
+                write = true;
+            }
+            else if (low == 0x55 || low == 0x65) {
+                length = X + 1;
+                write = low == 0x55;
+            }
+            break;
+    }
+    if (!length) {
+        return;
+    }
+    uint32_t last = static_cast<uint32_t>(state.high) + length - 1;
+    if (last > RAM_SIZE - 1) {
+        _report.out_of_range++;
+    }
+    if (write) {
+        //Every byte the write can reach, wrapped the way write_memory() wraps it
+        bool hitsCode = false;
+        uint32_t end = last - state.low + 1 >= RAM_SIZE ? state.low + RAM_SIZE - 1 : last;
+        for (uint32_t address = state.low; address <= end && !hitsCode; address++) {
+            hitsCode = is_code(address);
+        }
+        if (hitsCode) {
+            _report.code_writes++;
+        }
+    }
+}
+
+void ChippyVerifier::set_allocator(allocCallback aCallback, freeCallback fCallback){
+    _aCallback = aCallback;
+    _fCallback = fCallback;
+}
+
+size_t ChippyVerifier::work_size(){
+    return (sizeof(SlotState) + sizeof(uint16_t)) * (RAM_SIZE / 2);
+}
+
+const RomReport& ChippyVerifier::verify(const uint8_t* rom, size_t size, uint8_t quirks){
+    _report = {};
+    _report.quirks = quirks;
+    memset(_code, 0, sizeof(_code));
+    uint8_t* work = static_cast<uint8_t*>(_aCallback ? _aCallback(work_size(), ALLOC_ANALYSIS) : new (std::nothrow) uint8_t[work_size()]);
+    if (!work) {
+        return _report;
+    }
+    _slots = reinterpret_cast<SlotState*>(work);
+    _queue = reinterpret_cast<uint16_t*>(work + sizeof(SlotState) * (RAM_SIZE / 2));
+    for (uint16_t slot = 0; slot < RAM_SIZE / 2; slot++) {
+        _slots[slot] = {0xFFFF, 0, 0, 0, false, false, 0, false};
+    }
+    _rom = rom;
+    _romSize = size;
+    _queued = 0;
+
+    //The worklist runs until no state grows. Whenever the returns hand back something new every call
+    //is queued again, their successors take I from the returns.
+    ReturnState returns = {0xFFFF, 0, false, false, 0};
+    flow(ROM_START_ADDRESS, SlotState{0, 0, 0, 0, false, false, 0, false});
+    while (_queued) {
+        uint16_t slot = _queue[--_queued];
+        _slots[slot].queued = false;
+        if (!step(slot << 1, returns)) {
+            continue;
+        }
+        for (uint16_t call = 0; call < RAM_SIZE / 2; call++) {
+            const SlotState& state = _slots[call];
+            if (state.low <= state.high && (opcode_at(call << 1) >> 12) == 0x2 && !state.queued) {
+                _slots[call].queued = true;
+                _queue[_queued++] = call;
+            }
+        }
+    }
+
+    uint8_t planes = 1;
+    for (uint16_t slot = 0; slot < RAM_SIZE / 2; slot++) {
+        if (_slots[slot].low <= _slots[slot].high) {
+            uint16_t opcode = opcode_at(slot << 1);
+            mark_code(slot << 1);
+            mark_code((slot << 1) + 1);
+            if ((opcode & 0xF0FF) == 0xF001 && ((opcode >> 8) & 3) == 3) {
+                planes = 2;
+            }
+        }
+    }
+    for (uint16_t slot = 0; slot < RAM_SIZE / 2; slot++) {
+        if (_slots[slot].low <= _slots[slot].high) {
+            check(slot << 1, planes);
+        }
+    }
+    for (uint16_t address = 0; address < RAM_SIZE; address++) {
+        if (is_code(address)) {
+            _report.code_bytes++;
+        }
+    }
+    uint16_t romCode = 0;
+    for (size_t offset = 0; offset < size && offset < RAM_SIZE - ROM_START_ADDRESS; offset++) {
+        romCode += is_code(ROM_START_ADDRESS + offset);
+    }
+    _report.data_bytes = (size < RAM_SIZE - ROM_START_ADDRESS ? size : RAM_SIZE - ROM_START_ADDRESS) - romCode;
+    _codeHash = hash_code(nullptr);
+
+    if (_fCallback) {
+        _fCallback(work, ALLOC_ANALYSIS);
+    }
+    else {
+        delete[] work;
+    }
+    _slots = nullptr;
+    _queue = nullptr;
+    _rom = nullptr;
+    _report.verified = true;
+    _report.trusted = !_report.unknown_opcodes && !_report.unmatched_returns && !_report.out_of_range &&
+                      !_report.code_writes && !_report.computed_jumps && _report.max_stack_depth <= MAX_16;
+    return _report;
+}
+
+const RomReport& ChippyVerifier::report() const{
+    return _report;
+}
+
+bool ChippyVerifier::same_code(const uint8_t* memory) const{
+    return hash_code(memory) == _codeHash;
+}
+
+void ChippyVerifier::revoke(){
+    _report.trusted = false;
+}
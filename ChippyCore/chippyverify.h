@@ -0,0 +1,107 @@
+#ifndef CHIPPYVERIFY_H
+#define CHIPPYVERIFY_H
+
+#include "platform.h"
+#include "defines.h"
+
+///***********************************************************************************************///
+///                                        ROM VERIFIER                                           ///
+///                                                                                               ///
+/// Static analysis of a ROM at load time. Control flow is followed from ROM_START_ADDRESS through ///
+/// jumps, skips, calls and returns, which separates the code from the sprite and table data, and ///
+/// the possible values of I are tracked as an interval per address. That finds unknown opcodes,  ///
+/// returns with an empty stack, call nesting deeper than the stack, memory accesses that wrap    ///
+/// past the end of RAM and FX33/FX55 writes that may land on code. BNNN and jumps to odd         ///
+/// addresses are not followed, they leave the report unresolved.                                 ///
+///                                                                                               ///
+/// A trusted ROM provably never writes over its own code, so the block translator does not have  ///
+/// to end its blocks at the memory writes. Every other ROM runs as before: addresses masked to   ///
+/// RAM_SIZE, stack and opcode errors raised when they happen.                                    ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#define VERIFY_WIDEN_VISITS 8       // Visits of one address before its I interval widens to all of RAM
+
+struct RomReport {
+    bool verified;              // false when verification is off or its work memory could not be allocated
+    bool trusted;               // Verified with no finding below, see the banner above
+    uint8_t quirks;             // QUIRK_MASK_* the ROM was verified with, FX55/FX65 move I with QUIRK11
+    uint16_t code_bytes;        // Bytes of reachable opcodes
+    uint16_t data_bytes;        // The rest of the ROM: sprites, tables, padding and unreachable code
+    uint16_t unknown_opcodes;   // Reachable opcodes no engine knows
+    uint16_t first_unknown;     // Address of the lowest one, 0 when there is none
+    uint16_t unmatched_returns; // 00EE reachable with an empty stack
+    uint16_t out_of_range;      // Opcodes whose memory access may wrap past the end of RAM
+    uint16_t code_writes;       // FX33 and FX55 that may write over reachable code
+    uint16_t computed_jumps;    // BNNN and jumps or calls to odd addresses, their targets are not followed
+    uint8_t max_stack_depth;    // Deepest call nesting, MAX_16 + 1 when the stack may overflow
+};
+
+class ChippyVerifier{
+    public:
+        typedef void* (*allocCallback)(size_t size, uint8_t use);
+        typedef void (*freeCallback)(void* memory, uint8_t use);
+
+        //Analyses the ROM as load_and_run() loads it, memory outside the ROM reads as zero. Needs work_size()
+        //bytes of work memory while it runs, the report is not verified when that cannot be allocated.
+        const RomReport& verify(const uint8_t* rom, size_t size, uint8_t quirks);
+        //Heap of the work memory (ALLOC_ANALYSIS), ChippyCore passes its set_allocator() callbacks on.
+        //nullptr for both is new and delete.
+        void set_allocator(allocCallback aCallback, freeCallback fCallback);
+        //24 KB, allocated at the start of every verify() and freed at its end
+        static size_t work_size();
+        const RomReport& report() const;
+
+        //True for the bytes of reachable opcodes of the last verified ROM
+        bool is_code(uint16_t address) const;
+        //True while the code bytes of a flat RAM_SIZE image match the verified ROM
+        bool same_code(const uint8_t* memory) const;
+        //Drops the trust (after a snapshot with other code was loaded)
+        void revoke();
+
+    private:
+        //What every path reaching an even address agrees on
+        struct SlotState {
+            uint16_t low;           // Interval of I, low > high until the address is reached
+            uint16_t high;
+            uint8_t min_depth;      // Call nesting
+            uint8_t max_depth;
+            bool assigned;          // I was set by ANNN, FX29 or FX30 since the subroutine was entered
+            bool moved;             // I was moved by FX1E or FX55/FX65 (QUIRK11) since then
+            uint8_t visits;
+            bool queued;
+        };
+
+        //What the reachable returns hand back to every call
+        struct ReturnState {
+            uint16_t low;           // Interval of I at the returns that assigned or moved it
+            uint16_t high;
+            bool keeps;             // Some return leaves I as the caller had it
+            bool moves;             // Some return moved the caller's I
+            uint8_t changes;
+        };
+
+        RomReport _report = {};
+        uint8_t _code[RAM_SIZE / 8] = {};
+        uint32_t _codeHash = 0;
+
+        allocCallback _aCallback = nullptr;
+        freeCallback _fCallback = nullptr;
+
+        //Work memory of verify(), one allocation with the queue behind the slots
+        SlotState* _slots = nullptr;
+        uint16_t* _queue = nullptr;
+        uint16_t _queued = 0;
+        const uint8_t* _rom = nullptr;
+        size_t _romSize = 0;
+
+        uint8_t byte_at(uint16_t address) const;
+        uint16_t opcode_at(uint16_t address) const;
+        uint32_t hash_code(const uint8_t* memory) const;
+        void flow(uint16_t to, const SlotState& path);
+        bool step(uint16_t pc, ReturnState& returns);
+        void check(uint16_t pc, uint8_t planes);
+        void mark_code(uint16_t address);
+
+        static bool is_known(uint16_t opcode);
+};
+
+#endif
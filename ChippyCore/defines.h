@@ -1,18 +1,48 @@
 #ifndef DEFINES_H
 #define DEFINES_H
 
+    //Instrumentation (chippyprofile.h), costs nothing while commented out. Or pass -DCHIPPY_PROFILE.
+    //#define CHIPPY_PROFILE
+    //Breakpoints, watchpoints and the trace (chippydebug.h), likewise. Or pass -DCHIPPY_DEBUGGER.
+    //#define CHIPPY_DEBUGGER
+
     //CONSTANTS
     #define RAM_SIZE 4096
     #define MAX_16 16
     #define MAX_8 8
     #define ROM_START_ADDRESS 0x200
     #define FONTSET_START_ADDRESS 0x50 
+    #define BIG_FONTSET_START_ADDRESS 0xA0      // SCHIP 8x10 digits for FX30
+    #define MEMORY_PAGE_SHIFT 8
+    #define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_SHIFT)
+    #define MEMORY_PAGES (RAM_SIZE / MEMORY_PAGE_SIZE)
+    #define DISPLAY_WIDTH 64
+    #define DISPLAY_HEIGHT 32
+    #define HIRES_WIDTH 128                     // SCHIP/XO-CHIP 00FF
+    #define HIRES_HEIGHT 64
+    #define DISPLAY_PLANES 2                    // XO-CHIP bitplanes
+    #define FRAMEBUFFER_WORDS (HIRES_WIDTH / 64 * HIRES_HEIGHT)  // Row words of one plane at most
+    #define BLOCK_POOL_SIZE 512
+    #define BLOCK_MAX_OPS 32
+    #define FRAMEBUFFER_MSB (static_cast<uint64_t>(1) << 63)
+    #define DEFAULT_INSTRUCTIONS_PER_FRAME 8    // About the 500 Hz of the old 2 ms cycle
+    #define DEFAULT_MAX_CATCHUP_FRAMES 4
+    #define FRAME_PHASE_UNITS 1000000           // One 60 Hz frame in microseconds * 60, so frames never drift
+    #define SCHEDULER_SLICE 64                  // Opcodes between clock reads in run_for()
+    #define IDLE_CHECK_SLICE 256                // Opcodes between idle loop checks in run_instructions()
+    #define LOOP_POLL_US 1000                   // Loop callback polling interval
+    #define NO_KEY 0xFF
+    #define AUDIO_PATTERN_BYTES 16              // XO-CHIP pattern buffer, 128 one bit samples
+    #define AUDIO_DEFAULT_PITCH 64              // 4000 Hz pattern playback
     
     //EMULATOR STATES AND CONTROLS
     #define START 1
     #define PAUSE 2
     #define CLEAR_DISPLAY 3
     #define SOUND_STATE 4
+    #define FRAME_DRAWN 10
+    #define TURBO 11
+    #define AUDIO_PATTERN 12                    // F002 loaded a pattern, the beeper is replaced
 
     //ERROR CODES
     #define ERROR_ROM_SIZE 1
@@ -20,5 +50,6 @@
     #define ERROR_USER_KEYPRESS 3
     #define STACK_OVERFLOW_ERROR 4
     #define UNKNOWN_OPCODE 5
+    #define ERROR_OUT_OF_MEMORY 6
     
 #endif
\ No newline at end of file
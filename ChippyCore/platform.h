@@ -0,0 +1,42 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+///***********************************************************************************************///
+///                                       PLATFORM LAYER                                          ///
+///                                                                                               ///
+/// Everything the core needs from the board goes through these functions. On Arduino they are   ///
+/// thin inline wrappers, on other targets they are implemented in host/platform_host.cpp.        ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifdef ARDUINO
+    #include <Arduino.h>
+    #if __has_include(<esp_memory_utils.h>)
+        #include <esp_memory_utils.h>
+    #else
+        #include <soc/soc_memory_layout.h>
+    #endif
+
+    inline uint32_t platform_millis(){ return millis(); }
+    inline uint32_t platform_micros(){ return micros(); }
+    inline void platform_delay(uint32_t ms){ delay(ms); }
+    inline uint32_t platform_random(){ return esp_random(); }   // Hardware RNG, one read per ROM load
+    inline void platform_log(const char* message){ Serial.println(message); }
+    // True for data mapped from flash (const arrays, packs in a partition), which lives for the whole program
+    inline bool platform_is_static(const void* data){ return esp_ptr_in_drom(data); }
+
+    #define CHIPPY_CACHE_LINE 32    // ESP32 cache line (flash and PSRAM)
+#else
+    uint32_t platform_millis();             // Milliseconds since start, wraps like millis()
+    uint32_t platform_micros();             // Microseconds since start, wraps like micros()
+    void platform_delay(uint32_t ms);       // Blocking sleep
+    uint32_t platform_random();             // 32 random bits, seeds the CXNN generator at every ROM load
+    void platform_log(const char* message); // One line of diagnostic output
+    bool platform_is_static(const void* data); // True when data lives for the whole program (const or static data)
+
+    #define CHIPPY_CACHE_LINE 64
+#endif
+
+#endif
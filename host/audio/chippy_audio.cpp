@@ -0,0 +1,153 @@
+#include "chippycore.h"
+#include "chippyaudio.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+// Runs a ROM headless and writes the PCM blocks of ChippyAudio to a WAV file, draining the ring after
+// every frame like the I2S task would. Without a ROM a built-in demo plays: half a second of the
+// CHIP-8 beeper, then an XO-CHIP pattern whose pitch rises every third of a second.
+//
+//   chippy_audio [-o FILE.wav] [--frames N] [--ipf N] [--rate HZ] [ROM]
+
+// 200: beep for 30 frames and wait 60        216: beep 20 frames, wait 20, pitch += 16, repeat
+static const uint8_t DEMO_ROM[] = {
+    0x60, 0x1E, 0xF0, 0x18, 0x60, 0x3C, 0xF0, 0x15, 0xF1, 0x07, 0x31, 0x00, 0x12, 0x08,     // 200
+    0xA2, 0x28, 0xF0, 0x02, 0x62, 0x20, 0xF2, 0x3A,                                         // 20E
+    0x60, 0x14, 0xF0, 0x18, 0xF0, 0x15, 0xF1, 0x07, 0x31, 0x00, 0x12, 0x1C,                 // 216
+    0x72, 0x10, 0xF2, 0x3A, 0x12, 0x16,                                                     // 222
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0 // 228
+};
+
+struct AudioOptions {
+    const char* output = "chippy_audio.wav";
+    const char* rom = nullptr;
+    uint32_t frames = 300;
+    uint16_t ipf = 20;
+    uint32_t rate = AUDIO_SAMPLE_RATE;
+};
+
+static void put16(uint8_t* p, uint16_t value){
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t value){
+    put16(p, value & 0xFFFF);
+    put16(p + 2, value >> 16);
+}
+
+// 16 bit mono PCM, RIFF sizes from the sample count
+static void wav_header(uint8_t* header, uint32_t rate, uint32_t samples){
+    uint32_t bytes = samples * 2;
+    memcpy(header, "RIFF", 4);
+    put32(header + 4, 36 + bytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put32(header + 16, 16);
+    put16(header + 20, 1);
+    put16(header + 22, 1);
+    put32(header + 24, rate);
+    put32(header + 28, rate * 2);
+    put16(header + 32, 2);
+    put16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    put32(header + 40, bytes);
+}
+
+// Writes the block little endian whatever the host byte order
+static bool write_block(FILE* file, const int16_t* block){
+    uint8_t bytes[AUDIO_BLOCK_SAMPLES * 2];
+    for(uint16_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++){
+        put16(bytes + i * 2, static_cast<uint16_t>(block[i]));
+    }
+    return std::fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+}
+
+int main(int argc, char** argv){
+    AudioOptions options;
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "-o") && hasValue){
+            options.output = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--frames") && hasValue){
+            options.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            options.ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--rate") && hasValue){
+            options.rate = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(argv[i][0] != '-' && !options.rom){
+            options.rom = argv[i];
+        }
+        else{
+            std::fprintf(stderr, "usage: %s [-o FILE.wav] [--frames N] [--ipf N] [--rate HZ] [ROM]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(options.rate < 60){
+        std::fprintf(stderr, "the sample rate must be at least 60 Hz\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> rom(DEMO_ROM, DEMO_ROM + sizeof(DEMO_ROM));
+    if(options.rom){
+        std::ifstream stream(options.rom, std::ios::binary);
+        if(!stream){
+            std::fprintf(stderr, "cannot read %s\n", options.rom);
+            return 1;
+        }
+        rom.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+
+    FILE* file = std::fopen(options.output, "wb");
+    if(!file){
+        std::fprintf(stderr, "cannot write %s\n", options.output);
+        return 1;
+    }
+    uint8_t header[44];
+    wav_header(header, options.rate, 0);
+    std::fwrite(header, 1, sizeof(header), file);
+
+    static const bool config[4] = {false, false, false, false};
+    std::unique_ptr<ChippyCore> core(new ChippyCore());
+    std::unique_ptr<ChippyAudio> audio(new ChippyAudio(options.rate));
+    core->set_audio(audio.get());
+    core->load_and_run(rom.data(), rom.size(), nullptr, nullptr, nullptr, config);
+
+    uint32_t samples = 0;
+    uint32_t soundFrames = 0;
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t frame = 0; frame < options.frames && core->isRunning(); frame++){
+        soundFrames += core->get_cpu_state().SOUNDTIMER > 0;
+        core->run_frame(options.ipf);
+        while(const int16_t* block = audio->read_block()){
+            ok = ok && write_block(file, block);
+            audio->release_block();
+            samples += AUDIO_BLOCK_SAMPLES;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    wav_header(header, options.rate, samples);
+    ok = ok && !std::fseek(file, 0, SEEK_SET) && std::fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    ok = !std::fclose(file) && ok;
+    if(!ok){
+        std::fprintf(stderr, "cannot write %s\n", options.output);
+        return 1;
+    }
+    AudioStats stats = audio->get_stats();
+    std::printf("%s: %u samples at %u Hz, %u frames with sound, %u blocks, %u dropped, %.2f us per frame\n", options.output,
+                samples, options.rate, soundFrames, stats.rendered_blocks, stats.dropped_blocks,
+                seconds * 1e6 / options.frames);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "batch_runner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+BatchResult run_job(const BatchJob& job){
+    std::unique_ptr<ChippyCore> core(new ChippyCore());
+    core->set_engine(job.engine);
+    core->set_idle_skip(job.idleSkip);
+    core->load_and_run(job.rom, job.romSize, nullptr, nullptr, nullptr, job.config);
+    core->set_random_seed(job.seed);
+
+    BatchResult result = {};
+    size_t nextInput = 0;
+    for(uint32_t frame = 0; frame < job.frames && core->isRunning(); frame++){
+        while(nextInput < job.inputCount && job.inputs[nextInput].frame <= frame){
+            core->set_keypad_mask(job.inputs[nextInput].keys);
+            nextInput++;
+        }
+        result.instructions += core->run_frame(job.instructionsPerFrame);
+        result.frames++;
+    }
+    result.framebufferHash = hash_display(core->get_display_frame());
+    result.cpu = core->get_cpu_state();
+    result.running = core->isRunning();
+    result.idle = core->get_idle_stats();
+    return result;
+}
+
+// One job queue per worker. The owner takes from the back, thieves from the front, so the two rarely
+// meet on the same end. Jobs never spawn jobs, so a worker is done once every queue is empty.
+struct WorkerQueue {
+    std::mutex lock;
+    std::deque<size_t> jobs;
+
+    bool pop(size_t& job){
+        std::lock_guard<std::mutex> guard(lock);
+        if(jobs.empty()){
+            return false;
+        }
+        job = jobs.back();
+        jobs.pop_back();
+        return true;
+    }
+
+    bool steal(size_t& job){
+        std::lock_guard<std::mutex> guard(lock);
+        if(jobs.empty()){
+            return false;
+        }
+        job = jobs.front();
+        jobs.pop_front();
+        return true;
+    }
+};
+
+std::vector<BatchResult> run_batch(const std::vector<BatchJob>& jobs, unsigned threads, BatchStats* stats){
+    if(!threads){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(jobs.size(), 1)));
+
+    std::vector<BatchResult> results(jobs.size());
+    std::unique_ptr<WorkerQueue[]> queues(new WorkerQueue[threads]);
+    for(size_t i = 0; i < jobs.size(); i++){
+        queues[i % threads].jobs.push_back(i);
+    }
+
+    std::atomic<uint32_t> steals{0};
+    auto worker = [&](unsigned self){
+        size_t job;
+        while(true){
+            if(queues[self].pop(job)){
+                results[job] = run_job(jobs[job]);
+                continue;
+            }
+            bool stolen = false;
+            for(unsigned offset = 1; offset < threads && !stolen; offset++){
+                stolen = queues[(self + offset) % threads].steal(job);
+            }
+            if(!stolen){
+                return;
+            }
+            steals.fetch_add(1, std::memory_order_relaxed);
+            results[job] = run_job(jobs[job]);
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(unsigned i = 1; i < threads; i++){
+        workers.emplace_back(worker, i);
+    }
+    worker(0);
+    for(std::thread& thread : workers){
+        thread.join();
+    }
+
+    if(stats){
+        stats->threads = threads;
+        stats->steals = steals.load();
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return results;
+}
@@ -0,0 +1,49 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include "chippycore.h"
+#include "../bench/bench_common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Headless batch execution of many ROM/quirk/input combinations across all host cores, as fast as the
+// engines go. Jobs are independent ChippyCore instances, spread over the workers with work stealing so
+// a few long jobs do not leave the other cores idle.
+
+struct BatchJob {
+    const uint8_t* rom;
+    size_t romSize;
+    bool config[4];                         // QUIRK4, QUIRK5, QUIRK6, QUIRK11 like load_and_run()
+    uint32_t frames;
+    uint16_t instructionsPerFrame = 1000;
+    uint8_t engine = ENGINE_BLOCKS;
+    bool idleSkip = true;                   // ChippyCore::set_idle_skip()
+    uint32_t seed = 0;                      // ChippyCore::set_random_seed() for CXNN
+    const BatchInput* inputs = nullptr;     // Sorted by frame
+    size_t inputCount = 0;
+};
+
+struct BatchResult {
+    uint32_t framebufferHash;   // hash_display() (bench_common.h) of the final display
+    CpuState cpu;
+    uint64_t instructions;
+    uint32_t frames;            // Less than requested when the ROM stopped the emulator
+    bool running;
+    IdleStats idle;             // Share of the instructions fast-forwarded in idle loops
+};
+
+struct BatchStats {
+    unsigned threads;
+    uint32_t steals;            // Jobs a worker took from another worker's queue
+    double seconds;
+};
+
+// Runs every job and returns the results in job order. threads == 0 uses every hardware thread.
+std::vector<BatchResult> run_batch(const std::vector<BatchJob>& jobs, unsigned threads = 0, BatchStats* stats = nullptr);
+
+// Runs a single job on the calling thread
+BatchResult run_job(const BatchJob& job);
+
+#endif
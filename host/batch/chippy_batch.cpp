@@ -0,0 +1,221 @@
+#include "batch_runner.h"
+#include "../bench/bench_roms.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+// Regression and fuzzing front end for run_batch(). Every ROM (the files given, or the bundled benchmark
+// ROMs) runs under every quirk profile with no input, plus --fuzz runs with random keypad scripts. One
+// line per job with the final framebuffer hash and registers, so two firmware builds can be diffed.
+// --check runs every job again on the reference switch engine, without idle loop skipping, and reports
+// any difference. --verify runs nothing and prints the load-time verifier report (chippyverify.h) instead.
+//
+//   chippy_batch [--threads N] [--frames N] [--ipf N] [--fuzz N] [--seed N] [--engine NAME] [--check] [ROM...]
+//   chippy_batch --verify [ROM...]
+
+struct BatchOptions {
+    unsigned threads = 0;
+    uint32_t frames = 600;
+    uint16_t ipf = 1000;
+    uint32_t fuzz = 0;
+    uint32_t seed = 1;
+    uint8_t engine = ENGINE_BLOCKS;
+    bool check = false;
+    bool verify = false;
+    std::vector<const char*> files;
+};
+
+struct LoadedRom {
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+struct JobInfo {
+    size_t rom;
+    size_t profile;
+    uint32_t seed;
+};
+
+static bool parse_options(int argc, char** argv, BatchOptions& options){
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--threads") && hasValue){
+            options.threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--frames") && hasValue){
+            options.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            options.ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--fuzz") && hasValue){
+            options.fuzz = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--seed") && hasValue){
+            options.seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--engine") && hasValue){
+            const char* name = argv[++i];
+            bool found = false;
+            for(const BenchEngine& engine : BENCH_ENGINES){
+                if(!strcmp(name, engine.name)){
+                    options.engine = engine.engine;
+                    found = true;
+                }
+            }
+            if(!found){
+                std::fprintf(stderr, "unknown engine %s\n", name);
+                return false;
+            }
+        }
+        else if(!strcmp(argv[i], "--check")){
+            options.check = true;
+        }
+        else if(!strcmp(argv[i], "--verify")){
+            options.verify = true;
+        }
+        else if(argv[i][0] != '-'){
+            options.files.push_back(argv[i]);
+        }
+        else{
+            std::fprintf(stderr, "usage: %s [--threads N] [--frames N] [--ipf N] [--fuzz N] [--seed N] [--engine NAME] [--check] [ROM...]\n"
+                                 "       %s --verify [ROM...]\n", argv[0], argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool load_roms(const BatchOptions& options, std::vector<LoadedRom>& roms){
+    if(options.files.empty()){
+        for(const BenchRom& rom : BENCH_ROMS){
+            roms.push_back({rom.name, std::vector<uint8_t>(rom.data, rom.data + rom.size)});
+        }
+        return true;
+    }
+    for(const char* file : options.files){
+        std::ifstream stream(file, std::ios::binary);
+        if(!stream){
+            std::fprintf(stderr, "cannot read %s\n", file);
+            return false;
+        }
+        std::string name(file);
+        size_t slash = name.find_last_of('/');
+        roms.push_back({slash == std::string::npos ? name : name.substr(slash + 1),
+                        std::vector<uint8_t>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>())});
+    }
+    return true;
+}
+
+// One report line per ROM and profile, the profiles differ in how FX55/FX65 move I
+static void print_reports(const std::vector<LoadedRom>& roms){
+    ChippyVerifier verifier;
+    std::printf("%-12s %-7s %-7s %5s %5s %7s %5s %5s %5s %5s %5s\n", "rom", "profile", "trusted", "code", "data", "unknown",
+                "ret", "range", "write", "jump", "depth");
+    for(const LoadedRom& rom : roms){
+        for(const BenchProfile& profile : BENCH_PROFILES){
+            uint8_t quirks = (profile.config[0] ? QUIRK_MASK_VF_RESET : 0) | (profile.config[1] ? QUIRK_MASK_SHIFT : 0) |
+                             (profile.config[2] ? QUIRK_MASK_WRAP : 0) | (profile.config[3] ? QUIRK_MASK_MEMORY : 0);
+            const RomReport& report = verifier.verify(rom.data.data(), rom.data.size(), quirks);
+            std::printf("%-12s %-7s %-7s %5u %5u %7u %5u %5u %5u %5u %5u", rom.name.c_str(), profile.name,
+                        !report.verified ? "-" : report.trusted ? "yes" : "no", report.code_bytes, report.data_bytes,
+                        report.unknown_opcodes, report.unmatched_returns, report.out_of_range, report.code_writes,
+                        report.computed_jumps, report.max_stack_depth);
+            if(report.unknown_opcodes){
+                std::printf("  first unknown at %03x", report.first_unknown);
+            }
+            std::printf("\n");
+        }
+    }
+}
+
+static bool same_result(const BatchResult& a, const BatchResult& b){
+    return a.framebufferHash == b.framebufferHash && a.instructions == b.instructions && a.running == b.running &&
+           !memcmp(&a.cpu, &b.cpu, sizeof(CpuState));
+}
+
+int main(int argc, char** argv){
+    BatchOptions options;
+    std::vector<LoadedRom> roms;
+    if(!parse_options(argc, argv, options) || !load_roms(options, roms)){
+        return 1;
+    }
+    if(options.verify){
+        print_reports(roms);
+        return 0;
+    }
+
+    //Every ROM under every profile, once without input and options.fuzz times with a random script
+    std::vector<BatchJob> jobs;
+    std::vector<JobInfo> info;
+    std::vector<std::vector<BatchInput>> scripts;
+    scripts.reserve(roms.size() * (sizeof(BENCH_PROFILES) / sizeof(BENCH_PROFILES[0])) * options.fuzz);
+    for(size_t r = 0; r < roms.size(); r++){
+        for(size_t p = 0; p < sizeof(BENCH_PROFILES) / sizeof(BENCH_PROFILES[0]); p++){
+            for(uint32_t run = 0; run <= options.fuzz; run++){
+                BatchJob job;
+                job.rom = roms[r].data.data();
+                job.romSize = roms[r].data.size();
+                memcpy(job.config, BENCH_PROFILES[p].config, sizeof(job.config));
+                job.frames = options.frames;
+                job.instructionsPerFrame = options.ipf;
+                job.engine = options.engine;
+                job.seed = options.seed + static_cast<uint32_t>(jobs.size());
+                if(run){
+                    scripts.push_back(random_script(job.seed, options.frames));
+                    job.inputs = scripts.back().data();
+                    job.inputCount = scripts.back().size();
+                }
+                jobs.push_back(job);
+                info.push_back({r, p, run ? job.seed : 0});
+            }
+        }
+    }
+
+    BatchStats stats;
+    std::vector<BatchResult> results = run_batch(jobs, options.threads, &stats);
+
+    uint64_t instructions = 0;
+    uint64_t frames = 0;
+    std::printf("%-12s %-7s %10s %6s %12s %6s %8s %5s %5s  %s\n", "rom", "profile", "seed", "state", "instructions", "idle", "fbhash", "PC", "I", "V0-VF");
+    for(size_t i = 0; i < jobs.size(); i++){
+        const BatchResult& result = results[i];
+        instructions += result.instructions;
+        frames += result.frames;
+        uint64_t idleTotal = static_cast<uint64_t>(result.idle.executed) + result.idle.skipped;
+        double idle = idleTotal ? 100.0 * result.idle.skipped / idleTotal : 0;
+        std::printf("%-12s %-7s %10u %6s %12llu %5.1f%% %08x %05x %05x  ", roms[info[i].rom].name.c_str(), BENCH_PROFILES[info[i].profile].name,
+                    info[i].seed, result.running ? "run" : "stop", static_cast<unsigned long long>(result.instructions), idle,
+                    result.framebufferHash, result.cpu.PC, result.cpu.INDEX);
+        for(uint8_t reg = 0; reg < MAX_16; reg++){
+            std::printf("%02x", result.cpu.V[reg]);
+        }
+        std::printf("\n");
+    }
+    double seconds = stats.seconds > 0 ? stats.seconds : 1e-9;
+    std::fprintf(stderr, "%zu jobs on %u threads (%u steals) in %.3f s: %.0f instr/s, %.0fx real time\n", jobs.size(), stats.threads,
+                 stats.steals, stats.seconds, instructions / seconds, frames / (60.0 * seconds));
+
+    if(options.check){
+        std::vector<BatchJob> reference(jobs);
+        for(BatchJob& job : reference){
+            job.engine = ENGINE_SWITCH;
+            job.idleSkip = false;
+        }
+        std::vector<BatchResult> expected = run_batch(reference, options.threads);
+        uint32_t mismatches = 0;
+        for(size_t i = 0; i < jobs.size(); i++){
+            if(!same_result(results[i], expected[i])){
+                std::fprintf(stderr, "mismatch: %s %s seed %u\n", roms[info[i].rom].name.c_str(), BENCH_PROFILES[info[i].profile].name, info[i].seed);
+                mismatches++;
+            }
+        }
+        std::fprintf(stderr, "check against the switch engine: %u mismatches\n", mismatches);
+        return mismatches ? 2 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include "chippycore.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+// Tables and helpers shared by the host tools, so their results line up: chippy_lockstep_bench checks its
+// lanes against chippy_batch jobs with the same scripts, and an fbhash from chippy_bench is the same
+// hash chippy_batch prints. Change them here, never in a copy.
+
+struct BenchProfile {
+    const char* name;
+    bool config[4];     // QUIRK4, QUIRK5, QUIRK6, QUIRK11 like the load_and_run() config
+};
+
+static const BenchProfile BENCH_PROFILES[] = {
+    {"none",   {false, false, false, false}},
+    {"cosmac", {true,  false, false, true }},
+    {"schip",  {false, true,  false, false}},
+    {"chip48", {false, true,  false, true }},
+    {"xochip", {false, false, true,  true }},
+    {"wrap",   {false, false, true,  false}},
+};
+
+struct BenchEngine {
+    const char* name;
+    uint8_t engine;
+};
+
+static const BenchEngine BENCH_ENGINES[] = {
+    {"switch", ENGINE_SWITCH},
+    {"table",  ENGINE_TABLE},
+    {"goto",   ENGINE_GOTO},
+    {"cached", ENGINE_CACHED},
+    {"blocks", ENGINE_BLOCKS},
+};
+
+//Scripted input: from the start of frame `frame` on the keypad is `keys` (bit n is key n)
+struct BatchInput {
+    uint32_t frame;
+    uint16_t keys;
+};
+
+// A new random keypad state every 1 to 30 frames, no key pressed about half of the time
+inline std::vector<BatchInput> random_script(uint32_t seed, uint32_t frames){
+    std::mt19937 random(seed);
+    std::vector<BatchInput> script;
+    for(uint32_t frame = 0; frame < frames; frame += 1 + random() % 30){
+        uint16_t keys = (random() & 1) ? static_cast<uint16_t>(1u << (random() % MAX_16)) : 0;
+        script.push_back({frame, keys});
+    }
+    return script;
+}
+
+// FNV-1a over the row words of the first plane, then the second one if anything is lit there, so a
+// low resolution CHIP-8 display hashes the same as the single plane framebuffer did
+inline uint32_t hash_display(const DisplayFrame& frame){
+    uint32_t hash = 2166136261u;
+    size_t words = static_cast<size_t>(frame.row_words) * frame.height;
+    for(uint8_t plane = 0; plane < DISPLAY_PLANES; plane++){
+        const uint64_t* planeWords = frame.planes[plane];
+        bool lit = !plane;
+        for(size_t word = 0; word < words && !lit; word++){
+            lit = planeWords[word] != 0;
+        }
+        if(!lit){
+            continue;
+        }
+        for(size_t word = 0; word < words; word++){
+            for(uint8_t shift = 0; shift < 64; shift += 8){
+                hash = (hash ^ static_cast<uint8_t>(planeWords[word] >> shift)) * 16777619u;
+            }
+        }
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef BENCH_ROMS_H
+#define BENCH_ROMS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Small hand assembled ROMs that never terminate, each one stressing a different part of the core.
+
+// Fills the screen with the font digits over and over, sprite heavy with lots of collisions.
+static const uint8_t ROM_SPRITES[] = {
+    0x00, 0xE0,     // 200: CLS
+    0x60, 0x00,     // 202: V0 = 0          x
+    0x61, 0x00,     // 204: V1 = 0          y
+    0x62, 0x00,     // 206: V2 = 0          digit
+    0xF2, 0x29,     // 208: I = font(V2)
+    0xD0, 0x15,     // 20A: DRW V0, V1, 5
+    0x70, 0x06,     // 20C: V0 += 6
+    0x72, 0x01,     // 20E: V2 += 1
+    0x63, 0x0F,     // 210: V3 = 0x0F
+    0x82, 0x32,     // 212: V2 &= V3
+    0x30, 0x3C,     // 214: SE V0, 60
+    0x12, 0x08,     // 216: JP 208
+    0x60, 0x00,     // 218: V0 = 0
+    0x71, 0x06,     // 21A: V1 += 6
+    0x41, 0x1E,     // 21C: SNE V1, 30
+    0x61, 0x00,     // 21E: V1 = 0
+    0x12, 0x08      // 220: JP 208
+};
+
+// Tight ALU loop over the 8XYN family, the quirk sensitive shifts and logic ops included.
+static const uint8_t ROM_ARITH[] = {
+    0x60, 0x01,     // 200: V0 = 1
+    0x61, 0x03,     // 202: V1 = 3
+    0x80, 0x14,     // 204: V0 += V1
+    0x81, 0x05,     // 206: V1 -= V0
+    0x82, 0x06,     // 208: V2 = V0 >> 1
+    0x82, 0x1E,     // 20A: V2 = V1 << 1
+    0x80, 0x13,     // 20C: V0 ^= V1
+    0x81, 0x21,     // 20E: V1 |= V2
+    0x83, 0x02,     // 210: V3 &= V0
+    0x80, 0x17,     // 212: V0 = V1 - V0
+    0x50, 0x10,     // 214: SE V0, V1
+    0x73, 0x01,     // 216: V3 += 1
+    0x12, 0x04      // 218: JP 204
+};
+
+// BCD conversion and register store/load, the memory writers and readers.
+static const uint8_t ROM_MEMORY[] = {
+    0x65, 0x00,     // 200: V5 = 0
+    0xA3, 0x00,     // 202: I = 0x300
+    0xF5, 0x33,     // 204: BCD V5
+    0xF2, 0x65,     // 206: LD V0..V2, [I]
+    0xA3, 0x10,     // 208: I = 0x310
+    0xF3, 0x55,     // 20A: LD [I], V0..V3
+    0xF3, 0x1E,     // 20C: I += V3
+    0x75, 0x01,     // 20E: V5 += 1
+    0x12, 0x02      // 210: JP 202
+};
+
+// Busy waits on the delay timer and rolls a random number after every expiry.
+static const uint8_t ROM_TIMER[] = {
+    0x60, 0x02,     // 200: V0 = 2
+    0xF0, 0x15,     // 202: DT = V0
+    0xF1, 0x07,     // 204: V1 = DT
+    0x31, 0x00,     // 206: SE V1, 0
+    0x12, 0x04,     // 208: JP 204
+    0xC3, 0x0F,     // 20A: V3 = rand & 0x0F
+    0x72, 0x01,     // 20C: V2 += 1
+    0x12, 0x02      // 20E: JP 202
+};
+
+// Subroutine calls and keypad skips, the control flow heavy case.
+static const uint8_t ROM_CALLS[] = {
+    0x60, 0x00,     // 200: V0 = 0
+    0x22, 0x10,     // 202: CALL 210
+    0xE0, 0x9E,     // 204: SKP V0
+    0x70, 0x01,     // 206: V0 += 1
+    0xE0, 0xA1,     // 208: SKNP V0
+    0x70, 0x02,     // 20A: V0 += 2
+    0x12, 0x02,     // 20C: JP 202
+    0x00, 0x00,     // 20E: padding
+    0x81, 0x04,     // 210: V1 += V0
+    0x00, 0xEE      // 212: RET
+};
+
+// Patches the immediate of its own 7XNN every iteration, the decode cache has to drop that slot each time.
+static const uint8_t ROM_SELFMOD[] = {
+    0x62, 0x00,     // 200: V2 = 0
+    0xA2, 0x0B,     // 202: I = 0x20B       NN byte of the ADD below
+    0x72, 0x01,     // 204: V2 += 1
+    0x80, 0x20,     // 206: V0 = V2
+    0xF0, 0x55,     // 208: LD [I], V0
+    0x71, 0x00,     // 20A: V1 += NN        NN patched by the store above
+    0x63, 0x0F,     // 20C: V3 = 0x0F
+    0x83, 0x12,     // 20E: V3 &= V1
+    0xF3, 0x29,     // 210: I = font(V3)
+    0xD4, 0x55,     // 212: DRW V4, V5, 5
+    0x12, 0x02      // 214: JP 202
+};
+
+struct BenchRom {
+    const char* name;
+    const uint8_t* data;
+    size_t size;
+};
+
+static const BenchRom BENCH_ROMS[] = {
+    {"sprites", ROM_SPRITES, sizeof(ROM_SPRITES)},
+    {"arith",   ROM_ARITH,   sizeof(ROM_ARITH)},
+    {"memory",  ROM_MEMORY,  sizeof(ROM_MEMORY)},
+    {"timer",   ROM_TIMER,   sizeof(ROM_TIMER)},
+    {"calls",   ROM_CALLS,   sizeof(ROM_CALLS)},
+    {"selfmod", ROM_SELFMOD, sizeof(ROM_SELFMOD)},
+};
+
+#endif
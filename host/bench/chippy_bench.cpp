@@ -0,0 +1,168 @@
+#include "chippycore.h"
+#include "bench_roms.h"
+#include "bench_common.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+// Headless throughput benchmark: every bundled ROM under every quirk profile and execution engine,
+// reported as instructions/sec, frames/sec and ns/opcode. The framebuffer hash at the end of the run
+// must be identical for every engine of the same ROM/profile pair. Every engine but switch runs twice,
+// with the handlers specialized for the quirk profile ("spec") and with runtime quirk flags ("flags").
+// A profile without a specialization (wrap) runs with flags in both cases. --footprint adds the bytes
+// the instance held at the end of the run (ChippyCore::get_footprint()) to the notes.
+//
+//   chippy_bench [--frames N] [--ipf N] [--rom NAME] [--profile NAME] [--engine NAME] [--quirks spec|flags] [--footprint]
+
+struct BenchQuirkMode {
+    const char* name;
+    bool specialize;
+};
+
+static const BenchQuirkMode BENCH_QUIRK_MODES[] = {
+    {"spec",  true},
+    {"flags", false},
+};
+
+struct BenchOptions {
+    uint32_t frames = 600;
+    uint16_t ipf = 1000;
+    const char* rom = nullptr;
+    const char* profile = nullptr;
+    const char* engine = nullptr;
+    const char* quirks = nullptr;
+    bool footprint = false;
+};
+
+struct BenchResult {
+    uint64_t instructions = 0;
+    uint32_t frames = 0;
+    double seconds = 0;
+    uint32_t framebufferHash = 0;
+    bool specialized = false;
+    DecodeCacheStats cacheStats = {0, 0, 0};
+    BlockStats blockStats = {0, 0, 0, 0};
+    CoreFootprint footprint = {};
+};
+
+static BenchResult run_case(const BenchRom& rom, const BenchProfile& profile, const BenchEngine& engine,
+                            const BenchQuirkMode& quirks, const BenchOptions& options){
+    std::unique_ptr<ChippyCore> core(new ChippyCore());
+    core->set_engine(engine.engine);
+    core->set_quirk_specialization(quirks.specialize);
+    core->set_idle_skip(false);     // Times the engines, an idle loop would not run at all
+    core->load_and_run(rom.data, rom.size, nullptr, nullptr, nullptr, profile.config);
+
+    //Warm up caches and branch predictors before timing
+    for(uint32_t i = 0; i < 10 && core->isRunning(); i++){
+        core->run_frame(options.ipf);
+    }
+
+    BenchResult result;
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < options.frames && core->isRunning(); i++){
+        result.instructions += core->run_frame(options.ipf);
+        result.frames++;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.framebufferHash = hash_display(core->get_display_frame());
+    result.specialized = core->get_quirk_profile() != QuirkProfile::Runtime;
+    result.cacheStats = core->get_decode_cache_stats();
+    result.blockStats = core->get_block_stats();
+    result.footprint = core->get_footprint();
+    if(!core->isRunning()){
+        std::fprintf(stderr, "warning: %s/%s/%s stopped after %u frames\n", rom.name, profile.name, engine.name, result.frames);
+    }
+    return result;
+}
+
+static bool parse_options(int argc, char** argv, BenchOptions& options){
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--frames") && hasValue){
+            options.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            options.ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--rom") && hasValue){
+            options.rom = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--profile") && hasValue){
+            options.profile = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--engine") && hasValue){
+            options.engine = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--quirks") && hasValue){
+            options.quirks = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--footprint")){
+            options.footprint = true;
+        }
+        else{
+            std::fprintf(stderr, "usage: %s [--frames N] [--ipf N] [--rom NAME] [--profile NAME] [--engine NAME] [--quirks spec|flags] [--footprint]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv){
+    BenchOptions options;
+    if(!parse_options(argc, argv, options)){
+        return 1;
+    }
+
+    std::printf("%-10s %-8s %-8s %-6s %14s %12s %10s %10s  %s\n", "rom", "profile", "engine", "quirks", "instr/s", "frames/s", "ns/op", "fbhash", "notes");
+    for(const BenchRom& rom : BENCH_ROMS){
+        if(options.rom && strcmp(options.rom, rom.name)){
+            continue;
+        }
+        for(const BenchProfile& profile : BENCH_PROFILES){
+            if(options.profile && strcmp(options.profile, profile.name)){
+                continue;
+            }
+            for(const BenchEngine& engine : BENCH_ENGINES){
+                if(options.engine && strcmp(options.engine, engine.name)){
+                    continue;
+                }
+                for(const BenchQuirkMode& quirks : BENCH_QUIRK_MODES){
+                    if(options.quirks && strcmp(options.quirks, quirks.name)){
+                        continue;
+                    }
+                    //The switch engine always reads the flags, run it once
+                    if(engine.engine == ENGINE_SWITCH && quirks.specialize && !options.quirks){
+                        continue;
+                    }
+                    BenchResult result = run_case(rom, profile, engine, quirks, options);
+                    double seconds = result.seconds > 0 ? result.seconds : 1e-9;
+                    double nsPerOp = result.instructions ? (result.seconds * 1e9) / result.instructions : 0;
+                    std::printf("%-10s %-8s %-8s %-6s %14.0f %12.1f %10.2f   %08x", rom.name, profile.name, engine.name,
+                                result.specialized ? "spec" : "flags", result.instructions / seconds, result.frames / seconds,
+                                nsPerOp, result.framebufferHash);
+                    const DecodeCacheStats& stats = result.cacheStats;
+                    if(stats.hits + stats.misses){
+                        std::printf("  hit %.2f%% inval %u", 100.0 * stats.hits / (stats.hits + stats.misses), stats.invalidations);
+                    }
+                    const BlockStats& blocks = result.blockStats;
+                    if(blocks.translations){
+                        std::printf("  blocks %u fused %u inval %u flush %u", blocks.translations, blocks.superinstructions,
+                                    blocks.invalidations, blocks.flushes);
+                    }
+                    if(options.footprint){
+                        const CoreFootprint& bytes = result.footprint;
+                        std::printf("  instance %u (hot %u display %u) guest %u translation %u analysis %u history %u (load %u) total %u",
+                                    bytes.instance, bytes.hot_state, bytes.display, bytes.guest_memory, bytes.translation, bytes.analysis,
+                                    bytes.history, bytes.transient, bytes.total);
+                    }
+                    std::printf("\n");
+                }
+            }
+        }
+    }
+    return 0;
+}
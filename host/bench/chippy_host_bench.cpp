@@ -0,0 +1,193 @@
+#include "ChippyHost.h"
+#include "bench_roms.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+// Host integration benchmark: every bundled ROM runs headless through four integrations that do the
+// same work per frame (hash the changed rows, follow a keypad script):
+//   pixel     classic per-pixel and screen function pointers, the way ChippyCore.ino integrates
+//   present   the VBlank present callback, a function pointer called once per frame
+//   adapter   ChippyHost with the Callback* policies over the same function pointers
+//   policy    ChippyHost with policy structs the compiler inlines
+// The hash is the same for present, adapter and policy, pixel sees pixels instead of rows.
+//
+//   chippy_host_bench [--frames N] [--ipf N] [--rom NAME]
+
+struct HostOptions {
+    uint32_t frames = 3600;
+    uint16_t ipf = 200;
+    const char* rom = nullptr;
+};
+
+//Sink of all four integrations
+static uint32_t sinkHash = 2166136261u;
+
+static inline void mix(uint64_t value){
+    sinkHash = (sinkHash ^ static_cast<uint32_t>(value ^ (value >> 32))) * 16777619u;
+}
+
+static inline void hash_frame(const DisplayFrame& frame){
+    for(uint8_t row = 0; row < frame.height; row++){
+        if(frame.dirty_rows & (static_cast<uint64_t>(1) << row)){
+            for(uint8_t word = 0; word < frame.row_words; word++){
+                mix(frame.planes[0][row * frame.row_words + word] | frame.planes[1][row * frame.row_words + word]);
+            }
+        }
+    }
+}
+
+//Keypad script: one key at a time, held for 7 frames, then 7 frames without
+static inline uint16_t script_keys(uint32_t frame){
+    return (frame / 7) & 1 ? 0 : static_cast<uint16_t>(1 << ((frame / 14) & 0xF));
+}
+
+static uint32_t scriptFrame = 0;
+
+static void draw_pixel(const uint16_t x, const uint16_t y, bool& collision){
+    mix((static_cast<uint64_t>(x) << 8) | y);
+}
+
+static void screen(bool clearScreen, bool updateScreen){
+    mix(clearScreen | (updateScreen << 1));
+}
+
+static void present(const DisplayFrame& frame){
+    hash_frame(frame);
+}
+
+//Reports the script's key change of the frame like a loop callback does, one event per frame
+static void loop_callback(uint8_t& key, bool& keyState, bool& pause, bool& stop){
+    uint16_t before = scriptFrame ? script_keys(scriptFrame - 1) : 0;
+    uint16_t changed = before ^ script_keys(scriptFrame);
+    if(changed){
+        key = static_cast<uint8_t>(__builtin_ctz(changed));
+        keyState = script_keys(scriptFrame) & changed;
+    }
+}
+
+struct HashDisplay {
+    inline void present(const DisplayFrame& frame){
+        hash_frame(frame);
+    }
+};
+
+struct ScriptInput {
+    uint32_t frame = 0;
+    inline void poll(HostInput& input){
+        input.keys = script_keys(frame++);
+    }
+};
+
+struct NullClock {
+    inline uint32_t micros(){
+        return 0;
+    }
+    inline void idle(uint32_t){}
+};
+
+static const bool CONFIG[4] = {false, false, false, false};
+
+static uint64_t run_pixel(ChippyCore& core, const BenchRom& rom, const HostOptions& options){
+    core.load_and_run(rom.data, rom.size, draw_pixel, screen, nullptr, CONFIG);
+    core.set_random_seed(1);
+    uint64_t executed = 0;
+    for(uint32_t frame = 0; frame < options.frames && core.isRunning(); frame++){
+        core.set_keypad_mask(script_keys(frame));
+        executed += core.run_frame(options.ipf);
+    }
+    return executed;
+}
+
+static uint64_t run_present(ChippyCore& core, const BenchRom& rom, const HostOptions& options){
+    core.set_present_callback(present);
+    core.load_and_run(rom.data, rom.size, nullptr, nullptr, nullptr, CONFIG);
+    core.set_random_seed(1);
+    uint64_t executed = 0;
+    for(uint32_t frame = 0; frame < options.frames && core.isRunning(); frame++){
+        core.set_keypad_mask(script_keys(frame));
+        executed += core.run_frame(options.ipf);
+    }
+    return executed;
+}
+
+template<class Display, class Input>
+static uint64_t run_host(ChippyCore& core, Display& display, Input& input, const BenchRom& rom, const HostOptions& options){
+    NoAudio audio;
+    NullClock clock;
+    ChippyHost<Display, Input, NoAudio, NullClock> host(core, display, input, audio, clock);
+    host.set_speed(options.ipf);
+    host.load_and_run(rom.data, rom.size, CONFIG);
+    core.set_random_seed(1);
+    uint64_t executed = 0;
+    for(scriptFrame = 0; scriptFrame < options.frames && host.isRunning(); scriptFrame++){
+        executed += host.run_frame();
+    }
+    return executed;
+}
+
+static void report(const BenchRom& rom, const char* integration, uint64_t executed, double seconds, uint32_t frames){
+    std::printf("%-10s %-8s %12llu %10.1f %8.2f  %08x\n", rom.name, integration, static_cast<unsigned long long>(executed),
+                seconds * 1e9 / frames, executed ? seconds * 1e9 / executed : 0.0, sinkHash);
+}
+
+int main(int argc, char** argv){
+    HostOptions options;
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--frames") && hasValue){
+            options.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            options.ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--rom") && hasValue){
+            options.rom = argv[++i];
+        }
+        else{
+            std::fprintf(stderr, "usage: %s [--frames N] [--ipf N] [--rom NAME]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::printf("%-10s %-8s %12s %10s %8s  %-8s\n", "rom", "host", "instructions", "ns/frame", "ns/op", "hash");
+    for(const BenchRom& rom : BENCH_ROMS){
+        if(options.rom && strcmp(options.rom, rom.name)){
+            continue;
+        }
+        for(uint8_t integration = 0; integration < 4; integration++){
+            std::unique_ptr<ChippyCore> core(new ChippyCore());
+            core->set_engine(ENGINE_BLOCKS);
+            sinkHash = 2166136261u;
+            auto start = std::chrono::steady_clock::now();
+            uint64_t executed = 0;
+            const char* name = "";
+            if(integration == 0){
+                name = "pixel";
+                executed = run_pixel(*core, rom, options);
+            }
+            else if(integration == 1){
+                name = "present";
+                executed = run_present(*core, rom, options);
+            }
+            else if(integration == 2){
+                name = "adapter";
+                CallbackDisplay display = {present};
+                CallbackInput input = {loop_callback};
+                executed = run_host(*core, display, input, rom, options);
+            }
+            else{
+                name = "policy";
+                HashDisplay display;
+                ScriptInput input;
+                executed = run_host(*core, display, input, rom, options);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            report(rom, name, executed, seconds, options.frames);
+        }
+    }
+    return 0;
+}
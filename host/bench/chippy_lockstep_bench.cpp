@@ -0,0 +1,168 @@
+#include "lockstep_core.h"
+#include "batch_runner.h"
+#include "bench_roms.h"
+#include "bench_common.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Lockstep against scalar throughput: every bundled ROM under every quirk profile runs as N lanes of one
+// LockstepCore and as N separate ChippyCore instances on the same thread, with the same per-lane RNG
+// seed and keypad script. The profiles and --inputs scripts are the chippy_batch ones (bench_common.h),
+// so the lanes match batch jobs lane for lane. Reports the aggregate instructions/sec of both, the share of steps where all
+// lanes ran together, the average number of lane groups per step, and the lanes whose final state
+// differs from the scalar run (there must be none).
+//
+//   chippy_lockstep_bench [--lanes N] [--frames N] [--ipf N] [--seed N] [--inputs] [--rom NAME] [--profile NAME] [--engine NAME]
+
+struct LockstepOptions {
+    uint32_t lanes = 64;
+    uint32_t frames = 60;
+    uint16_t ipf = 1000;
+    uint32_t seed = 1;
+    bool inputs = false;
+    const char* rom = nullptr;
+    const char* profile = nullptr;
+    uint8_t engine = ENGINE_BLOCKS;
+};
+
+static bool same_cpu(const CpuState& a, const CpuState& b){
+    return a.PC == b.PC && a.INDEX == b.INDEX && a.SP == b.SP && a.DELAYTIMER == b.DELAYTIMER && a.SOUNDTIMER == b.SOUNDTIMER &&
+           !memcmp(a.STACK, b.STACK, sizeof(a.STACK)) && !memcmp(a.V, b.V, sizeof(a.V));
+}
+
+static bool parse_options(int argc, char** argv, LockstepOptions& options){
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--lanes") && hasValue){
+            options.lanes = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--frames") && hasValue){
+            options.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            options.ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--seed") && hasValue){
+            options.seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--inputs")){
+            options.inputs = true;
+        }
+        else if(!strcmp(argv[i], "--rom") && hasValue){
+            options.rom = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--profile") && hasValue){
+            options.profile = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--engine") && hasValue){
+            const char* name = argv[++i];
+            bool found = false;
+            for(const BenchEngine& engine : BENCH_ENGINES){
+                if(!strcmp(name, engine.name)){
+                    options.engine = engine.engine;
+                    found = true;
+                }
+            }
+            if(!found){
+                std::fprintf(stderr, "unknown engine %s\n", name);
+                return false;
+            }
+        }
+        else{
+            std::fprintf(stderr, "usage: %s [--lanes N] [--frames N] [--ipf N] [--seed N] [--inputs] [--rom NAME] [--profile NAME] [--engine NAME]\n", argv[0]);
+            return false;
+        }
+    }
+    return options.lanes > 0;
+}
+
+int main(int argc, char** argv){
+    LockstepOptions options;
+    if(!parse_options(argc, argv, options)){
+        return 1;
+    }
+
+    std::printf("lockstep kernels: %s, %u lanes\n", LockstepCore::simd_name(), options.lanes);
+    std::printf("%-10s %-8s %14s %14s %8s %9s %9s  %s\n", "rom", "profile", "lockstep/s", "scalar/s", "speedup", "uniform", "groups", "mismatches");
+    uint32_t totalMismatches = 0;
+    for(const BenchRom& rom : BENCH_ROMS){
+        if(options.rom && strcmp(options.rom, rom.name)){
+            continue;
+        }
+        for(const BenchProfile& profile : BENCH_PROFILES){
+            if(options.profile && strcmp(options.profile, profile.name)){
+                continue;
+            }
+            std::vector<std::vector<BatchInput>> scripts(options.lanes);
+            std::vector<BatchJob> jobs(options.lanes);
+            for(uint32_t lane = 0; lane < options.lanes; lane++){
+                BatchJob& job = jobs[lane];
+                job.rom = rom.data;
+                job.romSize = rom.size;
+                memcpy(job.config, profile.config, sizeof(job.config));
+                job.frames = options.frames;
+                job.instructionsPerFrame = options.ipf;
+                job.engine = options.engine;
+                job.seed = options.seed + lane;
+                if(options.inputs){
+                    scripts[lane] = random_script(job.seed, options.frames);
+                    job.inputs = scripts[lane].data();
+                    job.inputCount = scripts[lane].size();
+                }
+            }
+
+            //Scalar: one ChippyCore after the other
+            auto start = std::chrono::steady_clock::now();
+            std::vector<BatchResult> expected;
+            uint64_t scalarInstructions = 0;
+            for(const BatchJob& job : jobs){
+                expected.push_back(run_job(job));
+                scalarInstructions += expected.back().instructions;
+            }
+            double scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            //Lockstep: all lanes in one core
+            start = std::chrono::steady_clock::now();
+            LockstepCore core(options.lanes);
+            core.load(rom.data, rom.size, profile.config);
+            std::vector<size_t> nextInput(options.lanes, 0);
+            for(uint32_t lane = 0; lane < options.lanes; lane++){
+                core.seed_lane(lane, jobs[lane].seed);
+            }
+            uint64_t lockstepInstructions = 0;
+            for(uint32_t frame = 0; frame < options.frames; frame++){
+                for(uint32_t lane = 0; lane < options.lanes; lane++){
+                    const BatchJob& job = jobs[lane];
+                    while(nextInput[lane] < job.inputCount && job.inputs[nextInput[lane]].frame <= frame){
+                        core.set_keypad_mask(lane, job.inputs[nextInput[lane]].keys);
+                        nextInput[lane]++;
+                    }
+                }
+                lockstepInstructions += core.run_frame(options.ipf);
+            }
+            double lockstepSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            uint32_t mismatches = 0;
+            for(uint32_t lane = 0; lane < options.lanes; lane++){
+                if(hash_display(core.get_display_frame(lane)) != expected[lane].framebufferHash ||
+                   core.lane_instructions(lane) != expected[lane].instructions ||
+                   core.lane_running(lane) != expected[lane].running || !same_cpu(core.get_cpu_state(lane), expected[lane].cpu)){
+                    mismatches++;
+                }
+            }
+            totalMismatches += mismatches;
+
+            LockstepStats stats = core.get_stats();
+            double lockstepRate = lockstepInstructions / (lockstepSeconds > 0 ? lockstepSeconds : 1e-9);
+            double scalarRate = scalarInstructions / (scalarSeconds > 0 ? scalarSeconds : 1e-9);
+            std::printf("%-10s %-8s %14.0f %14.0f %7.2fx %8.1f%% %9.2f  %u\n", rom.name, profile.name, lockstepRate, scalarRate,
+                        scalarRate > 0 ? lockstepRate / scalarRate : 0, stats.steps ? 100.0 * stats.uniform_steps / stats.steps : 0,
+                        stats.steps ? static_cast<double>(stats.groups) / stats.steps : 0, mismatches);
+        }
+    }
+    return totalMismatches ? 2 : 0;
+}
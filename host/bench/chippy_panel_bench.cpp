@@ -0,0 +1,135 @@
+#include "chippycore.h"
+#include "chippypanel.h"
+#include "bench_roms.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+// Panel converter benchmark: every bundled ROM is presented through each panel converter. Reports the
+// bytes a panel would receive per present against a full frame transfer, the conversion time, and a
+// hash of everything written (addresses and data). The hash only changes when the converter output does.
+//
+//   chippy_panel_bench [--frames N] [--ipf N] [--rom NAME] [--panel NAME]
+
+struct BenchPanel {
+    const char* name;
+    uint16_t width;     // 0 for the SSD1306
+    uint16_t height;
+};
+
+static const BenchPanel BENCH_PANELS[] = {
+    {"ssd1306", 0,   0},
+    {"st7735",  160, 128},
+    {"ili9341", 320, 240},
+};
+
+struct PanelOptions {
+    uint32_t frames = 600;
+    uint16_t ipf = 1000;
+    const char* rom = nullptr;
+    const char* panel = nullptr;
+};
+
+struct PanelRun {
+    const BenchPanel* panel;
+    Ssd1306Converter oled;
+    std::unique_ptr<Rgb565Converter> lcd;
+    uint32_t presents = 0;
+    uint64_t bytes = 0;
+    uint64_t nanoseconds = 0;
+    uint32_t hash = 2166136261u;
+
+    void mix(const void* data, size_t size){
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for(size_t i = 0; i < size; i++){
+            hash = (hash ^ p[i]) * 16777619u;
+        }
+    }
+};
+
+static PanelRun* current = nullptr;
+
+static void present(const DisplayFrame& frame){
+    PanelRun& run = *current;
+    auto start = std::chrono::steady_clock::now();
+    if(run.lcd){
+        run.bytes += run.lcd->update(frame, [&](uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint16_t* line){
+            uint16_t window[4] = {x, y, width, height};
+            run.mix(window, sizeof(window));
+            run.mix(line, width * sizeof(uint16_t));
+        });
+    }
+    else{
+        run.bytes += run.oled.update(frame, [&](uint8_t page, uint8_t column, const uint8_t* data, uint8_t length){
+            uint8_t address[2] = {page, column};
+            run.mix(address, sizeof(address));
+            run.mix(data, length);
+        });
+    }
+    run.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    run.presents++;
+}
+
+static void run_case(const BenchRom& rom, const BenchPanel& panel, const PanelOptions& options){
+    static const bool config[4] = {false, false, false, false};
+    PanelRun run;
+    run.panel = &panel;
+    if(panel.width){
+        run.lcd.reset(new Rgb565Converter(panel.width, panel.height));
+    }
+    current = &run;
+    std::unique_ptr<ChippyCore> core(new ChippyCore());
+    core->set_engine(ENGINE_BLOCKS);
+    core->set_present_callback(present);
+    core->load_and_run(rom.data, rom.size, nullptr, nullptr, nullptr, config);
+    for(uint32_t frame = 0; frame < options.frames && core->isRunning(); frame++){
+        core->run_frame(options.ipf);
+    }
+    current = nullptr;
+
+    size_t fullFrame = panel.width ? static_cast<size_t>(panel.width) * panel.height * 2 : SSD1306_PAGES * SSD1306_WIDTH;
+    double perPresent = run.presents ? static_cast<double>(run.bytes) / run.presents : 0;
+    std::printf("%-10s %-8s %8u %12.1f %8.2f%% %10.0f  %08x\n", rom.name, panel.name, run.presents, perPresent,
+                100.0 * perPresent / fullFrame, run.presents ? static_cast<double>(run.nanoseconds) / run.presents : 0.0,
+                run.hash);
+}
+
+int main(int argc, char** argv){
+    PanelOptions options;
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--frames") && hasValue){
+            options.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            options.ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--rom") && hasValue){
+            options.rom = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--panel") && hasValue){
+            options.panel = argv[++i];
+        }
+        else{
+            std::fprintf(stderr, "usage: %s [--frames N] [--ipf N] [--rom NAME] [--panel NAME]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::printf("%-10s %-8s %8s %12s %9s %10s  %-8s\n", "rom", "panel", "presents", "bytes/pres", "of full", "ns/pres", "hash");
+    for(const BenchRom& rom : BENCH_ROMS){
+        if(options.rom && strcmp(options.rom, rom.name)){
+            continue;
+        }
+        for(const BenchPanel& panel : BENCH_PANELS){
+            if(options.panel && strcmp(options.panel, panel.name)){
+                continue;
+            }
+            run_case(rom, panel, options);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "chippyruntime.h"
+#include "bench_roms.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+// Throughput and latency of the threaded runtime against the single threaded loop. A display that
+// needs --display-us per frame (an SPI panel transfer) is simulated with a busy wait. Inline, that
+// time is taken from the emulator; threaded, it runs on the display thread.
+//
+//   chippy_runtime_bench [--seconds N] [--display-us N] [--ipf N] [--rom NAME] [--turbo]
+
+struct RuntimeOptions {
+    uint32_t seconds = 2;
+    uint32_t displayUs = 8000;
+    uint16_t ipf = 1000;
+    const char* rom = "sprites";
+    bool turbo = false;
+};
+
+static RuntimeOptions options;
+static uint32_t presentedFrames = 0;
+
+static void busy_wait(uint32_t us){
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    while(std::chrono::steady_clock::now() < end){
+    }
+}
+
+static void display_frame(const DisplayFrame& frame){
+    (void)frame;
+    busy_wait(options.displayUs);
+    presentedFrames++;
+}
+
+static void start_core(ChippyCore& core, const BenchRom& rom){
+    static const bool config[4] = {false, false, false, false};
+    core.set_engine(ENGINE_BLOCKS);
+    core.load_and_run(rom.data, rom.size, nullptr, nullptr, nullptr, config);
+    core.set_speed(options.ipf);
+    core.set_turbo(options.turbo);
+}
+
+static void run_inline(const BenchRom& rom){
+    std::unique_ptr<ChippyCore> core(new ChippyCore());
+    core->set_present_callback(display_frame);
+    start_core(*core, rom);
+
+    presentedFrames = 0;
+    uint64_t executed = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::seconds(options.seconds);
+    while(std::chrono::steady_clock::now() < end && core->isRunning()){
+        executed += core->run_for(RUNTIME_SLICE_US);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    SchedulerStats stats = core->get_scheduler_stats();
+    std::printf("%-9s %14.0f %10u %10u %10u %10s %10s\n", "inline", executed / seconds, stats.frames, presentedFrames,
+                stats.dropped_frames, "-", "-");
+}
+
+static void run_threaded(const BenchRom& rom){
+    std::unique_ptr<ChippyCore> core(new ChippyCore());
+    start_core(*core, rom);
+    ChippyRuntime runtime(*core);
+
+    presentedFrames = 0;
+    auto start = std::chrono::steady_clock::now();
+    if(!runtime.start(display_frame)){
+        std::fprintf(stderr, "runtime failed to start\n");
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    runtime.stop();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    RuntimeStats stats = runtime.get_stats();
+    SchedulerStats scheduler = core->get_scheduler_stats();
+    std::printf("%-9s %14.0f %10u %10u %10u %10u %10u\n", "threaded", stats.executed / seconds, stats.published,
+                presentedFrames, scheduler.dropped_frames + stats.skipped, stats.latency_avg_us, stats.latency_max_us);
+}
+
+static bool parse_options(int argc, char** argv){
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--seconds") && hasValue){
+            options.seconds = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--display-us") && hasValue){
+            options.displayUs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            options.ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--rom") && hasValue){
+            options.rom = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--turbo")){
+            options.turbo = true;
+        }
+        else{
+            std::fprintf(stderr, "usage: %s [--seconds N] [--display-us N] [--ipf N] [--rom NAME] [--turbo]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv){
+    if(!parse_options(argc, argv)){
+        return 1;
+    }
+    const BenchRom* rom = nullptr;
+    for(const BenchRom& candidate : BENCH_ROMS){
+        if(!strcmp(options.rom, candidate.name)){
+            rom = &candidate;
+        }
+    }
+    if(!rom){
+        std::fprintf(stderr, "unknown rom %s\n", options.rom);
+        return 1;
+    }
+
+    std::printf("%-9s %14s %10s %10s %10s %10s %10s\n", "mode", "instr/s", "frames", "presented", "dropped", "lat avg us", "lat max us");
+    run_inline(*rom);
+    run_threaded(*rom);
+    return 0;
+}
@@ -0,0 +1,257 @@
+#include "chippypanel.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Panel converter check: fixed lores, hires and two-plane frames go through both converters and every
+// write is compared byte for byte with the expected output below, worked out by hand from the panel
+// layouts. Covers the full resend after a resolution change, invalidate() and set_palette(), and the
+// narrowing of the dirty rows to the changed columns and spans. Run by ctest, exits 1 on a mismatch.
+//
+//   chippy_panel_check
+
+//A frame the tests draw into pixel by pixel
+struct CheckFrame {
+    uint64_t planes[DISPLAY_PLANES][FRAMEBUFFER_WORDS] = {};
+    uint8_t width = DISPLAY_WIDTH;
+    uint8_t height = DISPLAY_HEIGHT;
+    uint64_t dirty = 0;
+
+    void resize(uint8_t w, uint8_t h){
+        memset(planes, 0, sizeof(planes));
+        width = w;
+        height = h;
+        dirty = ~static_cast<uint64_t>(0);
+    }
+    void set(uint8_t plane, uint8_t x, uint8_t y){
+        planes[plane][y * (width / 64) + x / 64] |= static_cast<uint64_t>(1) << (63 - x % 64);
+        dirty |= static_cast<uint64_t>(1) << y;
+    }
+    //The frame as the core presents it, the dirty rows start over
+    DisplayFrame take(){
+        DisplayFrame frame = {{planes[0], planes[1]}, width, height, static_cast<uint8_t>(width / 64), dirty};
+        dirty = 0;
+        return frame;
+    }
+};
+
+//Every write of one update(): the address bytes, then the data
+static std::vector<uint8_t> written;
+static int failures = 0;
+
+static void expect(const char* name, const uint8_t* expected, size_t size){
+    if(written.size() != size || memcmp(written.data(), expected, size)){
+        std::printf("FAIL %s: %zu bytes written, %zu expected\n", name, written.size(), size);
+        failures++;
+    }
+    else{
+        std::printf("ok   %s\n", name);
+    }
+    written.clear();
+}
+
+static size_t update(Ssd1306Converter& oled, CheckFrame& frame){
+    return oled.update(frame.take(), [](uint8_t page, uint8_t column, const uint8_t* data, uint8_t length){
+        written.push_back(page);
+        written.push_back(column);
+        written.push_back(length);
+        written.insert(written.end(), data, data + length);
+    });
+}
+
+static size_t update(Rgb565Converter& lcd, CheckFrame& frame){
+    return lcd.update(frame.take(), [](uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint16_t* line){
+        uint16_t window[4] = {x, y, width, height};
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(window);
+        written.insert(written.end(), bytes, bytes + sizeof(window));
+        bytes = reinterpret_cast<const uint8_t*>(line);
+        written.insert(written.end(), bytes, bytes + width * sizeof(uint16_t));
+    });
+}
+
+//Expected write of a whole SSD1306 page, column 0 to 127
+static void full_page(std::vector<uint8_t>& out, uint8_t page, const uint8_t* columns){
+    out.push_back(page);
+    out.push_back(0);
+    out.push_back(SSD1306_WIDTH);
+    out.insert(out.end(), columns, columns + SSD1306_WIDTH);
+}
+
+//Expected RGB565 write, the pixels as the converter stores them (host byte order of the swapped colors)
+static void span(std::vector<uint8_t>& out, uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint16_t* line){
+    uint16_t window[4] = {x, y, width, height};
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(window);
+    out.insert(out.end(), bytes, bytes + sizeof(window));
+    bytes = reinterpret_cast<const uint8_t*>(line);
+    out.insert(out.end(), bytes, bytes + width * sizeof(uint16_t));
+}
+
+static void check_ssd1306(){
+    Ssd1306Converter oled;
+    CheckFrame frame;
+    const uint8_t blank[SSD1306_WIDTH] = {};
+    std::vector<uint8_t> expected;
+
+    //First update: all 8 pages, even though nothing is dirty
+    for(uint8_t page = 0; page < SSD1306_PAGES; page++){
+        full_page(expected, page, blank);
+    }
+    update(oled, frame);
+    expect("ssd1306 first update sends every page", expected.data(), expected.size());
+
+    //Lores pixels are 2x2: (0,0) is columns 0-1 rows 0-1 of page 0, (63,31) columns 126-127 rows 62-63
+    //of page 7. Only the changed columns of the two pages go out.
+    frame.set(0, 0, 0);
+    frame.set(1, 63, 31);
+    static const uint8_t LORES_CORNERS[] = {
+        0, 0, 2, 0x03, 0x03,
+        7, 126, 2, 0xC0, 0xC0,
+    };
+    update(oled, frame);
+    expect("ssd1306 lores corners, both planes", LORES_CORNERS, sizeof(LORES_CORNERS));
+
+    //(10,5) is columns 20-21 rows 10-11 of page 1, (13,5) columns 26-27: one span from 20 to 27
+    frame.set(0, 10, 5);
+    frame.set(0, 13, 5);
+    static const uint8_t LORES_SPAN[] = {1, 20, 8, 0x0C, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C};
+    update(oled, frame);
+    expect("ssd1306 lores span narrowed to changed columns", LORES_SPAN, sizeof(LORES_SPAN));
+
+    //A dirty row that ends up unchanged sends nothing
+    frame.dirty = static_cast<uint64_t>(1) << 5;
+    update(oled, frame);
+    expect("ssd1306 unchanged dirty row", nullptr, 0);
+
+    //Hires resends every page. (5,9) on plane 1 is column 5 bit 1 of page 1.
+    frame.resize(HIRES_WIDTH, HIRES_HEIGHT);
+    frame.set(1, 5, 9);
+    uint8_t page1[SSD1306_WIDTH] = {};
+    page1[5] = 0x02;
+    expected.clear();
+    for(uint8_t page = 0; page < SSD1306_PAGES; page++){
+        full_page(expected, page, page == 1 ? page1 : blank);
+    }
+    update(oled, frame);
+    expect("ssd1306 resize to hires resends every page", expected.data(), expected.size());
+    if(memcmp(oled.buffer() + SSD1306_WIDTH, page1, SSD1306_WIDTH)){
+        std::printf("FAIL ssd1306 buffer() after resize\n");
+        failures++;
+    }
+
+    //(127,63) is column 127 bit 7 of page 7, (0,8) and (0,15) column 0 bits 0 and 7 of page 1
+    frame.set(0, 127, 63);
+    frame.set(0, 0, 8);
+    frame.set(1, 0, 15);
+    static const uint8_t HIRES_PIXELS[] = {
+        1, 0, 1, 0x81,
+        7, 127, 1, 0x80,
+    };
+    update(oled, frame);
+    expect("ssd1306 hires pixels, both planes", HIRES_PIXELS, sizeof(HIRES_PIXELS));
+
+    //invalidate() resends every page as shown
+    page1[0] = 0x81;
+    uint8_t page7[SSD1306_WIDTH] = {};
+    page7[127] = 0x80;
+    expected.clear();
+    for(uint8_t page = 0; page < SSD1306_PAGES; page++){
+        full_page(expected, page, page == 1 ? page1 : page == 7 ? page7 : blank);
+    }
+    oled.invalidate();
+    update(oled, frame);
+    expect("ssd1306 invalidate resends every page", expected.data(), expected.size());
+}
+
+static void check_rgb565(){
+    //160x128 (ST7735): lores is scaled 2x at (16,32), hires 1x at (16,32)
+    Rgb565Converter lcd(160, 128);
+    CheckFrame frame;
+    //Default palette, byte swapped for SPI: 0x0000, 0xFFFF, 0xAD55 (plane 1) and 0x52AA (both planes)
+    const uint16_t C0 = 0x0000, C1 = 0xFFFF, C2 = 0x55AD, C3 = 0xAA52;
+    uint16_t line[160];
+    std::vector<uint8_t> expected;
+
+    //First update: the panel is cleared to color 0, then every row of the frame is sent
+    for(uint16_t& pixel : line){
+        pixel = C0;
+    }
+    span(expected, 0, 0, 160, 128, line);
+    for(uint8_t y = 0; y < DISPLAY_HEIGHT; y++){
+        span(expected, 16, 32 + y * 2, 128, 2, line);
+    }
+    size_t sent = update(lcd, frame);
+    expect("rgb565 first update clears and sends every row", expected.data(), expected.size());
+    if(lcd.scale() != 2 || sent != 160 * 128 * 2 + 32 * 128 * 2 * 2){
+        std::printf("FAIL rgb565 scale %u, %zu bytes counted\n", lcd.scale(), sent);
+        failures++;
+    }
+
+    //Pixels 5, 6 and 7 of row 3 in colors 1, 2 and 3. The span is rounded out to the 4 pixel group 4-7.
+    frame.set(0, 5, 3);
+    frame.set(1, 6, 3);
+    frame.set(0, 7, 3);
+    frame.set(1, 7, 3);
+    static const uint16_t GROUP[] = {C0, C0, C1, C1, C2, C2, C3, C3};
+    expected.clear();
+    span(expected, 16 + 4 * 2, 32 + 3 * 2, 8, 2, GROUP);
+    update(lcd, frame);
+    expect("rgb565 two planes, span narrowed to one group", expected.data(), expected.size());
+
+    //Changes at pixels 1 and 62 of row 0 span the groups 0 to 15 of the row
+    frame.set(0, 1, 0);
+    frame.set(0, 62, 0);
+    for(uint8_t x = 0; x < 64; x++){
+        line[x * 2] = line[x * 2 + 1] = (x == 1 || x == 62) ? C1 : C0;
+    }
+    expected.clear();
+    span(expected, 16, 32, 128, 2, line);
+    update(lcd, frame);
+    expect("rgb565 span from first to last changed group", expected.data(), expected.size());
+
+    //A dirty row that ends up unchanged sends nothing
+    frame.dirty = static_cast<uint64_t>(1) << 3;
+    update(lcd, frame);
+    expect("rgb565 unchanged dirty row", nullptr, 0);
+
+    //Hires: cleared again, then every row at 1x. (100,40) sits in the group 100-103 of row 40.
+    frame.resize(HIRES_WIDTH, HIRES_HEIGHT);
+    frame.set(1, 100, 40);
+    expected.clear();
+    for(uint16_t& pixel : line){
+        pixel = C0;
+    }
+    span(expected, 0, 0, 160, 128, line);
+    for(uint8_t y = 0; y < HIRES_HEIGHT; y++){
+        line[100] = y == 40 ? C2 : C0;
+        span(expected, 16, 32 + y, 128, 1, line);
+    }
+    update(lcd, frame);
+    expect("rgb565 resize to hires clears and resends every row", expected.data(), expected.size());
+
+    //A new palette clears with the new color 0 and resends the frame in the new colors
+    static const uint16_t PALETTE[4] = {0x001F, 0x07E0, 0xF800, 0xFFFF};
+    lcd.set_palette(PALETTE);
+    expected.clear();
+    for(uint16_t& pixel : line){
+        pixel = 0x1F00;
+    }
+    span(expected, 0, 0, 160, 128, line);
+    for(uint8_t y = 0; y < HIRES_HEIGHT; y++){
+        line[100] = y == 40 ? 0x00F8 : 0x1F00;
+        span(expected, 16, 32 + y, 128, 1, line);
+    }
+    update(lcd, frame);
+    expect("rgb565 set_palette clears and resends in the new colors", expected.data(), expected.size());
+}
+
+int main(){
+    check_ssd1306();
+    check_rgb565();
+    if(failures){
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include "chippycore.h"
+#include "../bench/bench_roms.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+// Runs a ROM headless under the debugger (chippydebug.h) and prints every stop: why, the registers and
+// the last opcodes with what they changed. After a stop the ROM runs on, at most --stops times. --step
+// single steps the first N opcodes. Needs the core built with CHIPPY_DEBUGGER (cmake -DCHIPPY_DEBUGGER=ON).
+//
+//   chippy_debug [--frames N] [--ipf N] [--break ADDR]... [--watch ADDR]... [--step N] [--stops N]
+//                [--trace N] (--rom NAME | ROM)
+
+struct DebugOptions {
+    uint32_t frames = 600;
+    uint16_t ipf = 1000;
+    uint32_t steps = 0;
+    uint32_t stops = 1;
+    uint16_t trace = 16;
+    std::vector<uint16_t> breakpoints;
+    std::vector<uint16_t> watchpoints;
+    const char* romName = nullptr;
+    const char* romFile = nullptr;
+};
+
+static const char* const STOP_NAMES[] = {"running", "breakpoint", "watchpoint", "step", "request", "error"};
+
+static bool read_file(const char* file, std::vector<uint8_t>& data){
+    std::ifstream stream(file, std::ios::binary);
+    if(!stream){
+        std::fprintf(stderr, "cannot read %s\n", file);
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static void print_error(const ErrorReport& error){
+    std::printf("error %u at 0x%03X opcode %04X\n", error.code, error.cpu.PC, error.opcode);
+}
+
+static void print_record(const TraceRecord& record){
+    std::printf("  0x%03X  %04X  I=%03X SP=%u VX=%02X VF=%02X", record.pc, record.opcode, record.index, record.sp,
+                record.vx, record.vf);
+    if(record.changed){
+        std::printf("  changed");
+        for(uint8_t reg = 0; reg < MAX_16; reg++){
+            if(record.changed & (1 << reg)){
+                std::printf(" V%X", reg);
+            }
+        }
+    }
+    if(record.flags & TRACE_INDEX){
+        std::printf("  I");
+    }
+    if(record.flags & TRACE_WRITE){
+        std::printf("  write");
+    }
+    std::printf("\n");
+}
+
+static void print_stop(const ChippyCore& core, const ChippyDebugger& debugger, uint32_t frame, uint16_t traceLength){
+    const DebugStop& stop = debugger.stopped();
+    std::printf("frame %u: %s at 0x%03X", frame, STOP_NAMES[stop.reason], stop.pc);
+    if(stop.reason == DEBUG_WATCHPOINT){
+        std::printf(", 0x%03X %02X -> %02X", stop.address, stop.old_value, stop.new_value);
+    }
+    else if(stop.reason == DEBUG_ERROR){
+        std::printf(", error %u", stop.error);
+    }
+    std::printf("\n");
+
+    CpuState cpu = core.get_cpu_state();
+    std::printf("  PC=%03X I=%03X SP=%u DT=%u ST=%u\n  V ", cpu.PC, cpu.INDEX, cpu.SP, cpu.DELAYTIMER, cpu.SOUNDTIMER);
+    for(uint8_t reg = 0; reg < MAX_16; reg++){
+        std::printf(" %02X", cpu.V[reg]);
+    }
+    std::printf("\n  stack");
+    for(uint8_t depth = 0; depth < cpu.SP; depth++){
+        std::printf(" %03X", cpu.STACK[depth]);
+    }
+    std::printf("\n");
+
+    uint16_t records = debugger.trace_count() < traceLength ? debugger.trace_count() : traceLength;
+    for(uint16_t age = records; age > 0; age--){
+        print_record(debugger.trace(age - 1));
+    }
+}
+
+static void usage(const char* program){
+    std::fprintf(stderr, "usage: %s [--frames N] [--ipf N] [--break ADDR]... [--watch ADDR]... [--step N] [--stops N]\n"
+                         "       [--trace N] (--rom NAME | ROM)\n", program);
+}
+
+int main(int argc, char** argv){
+    DebugOptions options;
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--frames") && hasValue){
+            options.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            options.ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--break") && hasValue){
+            options.breakpoints.push_back(static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0)));
+        }
+        else if(!strcmp(argv[i], "--watch") && hasValue){
+            options.watchpoints.push_back(static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0)));
+        }
+        else if(!strcmp(argv[i], "--step") && hasValue){
+            options.steps = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--stops") && hasValue){
+            options.stops = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--trace") && hasValue){
+            options.trace = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--rom") && hasValue){
+            options.romName = argv[++i];
+        }
+        else if(argv[i][0] != '-' && !options.romFile){
+            options.romFile = argv[i];
+        }
+        else{
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> rom;
+    if(options.romFile){
+        if(!read_file(options.romFile, rom)){
+            return 1;
+        }
+    }
+    else if(options.romName){
+        for(const BenchRom& bench : BENCH_ROMS){
+            if(!strcmp(bench.name, options.romName)){
+                rom.assign(bench.data, bench.data + bench.size);
+            }
+        }
+        if(rom.empty()){
+            std::fprintf(stderr, "unknown bench ROM %s\n", options.romName);
+            return 1;
+        }
+    }
+    else{
+        usage(argv[0]);
+        return 1;
+    }
+
+    static const bool config[4] = {false, false, false, false};
+    std::unique_ptr<ChippyCore> core(new ChippyCore());
+    std::unique_ptr<ChippyDebugger> debugger(new ChippyDebugger());
+    for(uint16_t address : options.breakpoints){
+        debugger->set_breakpoint(address);
+    }
+    for(uint16_t address : options.watchpoints){
+        debugger->set_watchpoint(address);
+    }
+    core->set_error_callback(print_error);
+    core->set_debugger(debugger.get());
+    core->load_and_run(rom.data(), rom.size(), nullptr, nullptr, nullptr, config);
+    core->set_random_seed(1);
+
+    if(options.steps){
+        std::printf("stepping %u opcodes\n", options.steps);
+        for(uint32_t step = 0; step < options.steps && core->isRunning(); step++){
+            debugger->step();
+            core->run_instructions(1);
+            print_record(debugger->trace(0));
+        }
+        debugger->resume();
+    }
+
+    uint32_t stops = 0;
+    uint32_t frame = 0;
+    while(frame < options.frames && core->isRunning()){
+        core->run_frame(options.ipf);
+        if(!debugger->is_stopped()){
+            frame++;
+            continue;
+        }
+        print_stop(*core, *debugger, frame, options.trace);
+        if(++stops >= options.stops){
+            break;
+        }
+        debugger->resume();
+    }
+    if(!stops){
+        std::printf("no stop in %u frames\n", frame);
+    }
+    return 0;
+}
@@ -0,0 +1,804 @@
+#include "lockstep_core.h"
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Byte vector primitives the kernels are written in. One LaneVec holds register Vx (or a timer) of
+// LANE_VEC_BYTES consecutive lanes. Masks are 0xFF/0x00 per lane. The scalar fallback is one lane wide.
+#if defined(__AVX2__)
+typedef __m256i LaneVec;
+#define LANE_VEC_BYTES 32
+static inline LaneVec vload(const uint8_t* p){ return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+static inline void vstore(uint8_t* p, LaneVec v){ _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+static inline LaneVec vset1(uint8_t b){ return _mm256_set1_epi8(static_cast<char>(b)); }
+static inline LaneVec vadd(LaneVec a, LaneVec b){ return _mm256_add_epi8(a, b); }
+static inline LaneVec vsub(LaneVec a, LaneVec b){ return _mm256_sub_epi8(a, b); }
+static inline LaneVec vsubs(LaneVec a, LaneVec b){ return _mm256_subs_epu8(a, b); }
+static inline LaneVec vand(LaneVec a, LaneVec b){ return _mm256_and_si256(a, b); }
+static inline LaneVec vor(LaneVec a, LaneVec b){ return _mm256_or_si256(a, b); }
+static inline LaneVec vxor(LaneVec a, LaneVec b){ return _mm256_xor_si256(a, b); }
+static inline LaneVec vandnot(LaneVec a, LaneVec b){ return _mm256_andnot_si256(a, b); }
+static inline LaneVec veq(LaneVec a, LaneVec b){ return _mm256_cmpeq_epi8(a, b); }
+static inline LaneVec vmin(LaneVec a, LaneVec b){ return _mm256_min_epu8(a, b); }
+static inline LaneVec vmax(LaneVec a, LaneVec b){ return _mm256_max_epu8(a, b); }
+static inline LaneVec vshr1(LaneVec a){ return _mm256_and_si256(_mm256_srli_epi16(a, 1), vset1(0x7F)); }
+static inline LaneVec vshr7(LaneVec a){ return _mm256_and_si256(_mm256_srli_epi16(a, 7), vset1(0x01)); }
+#elif defined(__SSE2__)
+typedef __m128i LaneVec;
+#define LANE_VEC_BYTES 16
+static inline LaneVec vload(const uint8_t* p){ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+static inline void vstore(uint8_t* p, LaneVec v){ _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+static inline LaneVec vset1(uint8_t b){ return _mm_set1_epi8(static_cast<char>(b)); }
+static inline LaneVec vadd(LaneVec a, LaneVec b){ return _mm_add_epi8(a, b); }
+static inline LaneVec vsub(LaneVec a, LaneVec b){ return _mm_sub_epi8(a, b); }
+static inline LaneVec vsubs(LaneVec a, LaneVec b){ return _mm_subs_epu8(a, b); }
+static inline LaneVec vand(LaneVec a, LaneVec b){ return _mm_and_si128(a, b); }
+static inline LaneVec vor(LaneVec a, LaneVec b){ return _mm_or_si128(a, b); }
+static inline LaneVec vxor(LaneVec a, LaneVec b){ return _mm_xor_si128(a, b); }
+static inline LaneVec vandnot(LaneVec a, LaneVec b){ return _mm_andnot_si128(a, b); }
+static inline LaneVec veq(LaneVec a, LaneVec b){ return _mm_cmpeq_epi8(a, b); }
+static inline LaneVec vmin(LaneVec a, LaneVec b){ return _mm_min_epu8(a, b); }
+static inline LaneVec vmax(LaneVec a, LaneVec b){ return _mm_max_epu8(a, b); }
+static inline LaneVec vshr1(LaneVec a){ return _mm_and_si128(_mm_srli_epi16(a, 1), vset1(0x7F)); }
+static inline LaneVec vshr7(LaneVec a){ return _mm_and_si128(_mm_srli_epi16(a, 7), vset1(0x01)); }
+#else
+typedef uint8_t LaneVec;
+#define LANE_VEC_BYTES 1
+static inline LaneVec vload(const uint8_t* p){ return *p; }
+static inline void vstore(uint8_t* p, LaneVec v){ *p = v; }
+static inline LaneVec vset1(uint8_t b){ return b; }
+static inline LaneVec vadd(LaneVec a, LaneVec b){ return a + b; }
+static inline LaneVec vsub(LaneVec a, LaneVec b){ return a - b; }
+static inline LaneVec vsubs(LaneVec a, LaneVec b){ return a > b ? a - b : 0; }
+static inline LaneVec vand(LaneVec a, LaneVec b){ return a & b; }
+static inline LaneVec vor(LaneVec a, LaneVec b){ return a | b; }
+static inline LaneVec vxor(LaneVec a, LaneVec b){ return a ^ b; }
+static inline LaneVec vandnot(LaneVec a, LaneVec b){ return ~a & b; }
+static inline LaneVec veq(LaneVec a, LaneVec b){ return a == b ? 0xFF : 0x00; }
+static inline LaneVec vmin(LaneVec a, LaneVec b){ return a < b ? a : b; }
+static inline LaneVec vmax(LaneVec a, LaneVec b){ return a > b ? a : b; }
+static inline LaneVec vshr1(LaneVec a){ return a >> 1; }
+static inline LaneVec vshr7(LaneVec a){ return a >> 7; }
+#endif
+
+static inline LaneVec vblend(LaneVec mask, LaneVec a, LaneVec b){ return vor(vand(mask, a), vandnot(mask, b)); }
+
+// dst = op(i) in the lanes of mask, everything else keeps its value. op loads what it needs from the
+// lane arrays at offset i, it runs before dst is read back so dst may be one of its sources.
+template<typename Op>
+static inline void vector_kernel(uint32_t stride, const uint8_t* mask, uint8_t* dst, Op op){
+    for (uint32_t i = 0; i < stride; i += LANE_VEC_BYTES) {
+        LaneVec value = op(i);
+        vstore(dst + i, vblend(vload(mask + i), value, vload(dst + i)));
+    }
+}
+
+template<typename Op>
+static inline void condition_kernel(uint32_t stride, uint8_t* condition, Op op){
+    for (uint32_t i = 0; i < stride; i += LANE_VEC_BYTES) {
+        vstore(condition + i, op(i));
+    }
+}
+
+#define LOCKSTEP_ADDRESS_MASK (RAM_SIZE - 1)
+
+LockstepCore::LockstepCore(uint32_t lanes)
+    : _lanes(lanes),
+      _stride((std::max<uint32_t>(lanes, 1) + LOCKSTEP_LANE_ALIGN - 1) / LOCKSTEP_LANE_ALIGN * LOCKSTEP_LANE_ALIGN),
+      V(MAX_16 * _stride), STACK(MAX_16 * _stride), PC(_stride), INDEX(_stride), SP(_stride),
+      DELAYTIMER(_stride), SOUNDTIMER(_stride), RAM(static_cast<size_t>(_stride) * RAM_SIZE),
+      displays(_stride), keys(_stride), fx0a_key(_stride),
+      random(_stride), active(_stride), group(_stride), pending(_stride), condition(_stride), frame_mask(_stride),
+      stopped_at(_stride), code_written(RAM_SIZE),
+      quirk4(false), quirk5(false), quirk6(false), quirk11(false), running(0), uniform(false), shared_pc(0),
+      _stats{0, 0, 0, 0, 0} {
+}
+
+bool LockstepCore::load(const uint8_t* data, size_t dataSize, const bool* config){
+    if (dataSize > (RAM_SIZE - ROM_START_ADDRESS)) {
+        return false;
+    }
+    quirk4 = config[0];
+    quirk5 = config[1];
+    quirk6 = config[2];
+    quirk11 = config[3];
+
+    std::fill(V.begin(), V.end(), 0);
+    std::fill(STACK.begin(), STACK.end(), 0);
+    std::fill(PC.begin(), PC.end(), ROM_START_ADDRESS);
+    std::fill(INDEX.begin(), INDEX.end(), 0);
+    std::fill(SP.begin(), SP.end(), 0);
+    std::fill(DELAYTIMER.begin(), DELAYTIMER.end(), 0);
+    std::fill(SOUNDTIMER.begin(), SOUNDTIMER.end(), 0);
+    for (ChippyDisplay& display : displays) {
+        display.reset();
+    }
+    std::fill(keys.begin(), keys.end(), 0);
+    std::fill(fx0a_key.begin(), fx0a_key.end(), NO_KEY);
+    std::fill(stopped_at.begin(), stopped_at.end(), 0);
+    std::fill(code_written.begin(), code_written.end(), 0);
+
+    //Every lane, padding included, starts from the same image so unwritten addresses read the same everywhere
+    uint8_t* image = RAM.data();
+    memset(image, 0, RAM_SIZE);
+    memcpy(image + FONTSET_START_ADDRESS, FONTSET, sizeof(FONTSET));
+    memcpy(image + BIG_FONTSET_START_ADDRESS, BIG_FONTSET, sizeof(BIG_FONTSET));
+    memcpy(image + ROM_START_ADDRESS, data, dataSize);
+    for (uint32_t lane = 1; lane < _stride; lane++) {
+        memcpy(image + static_cast<size_t>(lane) * RAM_SIZE, image, RAM_SIZE);
+    }
+
+    for (uint32_t lane = 0; lane < _stride; lane++) {
+        active[lane] = lane < _lanes ? 0xFF : 0x00;
+    }
+    running = _lanes;
+    uniform = true;
+    shared_pc = ROM_START_ADDRESS;
+    _stats = {0, 0, 0, 0, 0};
+    return true;
+}
+
+void LockstepCore::seed_lane(uint32_t lane, uint32_t seed){
+    random[lane].seed(seed);
+}
+
+void LockstepCore::set_keypad_mask(uint32_t lane, uint16_t mask){
+    keys[lane] = mask;
+}
+
+uint32_t LockstepCore::lanes() const{
+    return _lanes;
+}
+
+bool LockstepCore::lane_running(uint32_t lane) const{
+    return active[lane] != 0;
+}
+
+uint64_t LockstepCore::lane_instructions(uint32_t lane) const{
+    return active[lane] ? _stats.steps : stopped_at[lane];
+}
+
+CpuState LockstepCore::get_cpu_state(uint32_t lane) const{
+    CpuState state;
+    state.PC = PC[lane];
+    state.INDEX = INDEX[lane];
+    for (uint8_t level = 0; level < MAX_16; level++) {
+        state.STACK[level] = STACK[level * _stride + lane];
+        state.V[level] = V[level * _stride + lane];
+    }
+    state.SP = SP[lane];
+    state.DELAYTIMER = DELAYTIMER[lane];
+    state.SOUNDTIMER = SOUNDTIMER[lane];
+    return state;
+}
+
+const uint64_t* LockstepCore::get_framebuffer(uint32_t lane) const{
+    return displays[lane].planes[0];
+}
+
+DisplayFrame LockstepCore::get_display_frame(uint32_t lane) const{
+    return displays[lane].frame();
+}
+
+LockstepStats LockstepCore::get_stats() const{
+    return _stats;
+}
+
+const char* LockstepCore::simd_name(){
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+uint64_t LockstepCore::run_frame(uint16_t instructionsPerFrame){
+    uint64_t executed = 0;
+    memcpy(frame_mask.data(), active.data(), _stride);
+    for (uint16_t i = 0; i < instructionsPerFrame && running; i++) {
+        executed += running;
+        step();
+    }
+    tick_timers(frame_mask.data());
+    return executed;
+}
+
+// Like ChippyCore::tick_timers(): both timers stop at zero
+void LockstepCore::tick_timers(const uint8_t* mask){
+    LaneVec one = vset1(1);
+    vector_kernel(_stride, mask, DELAYTIMER.data(), [&](uint32_t i){ return vsubs(vload(DELAYTIMER.data() + i), one); });
+    vector_kernel(_stride, mask, SOUNDTIMER.data(), [&](uint32_t i){ return vsubs(vload(SOUNDTIMER.data() + i), one); });
+}
+
+uint16_t LockstepCore::fetch(uint32_t lane) const{
+    const uint8_t* ram = RAM.data() + static_cast<size_t>(lane) * RAM_SIZE;
+    uint16_t address = PC[lane] & LOCKSTEP_ADDRESS_MASK;
+    return (ram[address] << 8) | ram[(address + 1) & LOCKSTEP_ADDRESS_MASK];
+}
+
+// Any written address may hold different bytes per lane from now on, so fetches there compare the lanes
+void LockstepCore::write_memory(uint32_t lane, uint16_t address, uint8_t value){
+    address &= LOCKSTEP_ADDRESS_MASK;
+    RAM[static_cast<size_t>(lane) * RAM_SIZE + address] = value;
+    code_written[address] = 1;
+}
+
+void LockstepCore::stop_lane(uint32_t lane){
+    active[lane] = 0;
+    stopped_at[lane] = _stats.steps;
+    running--;
+}
+
+bool LockstepCore::key_pressed(uint32_t lane, uint8_t key) const{
+    return key < MAX_16 && (keys[lane] >> key) & 1;
+}
+
+// One opcode on every running lane. While uniform the opcode comes straight from the shared image,
+// otherwise the lanes are split by PC and opcode: up to LOCKSTEP_MAX_GROUPS groups run masked kernels,
+// whatever is left after that runs one lane at a time.
+void LockstepCore::step(){
+    _stats.steps++;
+    _stats.groups++;
+    uint16_t address = shared_pc & LOCKSTEP_ADDRESS_MASK;
+    uint16_t next = (address + 1) & LOCKSTEP_ADDRESS_MASK;
+    if (uniform && !code_written[address] && !code_written[next]) {
+        _stats.uniform_steps++;
+        uniform = execute_group((RAM[address] << 8) | RAM[next], active.data());
+        return;
+    }
+
+    memcpy(pending.data(), active.data(), _stride);
+    uint16_t opcode;
+    uint32_t others = regroup(opcode);
+    if (!others) {
+        _stats.uniform_steps++;
+    }
+    uint64_t vectorOps = _stats.vector_ops;
+    uniform = execute_group(opcode, group.data()) && !others;
+    //Another group only pays off while the groups hit vector kernels, lane by lane opcodes run as fast alone
+    for (uint32_t groups = 1; others && groups < LOCKSTEP_MAX_GROUPS && _stats.vector_ops != vectorOps; groups++) {
+        _stats.groups++;
+        vectorOps = _stats.vector_ops;
+        others = regroup(opcode);
+        execute_group(opcode, group.data());
+    }
+    if (others) {
+        for (uint32_t lane = 0; lane < _stride; lane++) {
+            if (pending[lane] && active[lane]) {
+                execute_lane(lane, fetch(lane));
+            }
+        }
+    }
+}
+
+// Takes the pending lanes that share the first pending lane's PC and opcode out of pending and marks
+// them in group, returns how many pending lanes are left
+uint32_t LockstepCore::regroup(uint16_t& opcode){
+    uint32_t leader = 0;
+    while (!pending[leader]) {
+        leader++;
+    }
+    shared_pc = PC[leader];
+    opcode = fetch(leader);
+    uint16_t address = shared_pc & LOCKSTEP_ADDRESS_MASK;
+    bool compare = code_written[address] || code_written[(address + 1) & LOCKSTEP_ADDRESS_MASK];
+
+    uint32_t others = 0;
+    if (compare) {
+        for (uint32_t lane = 0; lane < _stride; lane++) {
+            bool member = pending[lane] && PC[lane] == shared_pc && fetch(lane) == opcode;
+            group[lane] = member ? 0xFF : 0x00;
+            pending[lane] = member ? 0x00 : pending[lane];
+            others += pending[lane] != 0;
+        }
+        return others;
+    }
+    //Branch free so the compiler vectorizes it, this runs for every group of a divergent step
+    uint16_t pc = shared_pc;
+    for (uint32_t lane = 0; lane < _stride; lane++) {
+        uint8_t member = pending[lane] & (PC[lane] == pc ? 0xFF : 0x00);
+        group[lane] = member;
+        pending[lane] &= ~member;
+        others += pending[lane] >> 7;
+    }
+    return others;
+}
+
+void LockstepCore::set_group_pc(const uint8_t* mask, uint16_t pc){
+    for (uint32_t lane = 0; lane < _stride; lane++) {
+        PC[lane] = mask[lane] ? pc : PC[lane];
+    }
+    shared_pc = pc;
+}
+
+// PC += 4 where the condition holds, += 2 elsewhere. True when the whole group went the same way.
+bool LockstepCore::skip_group_pc(const uint8_t* mask){
+    uint16_t pc = shared_pc;
+    uint8_t taken = 0;
+    for (uint32_t lane = 0; lane < _stride; lane++) {
+        if (mask[lane]) {
+            bool skip = condition[lane] != 0;
+            PC[lane] = pc + (skip ? 4 : 2);
+            taken |= skip ? 1 : 2;
+        }
+    }
+    shared_pc = pc + (taken == 1 ? 4 : 2);
+    return taken != 3;
+}
+
+// Runs opcode on the lanes of mask, all of them at shared_pc. Register and timer opcodes, skips and jumps
+// are vector kernels, the rest runs lane by lane. Returns true when the group ends up at one PC again,
+// which is then in shared_pc.
+bool LockstepCore::execute_group(uint16_t opcode, const uint8_t* mask){
+    uint8_t X = (opcode & 0x0F00) >> MAX_8;
+    uint8_t Y = (opcode & 0x00F0) >> 4;
+    uint8_t* vx = V.data() + X * _stride;
+    uint8_t* vy = V.data() + Y * _stride;
+    uint8_t* vf = V.data() + 0xF * _stride;
+    LaneVec nn = vset1(opcode & 0x00FF);
+    LaneVec one = vset1(1);
+    LaneVec ones = vset1(0xFF);
+    uint16_t next = shared_pc + 2;
+
+    switch (opcode & 0xF000) {
+        case 0x1000:
+            set_group_pc(mask, opcode & 0x0FFF);
+            _stats.vector_ops++;
+            return true;
+        case 0x3000:
+            condition_kernel(_stride, condition.data(), [&](uint32_t i){ return veq(vload(vx + i), nn); });
+            _stats.vector_ops++;
+            return skip_group_pc(mask);
+        case 0x4000:
+            condition_kernel(_stride, condition.data(), [&](uint32_t i){ return vxor(veq(vload(vx + i), nn), ones); });
+            _stats.vector_ops++;
+            return skip_group_pc(mask);
+        case 0x5000:
+            condition_kernel(_stride, condition.data(), [&](uint32_t i){ return veq(vload(vx + i), vload(vy + i)); });
+            _stats.vector_ops++;
+            return skip_group_pc(mask);
+        case 0x9000:
+            condition_kernel(_stride, condition.data(), [&](uint32_t i){ return vxor(veq(vload(vx + i), vload(vy + i)), ones); });
+            _stats.vector_ops++;
+            return skip_group_pc(mask);
+        case 0x6000:
+            vector_kernel(_stride, mask, vx, [&](uint32_t){ return nn; });
+            break;
+        case 0x7000:
+            vector_kernel(_stride, mask, vx, [&](uint32_t i){ return vadd(vload(vx + i), nn); });
+            break;
+        case 0x8000:
+            //VF is written before Vx like in executeOpcode(), every kernel reloads its sources so X or Y == F matches
+            switch (opcode & 0x000F) {
+                case 0x0:
+                    vector_kernel(_stride, mask, vx, [&](uint32_t i){ return vload(vy + i); });
+                break;
+                case 0x1:
+                case 0x2:
+                case 0x3: {
+                    uint8_t op = opcode & 0x000F;
+                    vector_kernel(_stride, mask, vx, [&](uint32_t i){
+                        LaneVec x = vload(vx + i);
+                        LaneVec y = vload(vy + i);
+                        return op == 1 ? vor(x, y) : op == 2 ? vand(x, y) : vxor(x, y);
+                    });
+                    if (quirk4) {
+                        vector_kernel(_stride, mask, vf, [&](uint32_t){ return vset1(0); });
+                    }
+                }
+                break;
+                case 0x4:
+                    vector_kernel(_stride, mask, vf, [&](uint32_t i){
+                        LaneVec x = vload(vx + i);
+                        LaneVec sum = vadd(x, vload(vy + i));
+                        return vandnot(veq(vmax(sum, x), sum), one);    //carry when the sum wrapped below x
+                    });
+                    vector_kernel(_stride, mask, vx, [&](uint32_t i){ return vadd(vload(vx + i), vload(vy + i)); });
+                break;
+                case 0x5:
+                    vector_kernel(_stride, mask, vf, [&](uint32_t i){
+                        LaneVec x = vload(vx + i);
+                        return vandnot(veq(vmin(x, vload(vy + i)), x), one);   //x > y
+                    });
+                    vector_kernel(_stride, mask, vx, [&](uint32_t i){ return vsub(vload(vx + i), vload(vy + i)); });
+                break;
+                case 0x7:
+                    vector_kernel(_stride, mask, vf, [&](uint32_t i){
+                        LaneVec y = vload(vy + i);
+                        return vandnot(veq(vmin(vload(vx + i), y), y), one);   //y > x
+                    });
+                    vector_kernel(_stride, mask, vx, [&](uint32_t i){ return vsub(vload(vy + i), vload(vx + i)); });
+                break;
+                case 0x6: {
+                    uint8_t* source = quirk5 ? vx : vy;
+                    vector_kernel(_stride, mask, vf, [&](uint32_t i){ return vand(vload(source + i), one); });
+                    vector_kernel(_stride, mask, vx, [&](uint32_t i){ return vshr1(vload(source + i)); });
+                }
+                break;
+                case 0xE: {
+                    uint8_t* source = quirk5 ? vx : vy;
+                    vector_kernel(_stride, mask, vf, [&](uint32_t i){ return vshr7(vload(source + i)); });
+                    vector_kernel(_stride, mask, vx, [&](uint32_t i){
+                        LaneVec value = vload(source + i);
+                        return vadd(value, value);
+                    });
+                }
+                break;
+                default:
+                    return execute_lanes(opcode, mask);
+            }
+        break;
+        case 0xA000:
+            for (uint32_t lane = 0; lane < _stride; lane++) {
+                INDEX[lane] = mask[lane] ? (opcode & 0x0FFF) : INDEX[lane];
+            }
+        break;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x07:
+                    vector_kernel(_stride, mask, vx, [&](uint32_t i){ return vload(DELAYTIMER.data() + i); });
+                break;
+                case 0x15:
+                    vector_kernel(_stride, mask, DELAYTIMER.data(), [&](uint32_t i){ return vload(vx + i); });
+                break;
+                case 0x18:
+                    vector_kernel(_stride, mask, SOUNDTIMER.data(), [&](uint32_t i){ return vload(vx + i); });
+                break;
+                default:
+                    return execute_lanes(opcode, mask);
+            }
+        break;
+        default:
+            return execute_lanes(opcode, mask);
+    }
+    set_group_pc(mask, next);
+    _stats.vector_ops++;
+    return true;
+}
+
+// The opcodes without a kernel: decoded once, executed per lane. Those that always continue at the same
+// address (unless the lane stops) keep the group together.
+bool LockstepCore::execute_lanes(uint16_t opcode, const uint8_t* mask){
+    for (uint32_t lane = 0; lane < _stride; lane++) {
+        if (mask[lane]) {
+            execute_lane(lane, opcode);
+        }
+    }
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            //00E0 and the display opcodes, not 00EE, 00FD or an unknown one
+            if ((opcode & 0x00FF) == 0xE0 || (opcode & 0x00E0) == 0xC0 || ((opcode & 0x00FF) >= 0xFB && (opcode & 0x00FF) != 0xFD)) {
+                shared_pc += 2;
+                return true;
+            }
+            return false;
+        case 0x2000:
+            shared_pc = opcode & 0x0FFF;
+            return true;
+        case 0xC000:
+        case 0xD000:
+            shared_pc += 2;
+            return true;
+        case 0xF000:
+            if (opcode != 0xF002 && (opcode & 0x00FF) == 0x02) {
+                return false;   // Only F002 itself, any other FX02 stops the lane
+            }
+            switch (opcode & 0x00FF) {
+                case 0x01:
+                case 0x02:
+                case 0x1E:
+                case 0x29:
+                case 0x30:
+                case 0x33:
+                case 0x3A:
+                case 0x55:
+                case 0x65:
+                    shared_pc += 2;
+                    return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+// Scalar reference path, executeOpcode() on the lane's slice of the arrays
+void LockstepCore::execute_lane(uint32_t lane, uint16_t opcode){
+    _stats.scalar_ops++;
+    uint8_t X = (opcode & 0x0F00) >> MAX_8;
+    uint8_t Y = (opcode & 0x00F0) >> 4;
+    uint8_t& VX = V[X * _stride + lane];
+    uint8_t& VY = V[Y * _stride + lane];
+    uint8_t& VF = V[0xF * _stride + lane];
+    uint16_t& pc = PC[lane];
+    uint16_t& index = INDEX[lane];
+    uint8_t& sp = SP[lane];
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            switch (opcode & 0x00FF) {
+                case 0xE0:
+                    displays[lane].clear();
+                    pc += 2;
+                break;
+                case 0xEE:
+                    if (sp <= 0) {
+                        stop_lane(lane);
+                    }
+                    else {
+                        pc = STACK[--sp * _stride + lane];
+                    }
+                break;
+                case 0xFB:
+                    displays[lane].scroll_right();
+                    pc += 2;
+                break;
+                case 0xFC:
+                    displays[lane].scroll_left();
+                    pc += 2;
+                break;
+                case 0xFE:
+                case 0xFF:
+                    displays[lane].set_hires(opcode & 0x1);
+                    pc += 2;
+                break;
+                default:
+                    if ((opcode & 0x00F0) == 0xC0) {
+                        displays[lane].scroll_down(opcode & 0x000F);
+                        pc += 2;
+                    }
+                    else if ((opcode & 0x00F0) == 0xD0) {
+                        displays[lane].scroll_up(opcode & 0x000F);
+                        pc += 2;
+                    }
+                    else {
+                        stop_lane(lane);    // 00FD exits, the rest is unknown
+                    }
+                break;
+            }
+        break;
+        case 0x1000:
+            pc = opcode & 0x0FFF;
+        break;
+        case 0x2000:
+            if (sp < MAX_16) {
+                STACK[sp++ * _stride + lane] = pc + 2;
+                pc = opcode & 0x0FFF;
+            }
+            else {
+                stop_lane(lane);
+            }
+        break;
+        case 0x3000:
+            pc += VX == (opcode & 0x00FF) ? 4 : 2;
+        break;
+        case 0x4000:
+            pc += VX != (opcode & 0x00FF) ? 4 : 2;
+        break;
+        case 0x5000:
+            pc += VX == VY ? 4 : 2;
+        break;
+        case 0x6000:
+            VX = opcode & 0x00FF;
+            pc += 2;
+        break;
+        case 0x7000:
+            VX += opcode & 0x00FF;
+            pc += 2;
+        break;
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0:
+                    VX = VY;
+                break;
+                case 0x1:
+                    VX |= VY;
+                    if (quirk4) {
+                        VF = 0;
+                    }
+                break;
+                case 0x2:
+                    VX &= VY;
+                    if (quirk4) {
+                        VF = 0;
+                    }
+                break;
+                case 0x3:
+                    VX ^= VY;
+                    if (quirk4) {
+                        VF = 0;
+                    }
+                break;
+                case 0x4:
+                    VF = ((VX + VY) > 0xFF) ? 1 : 0;
+                    VX = (VX + VY) & 0xFF;
+                break;
+                case 0x5:
+                    VF = (VX > VY) ? 1 : 0;
+                    VX -= VY;
+                break;
+                case 0x6:
+                    if (quirk5) {
+                        VF = VX & 0x1;
+                        VX >>= 1;
+                    }
+                    else {
+                        VF = VY & 0x1;
+                        VX = VY >> 1;
+                    }
+                break;
+                case 0x7:
+                    VF = (VY > VX) ? 1 : 0;
+                    VX = VY - VX;
+                break;
+                case 0xE:
+                    if (quirk5) {
+                        VF = (VX & 0x80) ? 1 : 0;
+                        VX <<= 1;
+                    }
+                    else {
+                        VF = (VY & 0x80) ? 1 : 0;
+                        VX = VY << 1;
+                    }
+                break;
+                default:
+                    stop_lane(lane);
+                    return;
+            }
+            pc += 2;
+        break;
+        case 0x9000:
+            pc += VX != VY ? 4 : 2;
+        break;
+        case 0xA000:
+            index = opcode & 0x0FFF;
+            pc += 2;
+        break;
+        case 0xB000:
+            pc = (opcode & 0x0FFF) + V[lane];
+        break;
+        case 0xC000: {
+            VX = random[lane].next_byte() & (opcode & 0x00FF);
+            pc += 2;
+        }
+        break;
+        case 0xD000:
+            draw_sprite(lane, X, Y, opcode & 0x000F);
+            pc += 2;
+        break;
+        case 0xE000:
+            switch (opcode & 0x00FF) {
+                case 0x9E:
+                    pc += key_pressed(lane, VX) ? 4 : 2;
+                break;
+                case 0xA1:
+                    pc += !key_pressed(lane, VX) ? 4 : 2;
+                break;
+                default:
+                    stop_lane(lane);
+                break;
+            }
+        break;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x07:
+                    VX = DELAYTIMER[lane];
+                    pc += 2;
+                break;
+                case 0x15:
+                    DELAYTIMER[lane] = VX;
+                    pc += 2;
+                break;
+                case 0x18:
+                    SOUNDTIMER[lane] = VX;
+                    pc += 2;
+                break;
+                case 0x0A: {
+                    //Press and release like ChippyCore::get_released_key()
+                    uint8_t& waiting = fx0a_key[lane];
+                    if (waiting == NO_KEY) {
+                        if (keys[lane]) {
+                            waiting = __builtin_ctz(keys[lane]);
+                        }
+                    }
+                    else if (!key_pressed(lane, waiting)) {
+                        VX = waiting;
+                        waiting = NO_KEY;
+                        pc += 2;
+                    }
+                }
+                break;
+                case 0x1E:
+                    index += VX;
+                    VF = (index > 0xFFF) ? 1 : 0;
+                    index &= 0xFFF;
+                    pc += 2;
+                break;
+                case 0x29:
+                    index = 0x50 + (VX * 5);
+                    pc += 2;
+                break;
+                case 0x30:
+                    index = BIG_FONTSET_START_ADDRESS + (VX & 0xF) * 10;
+                    pc += 2;
+                break;
+                case 0x01:
+                    displays[lane].plane_mask = X & ((1 << DISPLAY_PLANES) - 1);
+                    pc += 2;
+                break;
+                case 0x02:
+                    if (opcode != 0xF002) {
+                        stop_lane(lane);
+                        break;
+                    }
+                    pc += 2;    // F002: no audio output in lockstep runs
+                break;
+                case 0x3A:
+                    pc += 2;    // FX3A: no audio output in lockstep runs
+                break;
+                case 0x33: {
+                    uint8_t value = VX;
+                    write_memory(lane, index, value / 100);
+                    write_memory(lane, index + 1, (value / 10) % 10);
+                    write_memory(lane, index + 2, value % 10);
+                    pc += 2;
+                }
+                break;
+                case 0x55:
+                    for (uint8_t reg = 0; reg <= X; ++reg) {
+                        write_memory(lane, index + reg, V[reg * _stride + lane]);
+                    }
+                    if (quirk11) {
+                        index += X + 1;
+                    }
+                    pc += 2;
+                break;
+                case 0x65: {
+                    const uint8_t* ram = RAM.data() + static_cast<size_t>(lane) * RAM_SIZE;
+                    for (uint8_t reg = 0; reg <= X; ++reg) {
+                        V[reg * _stride + lane] = ram[(index + reg) & LOCKSTEP_ADDRESS_MASK];
+                    }
+                    if (quirk11) {
+                        index += X + 1;
+                    }
+                    pc += 2;
+                }
+                break;
+                default:
+                    stop_lane(lane);
+                break;
+            }
+        break;
+    }
+}
+
+// ChippyCore::blit_sprite() on the lane's display
+void LockstepCore::draw_sprite(uint32_t lane, uint8_t X, uint8_t Y, uint8_t N){
+    const uint8_t* ram = RAM.data() + static_cast<size_t>(lane) * RAM_SIZE;
+    ChippyDisplay& display = displays[lane];
+    uint8_t& VF = V[0xF * _stride + lane];
+    uint16_t index = INDEX[lane] & LOCKSTEP_ADDRESS_MASK;
+    VF = 0;
+    uint8_t x = V[X * _stride + lane];
+    uint8_t y = V[Y * _stride + lane];
+    uint8_t length = (N ? N : 32) * display.selected_planes();
+    uint8_t copy[SPRITE_MAX_BYTES];
+    const uint8_t* sprite = ram + index;
+    if (index + length > RAM_SIZE) {
+        for (uint8_t i = 0; i < length; i++) {
+            copy[i] = ram[(index + i) & LOCKSTEP_ADDRESS_MASK];
+        }
+        sprite = copy;
+    }
+    auto ignore = [](uint8_t, uint8_t, uint8_t, uint64_t){};
+    bool collision = quirk6 ? display.draw<true>(x, y, N, sprite, ignore) : display.draw<false>(x, y, N, sprite, ignore);
+    VF = collision ? 1 : 0;
+}
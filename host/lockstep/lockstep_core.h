@@ -0,0 +1,110 @@
+#ifndef LOCKSTEP_CORE_H
+#define LOCKSTEP_CORE_H
+
+#include "chippycore.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Lockstep execution of many instances of the same ROM, stored as structure of arrays: register Vx of
+// every lane is one contiguous byte array, so one SSE2/AVX2 instruction updates 16 or 32 lanes. While
+// the lanes share a PC (and the opcode there) an opcode is decoded once and runs as a vector kernel
+// under the mask of the lanes that are still running. Lanes that went elsewhere run the scalar path one
+// opcode per step, until they meet the others again. ChippyCore::executeOpcode() is the reference:
+// every lane ends up in the state a ChippyCore run with the same seed and keypad would reach.
+//
+// Differences to ChippyCore: no callbacks and no scheduler (run_frame() only), no key event queue
+// (set_keypad_mask() per lane), addresses wrap at 4 KB, and an error stops the lane without the delay.
+
+#define LOCKSTEP_LANE_ALIGN 32      // Lane count granularity, one AVX2 vector of byte registers
+#define LOCKSTEP_MAX_GROUPS 4       // PC groups per step that get the vector kernels, the lanes left run scalar
+
+struct LockstepStats {
+    uint64_t steps;             // Opcode steps, each one runs one opcode on every running lane
+    uint64_t uniform_steps;     // Steps where every running lane had the same PC and opcode
+    uint64_t groups;            // Lane groups that ran one opcode together, at least one per step
+    uint64_t vector_ops;        // Groups whose opcode ran as a vector kernel
+    uint64_t scalar_ops;        // Opcodes executed lane by lane (divergent lanes and complex opcodes)
+};
+
+class LockstepCore {
+    public:
+        explicit LockstepCore(uint32_t lanes);
+
+        //Loads the ROM into every lane and resets them, config like load_and_run(). False when it does not fit.
+        bool load(const uint8_t* data, size_t dataSize, const bool* config);
+        //Lane RNG for CXNN, draws the same numbers as ChippyCore after set_random_seed(seed)
+        void seed_lane(uint32_t lane, uint32_t seed);
+        void set_keypad_mask(uint32_t lane, uint16_t mask);
+
+        //Like ChippyCore::run_frame() on every lane, returns the opcodes executed over all lanes
+        uint64_t run_frame(uint16_t instructionsPerFrame);
+
+        uint32_t lanes() const;
+        bool lane_running(uint32_t lane) const;
+        uint64_t lane_instructions(uint32_t lane) const;
+        CpuState get_cpu_state(uint32_t lane) const;
+        const uint64_t* get_framebuffer(uint32_t lane) const;
+        DisplayFrame get_display_frame(uint32_t lane) const;
+        LockstepStats get_stats() const;
+
+        //Kernel width this file was compiled for: "avx2", "sse2" or "scalar"
+        static const char* simd_name();
+
+    private:
+        uint32_t _lanes;                // Requested lanes
+        uint32_t _stride;               // Lanes rounded up to LOCKSTEP_LANE_ALIGN, the padding never runs
+
+        //Structure of arrays, index [register * _stride + lane]
+        std::vector<uint8_t> V;
+        std::vector<uint16_t> STACK;
+        std::vector<uint16_t> PC;
+        std::vector<uint16_t> INDEX;
+        std::vector<uint8_t> SP;
+        std::vector<uint8_t> DELAYTIMER;
+        std::vector<uint8_t> SOUNDTIMER;
+
+        //Per lane memory, index [lane * RAM_SIZE], and per lane display
+        std::vector<uint8_t> RAM;
+        std::vector<ChippyDisplay> displays;
+
+        std::vector<uint16_t> keys;
+        std::vector<uint8_t> fx0a_key;
+        std::vector<FastRandom> random;
+
+        std::vector<uint8_t> active;    // 0xFF while the lane runs
+        std::vector<uint8_t> group;     // 0xFF for the lanes that run the current group opcode
+        std::vector<uint8_t> pending;   // 0xFF for the lanes that have not run the current step yet
+        std::vector<uint8_t> condition; // Skip results of the current group opcode
+        std::vector<uint8_t> frame_mask; // Lanes running at the start of the frame, their timers tick
+        std::vector<uint64_t> stopped_at;
+        std::vector<uint8_t> code_written; // Addresses some lane wrote, opcodes there may differ per lane
+
+        bool quirk4;
+        bool quirk5;
+        bool quirk6;
+        bool quirk11;
+
+        uint32_t running;               // Lanes still running
+        bool uniform;                   // Every running lane is at shared_pc with the same opcode
+        uint16_t shared_pc;
+        LockstepStats _stats;
+
+        uint16_t fetch(uint32_t lane) const;
+        void write_memory(uint32_t lane, uint16_t address, uint8_t value);
+        void stop_lane(uint32_t lane);
+        bool key_pressed(uint32_t lane, uint8_t key) const;
+
+        void step();
+        uint32_t regroup(uint16_t& opcode);
+        bool execute_group(uint16_t opcode, const uint8_t* mask);
+        bool execute_lanes(uint16_t opcode, const uint8_t* mask);
+        void execute_lane(uint32_t lane, uint16_t opcode);
+        void draw_sprite(uint32_t lane, uint8_t X, uint8_t Y, uint8_t N);
+        void set_group_pc(const uint8_t* mask, uint16_t pc);
+        bool skip_group_pc(const uint8_t* mask);
+        void tick_timers(const uint8_t* mask);
+};
+
+#endif
@@ -0,0 +1,293 @@
+#include "chippypack.h"
+#include "../bench/bench_roms.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Builds and inspects ROM packs (chippypack.h). The quirk profile and speed options apply to every ROM
+// after them, --name only to the next one (the default is the file name). --bench adds the bundled
+// benchmark ROMs. Identical ROMs are stored once. --list and --find read a pack through mmap, the way
+// the firmware reads it from a flash partition.
+//
+//   chippy_pack -o PACK [--profile NAME] [--ipf N] [--name NAME] [--bench] ROM...
+//   chippy_pack --list PACK
+//   chippy_pack --find PACK ROM...
+
+struct PackProfile {
+    const char* name;
+    uint8_t quirks;
+};
+
+static const PackProfile PACK_PROFILES[] = {
+    {"none",   QuirkProfile::None},
+    {"cosmac", QuirkProfile::CosmacVIP},
+    {"schip",  QuirkProfile::SChip},
+    {"chip48", QuirkProfile::Chip48},
+    {"xochip", QuirkProfile::XOChip},
+    {"wrap",   QUIRK_MASK_WRAP},
+};
+
+struct PackRom {
+    std::string name;
+    std::vector<uint8_t> data;
+    uint8_t quirks;
+    uint16_t ipf;
+    uint32_t hash;
+};
+
+static const char* profile_name(uint8_t quirks){
+    for(const PackProfile& profile : PACK_PROFILES){
+        if(profile.quirks == quirks){
+            return profile.name;
+        }
+    }
+    return "custom";
+}
+
+static bool read_file(const char* file, std::vector<uint8_t>& data){
+    std::ifstream stream(file, std::ios::binary);
+    if(!stream){
+        std::fprintf(stderr, "cannot read %s\n", file);
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static std::string base_name(const char* file){
+    std::string name(file);
+    size_t slash = name.find_last_of('/');
+    return slash == std::string::npos ? name : name.substr(slash + 1);
+}
+
+static void put16(std::vector<uint8_t>& out, size_t at, uint16_t value){
+    out[at] = value & 0xFF;
+    out[at + 1] = value >> 8;
+}
+
+static void put32(std::vector<uint8_t>& out, size_t at, uint32_t value){
+    put16(out, at, value & 0xFFFF);
+    put16(out, at + 2, value >> 16);
+}
+
+static bool add_rom(std::vector<PackRom>& roms, PackRom rom){
+    if(rom.data.empty() || rom.data.size() > RAM_SIZE - ROM_START_ADDRESS){
+        std::fprintf(stderr, "%s: %zu bytes, a ROM has 1 to %d\n", rom.name.c_str(), rom.data.size(), RAM_SIZE - ROM_START_ADDRESS);
+        return false;
+    }
+    rom.hash = ChippyPack::hash_rom(rom.data.data(), rom.data.size());
+    for(const PackRom& other : roms){
+        if(other.hash != rom.hash){
+            continue;
+        }
+        if(other.data == rom.data){
+            std::fprintf(stderr, "%s: same ROM as %s, skipped\n", rom.name.c_str(), other.name.c_str());
+            return true;
+        }
+        std::fprintf(stderr, "%s: hash %08x collides with %s\n", rom.name.c_str(), rom.hash, other.name.c_str());
+        return false;
+    }
+    roms.push_back(std::move(rom));
+    return true;
+}
+
+static bool build_pack(const std::vector<PackRom>& input, const char* output){
+    std::vector<const PackRom*> roms;
+    for(const PackRom& rom : input){
+        roms.push_back(&rom);
+    }
+    std::sort(roms.begin(), roms.end(), [](const PackRom* a, const PackRom* b){ return a->hash < b->hash; });
+    if(roms.size() > 0xFFFF){
+        std::fprintf(stderr, "a pack holds at most 65535 ROMs\n");
+        return false;
+    }
+
+    size_t offset = PACK_HEADER_SIZE + roms.size() * PACK_ENTRY_SIZE;
+    std::vector<uint8_t> image(offset, 0);
+    std::string names;
+    for(size_t index = 0; index < roms.size(); index++){
+        const PackRom& rom = *roms[index];
+        image.resize((image.size() + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN, 0);
+        size_t entry = PACK_HEADER_SIZE + index * PACK_ENTRY_SIZE;
+        put32(image, entry, rom.hash);
+        put32(image, entry + 4, static_cast<uint32_t>(image.size()));
+        put16(image, entry + 8, static_cast<uint16_t>(rom.data.size()));
+        put16(image, entry + 10, rom.ipf);
+        put16(image, entry + 12, static_cast<uint16_t>(names.size()));
+        image[entry + 14] = rom.quirks;
+        image.insert(image.end(), rom.data.begin(), rom.data.end());
+        names += rom.name;
+        names += '\0';
+        if(names.size() > 0x10000){
+            std::fprintf(stderr, "the ROM names exceed 64 KB\n");
+            return false;
+        }
+    }
+    size_t namesOffset = image.size();
+    image.insert(image.end(), names.begin(), names.end());
+    memcpy(image.data(), PACK_MAGIC, 4);
+    image[4] = PACK_VERSION;
+    put16(image, 6, static_cast<uint16_t>(roms.size()));
+    put32(image, 8, static_cast<uint32_t>(namesOffset));
+    put32(image, 12, static_cast<uint32_t>(image.size()));
+
+    //The reader checks what the firmware would
+    ChippyPack check;
+    if(!check.open(image.data(), image.size())){
+        std::fprintf(stderr, "internal error: the pack does not verify\n");
+        return false;
+    }
+    FILE* file = std::fopen(output, "wb");
+    if(!file || std::fwrite(image.data(), 1, image.size(), file) != image.size()){
+        std::fprintf(stderr, "cannot write %s\n", output);
+        if(file){
+            std::fclose(file);
+        }
+        return false;
+    }
+    std::fclose(file);
+    std::printf("%s: %zu ROMs, %zu bytes\n", output, roms.size(), image.size());
+    return true;
+}
+
+// Maps a pack read-only, returns nullptr on failure
+static const uint8_t* map_pack(const char* file, size_t& size){
+    int fd = ::open(file, O_RDONLY);
+    if(fd < 0){
+        std::fprintf(stderr, "cannot read %s\n", file);
+        return nullptr;
+    }
+    struct stat info;
+    void* mapped = MAP_FAILED;
+    if(!fstat(fd, &info) && info.st_size > 0){
+        size = static_cast<size_t>(info.st_size);
+        mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if(mapped == MAP_FAILED){
+        std::fprintf(stderr, "cannot map %s\n", file);
+        return nullptr;
+    }
+    return static_cast<const uint8_t*>(mapped);
+}
+
+static int inspect_pack(const char* file, const std::vector<const char*>& lookups, bool list){
+    size_t size = 0;
+    const uint8_t* data = map_pack(file, size);
+    if(!data){
+        return 1;
+    }
+    ChippyPack pack;
+    int status = 0;
+    if(!pack.open(data, size)){
+        std::fprintf(stderr, "%s is not a valid version %d pack\n", file, PACK_VERSION);
+        status = 1;
+    }
+    else if(list){
+        std::printf("%-8s %5s %5s %-7s  %s\n", "hash", "size", "ipf", "quirks", "name");
+        for(uint16_t index = 0; index < pack.count(); index++){
+            PackEntry entry;
+            pack.entry(index, entry);
+            std::printf("%08x %5u %5u %-7s  %s\n", entry.hash, entry.size, entry.instructions_per_frame, profile_name(entry.quirks), entry.name);
+        }
+    }
+    else{
+        for(const char* lookup : lookups){
+            std::vector<uint8_t> rom;
+            PackEntry entry;
+            if(!read_file(lookup, rom)){
+                status = 1;
+            }
+            else if(pack.find(rom.data(), rom.size(), entry)){
+                std::printf("%s: %s, %s, %u ipf\n", lookup, entry.name, profile_name(entry.quirks), entry.instructions_per_frame);
+            }
+            else{
+                std::printf("%s: not in the pack\n", lookup);
+                status = 2;
+            }
+        }
+    }
+    munmap(const_cast<uint8_t*>(data), size);
+    return status;
+}
+
+static void usage(const char* program){
+    std::fprintf(stderr, "usage: %s -o PACK [--profile NAME] [--ipf N] [--name NAME] [--bench] ROM...\n"
+                         "       %s --list PACK\n"
+                         "       %s --find PACK ROM...\n", program, program, program);
+}
+
+int main(int argc, char** argv){
+    if(argc >= 3 && !strcmp(argv[1], "--list")){
+        return inspect_pack(argv[2], {}, true);
+    }
+    if(argc >= 4 && !strcmp(argv[1], "--find")){
+        return inspect_pack(argv[2], std::vector<const char*>(argv + 3, argv + argc), false);
+    }
+
+    const char* output = nullptr;
+    uint8_t quirks = QuirkProfile::None;
+    uint16_t ipf = 0;
+    const char* name = nullptr;
+    std::vector<PackRom> roms;
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "-o") && hasValue){
+            output = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--profile") && hasValue){
+            const char* profileName = argv[++i];
+            bool found = false;
+            for(const PackProfile& profile : PACK_PROFILES){
+                if(!strcmp(profileName, profile.name)){
+                    quirks = profile.quirks;
+                    found = true;
+                }
+            }
+            if(!found){
+                std::fprintf(stderr, "unknown profile %s\n", profileName);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--name") && hasValue){
+            name = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--bench")){
+            for(const BenchRom& rom : BENCH_ROMS){
+                if(!add_rom(roms, {rom.name, std::vector<uint8_t>(rom.data, rom.data + rom.size), quirks, ipf, 0})){
+                    return 1;
+                }
+            }
+        }
+        else if(argv[i][0] != '-'){
+            PackRom rom = {name ? name : base_name(argv[i]), {}, quirks, ipf, 0};
+            name = nullptr;
+            if(!read_file(argv[i], rom.data) || !add_rom(roms, std::move(rom))){
+                return 1;
+            }
+        }
+        else{
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(!output){
+        usage(argv[0]);
+        return 1;
+    }
+    return build_pack(roms, output) ? 0 : 1;
+}
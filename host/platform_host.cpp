@@ -0,0 +1,49 @@
+#include "platform.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+// Host implementation of the platform layer used by the CMake build.
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+uint32_t platform_millis(){
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count());
+}
+
+uint32_t platform_micros(){
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count());
+}
+
+void platform_delay(uint32_t ms){
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// One generator per thread, so headless instances on different threads never share state
+static thread_local std::minstd_rand generator(std::random_device{}());
+
+uint32_t platform_random(){
+    return static_cast<uint32_t>(generator()) ^ (static_cast<uint32_t>(generator()) << 16);
+}
+
+void platform_log(const char* message){
+    std::fprintf(stderr, "%s\n", message);
+}
+
+#if defined(__linux__)
+// The executable's text, read-only data and initialized data, as laid out by the default linker script
+extern "C" char __executable_start[];
+extern "C" char edata[];
+
+bool platform_is_static(const void* data){
+    uintptr_t address = reinterpret_cast<uintptr_t>(data);
+    return address >= reinterpret_cast<uintptr_t>(__executable_start) && address < reinterpret_cast<uintptr_t>(edata);
+}
+#else
+// No portable way to tell, so every ROM is copied
+bool platform_is_static(const void*){
+    return false;
+}
+#endif
@@ -0,0 +1,262 @@
+#include "chippycore.h"
+#include "../bench/bench_roms.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+// Profiles a ROM headless and prints the counters as CSV tables, or converts a record captured from
+// the firmware (ChippyProfile::write_record() sent over Serial) to the same CSV. Needs the core built
+// with CHIPPY_PROFILE (cmake -DCHIPPY_PROFILE=ON).
+//
+//   chippy_profile [--frames N] [--ipf N] [--engine NAME] [--top N] [-o RECORD] (--rom NAME | ROM)
+//   chippy_profile --decode RECORD [--top N]
+
+struct ProfileEngine {
+    const char* name;
+    uint8_t engine;
+};
+
+static const ProfileEngine PROFILE_ENGINES[] = {
+    {"switch", ENGINE_SWITCH},
+    {"table",  ENGINE_TABLE},
+    {"goto",   ENGINE_GOTO},
+    {"cached", ENGINE_CACHED},
+    {"blocks", ENGINE_BLOCKS},
+};
+
+static const char* const CALLBACK_NAMES[PROFILE_CALLBACKS] = {"draw_pixel", "screen", "loop", "present"};
+
+struct ProfileOptions {
+    uint32_t frames = 600;
+    uint16_t ipf = 1000;
+    uint8_t engine = ENGINE_BLOCKS;
+    uint32_t top = 0;               // 0 lists every hot PC in address order
+    const char* output = nullptr;
+    const char* decode = nullptr;
+    const char* romName = nullptr;
+    const char* romFile = nullptr;
+};
+
+static uint16_t get16(const uint8_t* p){
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p){
+    return get16(p) | (static_cast<uint32_t>(get16(p + 2)) << 16);
+}
+
+static bool read_file(const char* file, std::vector<uint8_t>& data){
+    std::ifstream stream(file, std::ios::binary);
+    if(!stream){
+        std::fprintf(stderr, "cannot read %s\n", file);
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Back from the write_record() layout, false for a damaged record or one of another build
+static bool read_record(const std::vector<uint8_t>& record, ChippyProfile& profile){
+    const size_t fixed = PROFILE_HEADER_SIZE + 4 * (PROFILE_OP_CLASSES + 3 * PROFILE_CALLBACKS + PROFILE_FRAME_BUCKETS) + 2;
+    if(record.size() < fixed || memcmp(record.data(), PROFILE_MAGIC, 4) || record[4] != PROFILE_VERSION ||
+       record[5] != PROFILE_OP_CLASSES || record[6] != PROFILE_CALLBACKS || record[7] != PROFILE_FRAME_BUCKETS){
+        return false;
+    }
+    profile.reset();
+    const uint8_t* p = record.data() + 8;
+    profile.frames = get32(p);
+    profile.max_frame_micros = get32(p + 4);
+    p += 8;
+    for(uint8_t opClass = 0; opClass < PROFILE_OP_CLASSES; opClass++, p += 4){
+        profile.op_counts[opClass] = get32(p);
+    }
+    for(uint8_t callback = 0; callback < PROFILE_CALLBACKS; callback++, p += 12){
+        profile.callbacks[callback] = {get32(p), get32(p + 4), get32(p + 8)};
+    }
+    for(uint8_t bucket = 0; bucket < PROFILE_FRAME_BUCKETS; bucket++, p += 4){
+        profile.frame_buckets[bucket] = get32(p);
+    }
+    uint16_t hot = get16(p);
+    p += 2;
+    if(record.size() < fixed + hot * 6u){
+        return false;
+    }
+    for(uint16_t i = 0; i < hot; i++, p += 6){
+        profile.pc_hits[(get16(p) & (RAM_SIZE - 1)) >> 1] = get32(p + 2);
+    }
+    return true;
+}
+
+static void print_csv(const ChippyProfile& profile, uint32_t top){
+    std::printf("metric,value\n");
+    std::printf("frames,%u\n", profile.frames);
+    std::printf("frame_p50_us,%u\n", profile.frame_percentile(50));
+    std::printf("frame_p90_us,%u\n", profile.frame_percentile(90));
+    std::printf("frame_p99_us,%u\n", profile.frame_percentile(99));
+    std::printf("frame_max_us,%u\n", profile.max_frame_micros);
+
+    uint64_t total = 0;
+    for(uint32_t count : profile.op_counts){
+        total += count;
+    }
+    std::printf("\nop_class,count,percent\n");
+    for(uint8_t opClass = 0; opClass < PROFILE_OP_CLASSES; opClass++){
+        if(profile.op_counts[opClass]){
+            std::printf("%s,%u,%.3f\n", ChippyProfile::op_class_name(opClass), profile.op_counts[opClass],
+                        100.0 * profile.op_counts[opClass] / total);
+        }
+    }
+
+    std::printf("\ncallback,calls,total_us,max_us\n");
+    for(uint8_t callback = 0; callback < PROFILE_CALLBACKS; callback++){
+        const ProfileCallbackTime& time = profile.callbacks[callback];
+        std::printf("%s,%u,%u,%u\n", CALLBACK_NAMES[callback], time.calls, time.micros, time.max_micros);
+    }
+
+    std::printf("\nframe_us_up_to,frames\n");
+    for(uint8_t bucket = 0; bucket < PROFILE_FRAME_BUCKETS; bucket++){
+        if(profile.frame_buckets[bucket]){
+            std::printf("%u,%u\n", ChippyProfile::bucket_limit(bucket), profile.frame_buckets[bucket]);
+        }
+    }
+
+    std::vector<uint16_t> hot;
+    for(uint16_t slot = 0; slot < RAM_SIZE / 2; slot++){
+        if(profile.pc_hits[slot]){
+            hot.push_back(slot);
+        }
+    }
+    if(top && top < hot.size()){
+        std::partial_sort(hot.begin(), hot.begin() + top, hot.end(), [&](uint16_t a, uint16_t b){
+            return profile.pc_hits[a] > profile.pc_hits[b];
+        });
+        hot.resize(top);
+    }
+    std::printf("\npc,hits,percent\n");
+    for(uint16_t slot : hot){
+        std::printf("0x%03X,%u,%.3f\n", slot << 1, profile.pc_hits[slot], 100.0 * profile.pc_hits[slot] / total);
+    }
+}
+
+static void usage(const char* program){
+    std::fprintf(stderr, "usage: %s [--frames N] [--ipf N] [--engine NAME] [--top N] [-o RECORD] (--rom NAME | ROM)\n"
+                         "       %s --decode RECORD [--top N]\n", program, program);
+}
+
+int main(int argc, char** argv){
+    ProfileOptions options;
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--frames") && hasValue){
+            options.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            options.ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--top") && hasValue){
+            options.top = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--engine") && hasValue){
+            const char* name = argv[++i];
+            bool found = false;
+            for(const ProfileEngine& engine : PROFILE_ENGINES){
+                if(!strcmp(name, engine.name)){
+                    options.engine = engine.engine;
+                    found = true;
+                }
+            }
+            if(!found){
+                std::fprintf(stderr, "unknown engine %s\n", name);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "-o") && hasValue){
+            options.output = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--decode") && hasValue){
+            options.decode = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--rom") && hasValue){
+            options.romName = argv[++i];
+        }
+        else if(argv[i][0] != '-' && !options.romFile){
+            options.romFile = argv[i];
+        }
+        else{
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::unique_ptr<ChippyProfile> profile(new ChippyProfile());
+    if(options.decode){
+        std::vector<uint8_t> record;
+        if(!read_file(options.decode, record)){
+            return 1;
+        }
+        if(!read_record(record, *profile)){
+            std::fprintf(stderr, "%s is not a version %d profile record of this build\n", options.decode, PROFILE_VERSION);
+            return 1;
+        }
+        print_csv(*profile, options.top);
+        return 0;
+    }
+
+    std::vector<uint8_t> rom;
+    if(options.romFile){
+        if(!read_file(options.romFile, rom)){
+            return 1;
+        }
+    }
+    else if(options.romName){
+        for(const BenchRom& bench : BENCH_ROMS){
+            if(!strcmp(bench.name, options.romName)){
+                rom.assign(bench.data, bench.data + bench.size);
+            }
+        }
+        if(rom.empty()){
+            std::fprintf(stderr, "unknown bench ROM %s\n", options.romName);
+            return 1;
+        }
+    }
+    else{
+        usage(argv[0]);
+        return 1;
+    }
+
+    static const bool config[4] = {false, false, false, false};
+    std::unique_ptr<ChippyCore> core(new ChippyCore());
+    core->set_engine(options.engine);
+    if(!core->start_profile()){
+        std::fprintf(stderr, "cannot allocate the profile\n");
+        return 1;
+    }
+    core->load_and_run(rom.data(), rom.size(), nullptr, nullptr, nullptr, config);
+    for(uint32_t frame = 0; frame < options.frames && core->isRunning(); frame++){
+        core->run_frame(options.ipf);
+    }
+
+    //Through the record, exactly what the firmware would send
+    std::vector<uint8_t> record(core->get_profile()->record_size());
+    core->get_profile()->write_record(record.data(), record.size());
+    if(options.output){
+        FILE* file = std::fopen(options.output, "wb");
+        bool ok = file && std::fwrite(record.data(), 1, record.size(), file) == record.size();
+        if(file){
+            ok = !std::fclose(file) && ok;
+        }
+        if(!ok){
+            std::fprintf(stderr, "cannot write %s\n", options.output);
+            return 1;
+        }
+    }
+    read_record(record, *profile);
+    print_csv(*profile, options.top);
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include "chippycore.h"
+#include "chippyreplay.h"
+#include "../bench/bench_roms.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
+// Records a session and replays it. Without --play the ROM runs headless for --frames frames while a
+// random keypad script presses keys in the middle of frames, through the event queue, and now and then
+// changes the speed. The recording is then replayed on a fresh core with every engine, and each replay
+// must end in the state of the recorded run. With --play a record (from the firmware, or written with
+// -o) is replayed --repeat times, printing the final state hash and the replay speed.
+//
+//   chippy_replay [--frames N] [--ipf N] [--seed N] [-o RECORD] (--rom NAME | ROM)
+//   chippy_replay --play RECORD [--engine NAME] [--repeat N]
+
+struct ReplayEngine {
+    const char* name;
+    uint8_t engine;
+};
+
+static const ReplayEngine REPLAY_ENGINES[] = {
+    {"switch", ENGINE_SWITCH},
+    {"table",  ENGINE_TABLE},
+    {"goto",   ENGINE_GOTO},
+    {"cached", ENGINE_CACHED},
+    {"blocks", ENGINE_BLOCKS},
+};
+
+struct ReplayOptions {
+    uint32_t frames = 3600;
+    uint16_t ipf = 1000;
+    uint32_t seed = 1;
+    uint32_t repeat = 1;
+    const ReplayEngine* engine = nullptr;
+    const char* output = nullptr;
+    const char* play = nullptr;
+    const char* romName = nullptr;
+    const char* romFile = nullptr;
+};
+
+static const uint8_t EMPTY_ROM[] = {0x12, 0x00};
+static const bool NO_QUIRKS[4] = {false, false, false, false};
+
+static bool read_file(const char* file, std::vector<uint8_t>& data){
+    std::ifstream stream(file, std::ios::binary);
+    if(!stream){
+        std::fprintf(stderr, "cannot read %s\n", file);
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// FNV-1a over a snapshot, everything the ROM can observe
+static uint32_t hash_state(const ChippyCore& core){
+    std::vector<uint8_t> snapshot(SNAPSHOT_SIZE);
+    core.save_state(snapshot.data(), snapshot.size());
+    uint32_t hash = 2166136261u;
+    for(uint8_t byte : snapshot){
+        hash = (hash ^ byte) * 16777619u;
+    }
+    return hash;
+}
+
+// Replays on a fresh core, returns the final state hash
+static uint32_t replay_on(const ChippyRecorder& recorder, uint8_t engine, uint32_t& frames, double& seconds){
+    std::unique_ptr<ChippyCore> core(new ChippyCore());
+    core->set_engine(engine);
+    core->load_and_run(EMPTY_ROM, sizeof(EMPTY_ROM), nullptr, nullptr, nullptr, NO_QUIRKS);
+    auto start = std::chrono::steady_clock::now();
+    frames = recorder.replay(*core);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return hash_state(*core);
+}
+
+static int record_session(const std::vector<uint8_t>& rom, const ReplayOptions& options){
+    std::unique_ptr<ChippyRecorder> recorder(new ChippyRecorder(options.frames * 2 + 16));
+    std::unique_ptr<ChippyCore> core(new ChippyCore());
+    core->set_engine(ENGINE_BLOCKS);
+    core->load_and_run(rom.data(), rom.size(), nullptr, nullptr, nullptr, NO_QUIRKS);
+    if(!recorder->start(*core)){
+        std::fprintf(stderr, "cannot allocate the recorder\n");
+        return 1;
+    }
+
+    //The first tick starts the recording
+    core->run_frame(options.ipf);
+    std::mt19937 random(options.seed);
+    uint16_t ipf = options.ipf;
+    uint16_t keys = 0;
+    uint32_t frames = 0;
+    for(; frames < options.frames && core->isRunning(); frames++){
+        if(random() % 300 == 0){
+            ipf = options.ipf / 2 + random() % options.ipf;
+        }
+        uint32_t split = random() % (ipf + 1);
+        core->run_instructions(split);
+        if(random() % 10 == 0){
+            keys = random() % 4 ? 0 : 1 << (random() % MAX_16);
+            core->set_keypad_mask(keys);
+        }
+        if(random() % 20 == 0){
+            core->push_key_event(random() % MAX_16, random() % 2);
+        }
+        core->run_instructions(ipf - split);
+        core->run_frame(0);
+    }
+    recorder->stop();
+    uint32_t expected = hash_state(*core);
+    ReplayStats stats = recorder->get_stats();
+    std::printf("recorded %u frames, %u events, %zu bytes, state %08x%s\n", stats.frames, stats.events, recorder->record_size(),
+                expected, stats.full ? " (events full, recording stopped early)" : "");
+
+    if(options.output){
+        std::vector<uint8_t> record(recorder->record_size());
+        recorder->write_record(record.data(), record.size());
+        FILE* file = std::fopen(options.output, "wb");
+        bool ok = file && std::fwrite(record.data(), 1, record.size(), file) == record.size();
+        if(file){
+            ok = !std::fclose(file) && ok;
+        }
+        if(!ok){
+            std::fprintf(stderr, "cannot write %s\n", options.output);
+            return 1;
+        }
+    }
+
+    uint32_t mismatches = 0;
+    for(const ReplayEngine& engine : REPLAY_ENGINES){
+        uint32_t replayed;
+        double seconds;
+        uint32_t hash = replay_on(*recorder, engine.engine, replayed, seconds);
+        bool match = hash == expected && (stats.full || replayed == frames);
+        mismatches += !match;
+        std::printf("%-8s %8u frames %8.3f s %8.0fx real time  state %08x  %s\n", engine.name, replayed, seconds,
+                    replayed / (60.0 * (seconds > 0 ? seconds : 1e-9)), hash, match ? "ok" : "MISMATCH");
+    }
+    return mismatches ? 2 : 0;
+}
+
+static int play_record(const ReplayOptions& options){
+    std::vector<uint8_t> data;
+    if(!read_file(options.play, data)){
+        return 1;
+    }
+    std::unique_ptr<ChippyRecorder> recorder(new ChippyRecorder(UINT16_MAX));
+    if(!recorder->read_record(data.data(), data.size())){
+        std::fprintf(stderr, "%s is not a version %d record of this build\n", options.play, REPLAY_VERSION);
+        return 1;
+    }
+    for(const ReplayEngine& engine : REPLAY_ENGINES){
+        if(options.engine && options.engine != &engine){
+            continue;
+        }
+        for(uint32_t run = 0; run < options.repeat; run++){
+            uint32_t replayed;
+            double seconds;
+            uint32_t hash = replay_on(*recorder, engine.engine, replayed, seconds);
+            std::printf("%-8s %8u frames %8.3f s %8.0fx real time  state %08x\n", engine.name, replayed, seconds,
+                        replayed / (60.0 * (seconds > 0 ? seconds : 1e-9)), hash);
+        }
+    }
+    return 0;
+}
+
+static void usage(const char* program){
+    std::fprintf(stderr, "usage: %s [--frames N] [--ipf N] [--seed N] [-o RECORD] (--rom NAME | ROM)\n"
+                         "       %s --play RECORD [--engine NAME] [--repeat N]\n", program, program);
+}
+
+int main(int argc, char** argv){
+    ReplayOptions options;
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--frames") && hasValue){
+            options.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--ipf") && hasValue){
+            options.ipf = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--seed") && hasValue){
+            options.seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--repeat") && hasValue){
+            options.repeat = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!strcmp(argv[i], "--engine") && hasValue){
+            const char* name = argv[++i];
+            for(const ReplayEngine& engine : REPLAY_ENGINES){
+                if(!strcmp(name, engine.name)){
+                    options.engine = &engine;
+                }
+            }
+            if(!options.engine){
+                std::fprintf(stderr, "unknown engine %s\n", name);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "-o") && hasValue){
+            options.output = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--play") && hasValue){
+            options.play = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--rom") && hasValue){
+            options.romName = argv[++i];
+        }
+        else if(argv[i][0] != '-' && !options.romFile){
+            options.romFile = argv[i];
+        }
+        else{
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(options.play){
+        return play_record(options);
+    }
+    std::vector<uint8_t> rom;
+    if(options.romFile){
+        if(!read_file(options.romFile, rom)){
+            return 1;
+        }
+    }
+    else if(options.romName){
+        for(const BenchRom& bench : BENCH_ROMS){
+            if(!strcmp(bench.name, options.romName)){
+                rom.assign(bench.data, bench.data + bench.size);
+            }
+        }
+        if(rom.empty()){
+            std::fprintf(stderr, "unknown bench ROM %s\n", options.romName);
+            return 1;
+        }
+    }
+    else{
+        usage(argv[0]);
+        return 1;
+    }
+    return record_session(rom, options);
+}